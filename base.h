@@ -1,7 +1,18 @@
 #pragma once
 
+#ifdef _WIN32
 #define export __declspec(dllexport)
 #define import __declspec(dllimport)
+#else
+#define export __attribute__((visibility("default")))
+#define import
+#endif
+
+// SIMD paths are only compiled in when the compiler targets them (e.g. -msse4.1, -mavx2 or
+// -march=native), tcc always gets the scalar fallbacks
+#if defined(__SSE4_1__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 #define global static
 #define persist static
@@ -27,8 +38,17 @@ typedef u32          col32;
 #define WHITE rgb(255, 255, 255)
 #define BLACK rgb(0, 0, 0)
 
+// long is only 32 bits on Windows (LLP64). Elsewhere it matches size_t, which the forward
+// declarations below rely on. U64_FMT is the printf length and conversion for a u64: "%" U64_FMT.
+#ifdef _WIN32
+typedef long long          i64;
+typedef unsigned long long u64;
+#define U64_FMT "llu"
+#else
 typedef long          i64;
 typedef unsigned long u64;
+#define U64_FMT "lu"
+#endif
 
 #define KB(n) ((n) * 1024)
 #define MB(n) (KB(n) * 1024)
@@ -115,6 +135,55 @@ q6 q6_div(q6 a, q6 b) { return (q6)((a << 6) / b); }
 q6 q6_mul64(q6 a, q6 b) { return (q6)(((i64)a * (i64)b) >> 6); }
 q6 q6_div64(q6 a, q6 b) { return (q6)(((i64)a << 6) / b); }
 
+// 1.15.16 fixed point. Any product of two q16 overflows 32 bits, so there is only the 64-bit
+// multiply.
+typedef i32 q16;
+#define Q16(i32_val) ((q16)((i32_val) << 16))
+
+#define Q16_PI (q16)(205887)
+#define Q16_TAU (q16)(411775)
+
+q16 q16_from_i32(i32 val) { return val << 16; }
+i32 q16_to_i32(q16 val) { return val >> 16; }
+
+q16 q16_floor(q16 val) { return val & ~0xFFFF; }
+q16 q16_ceil(q16 val) { return (val + 0xFFFF) & ~0xFFFF; }
+q16 q16_round(q16 val) { return (val + 0x8000) & ~0xFFFF; }
+q16 q16_frac(q16 val) { return val & 0xFFFF; }
+
+q16 q16_mul(q16 a, q16 b) { return (q16)(((i64)a * (i64)b) >> 16); }
+q16 q16_div(q16 a, q16 b) { return (q16)(((i64)a << 16) / b); }
+
+// World space scalar: vectors, matrices and everything up to projection. q8 by default, build with
+// FX_Q16 defined for 16.16, which trades range (+-32768 instead of +-8M) for 256 times the
+// precision. Screen space (v2, rect) is q8 either way. fx_mul always goes through 64 bits.
+#ifdef FX_Q16
+typedef q16 fx;
+#define FX_BITS 16
+#define FX(i32_val) Q16(i32_val)
+#define FX_PI Q16_PI
+#define FX_TAU Q16_TAU
+#else
+typedef q8 fx;
+#define FX_BITS 8
+#define FX(i32_val) Q8(i32_val)
+#define FX_PI Q8_PI
+#define FX_TAU Q8_TAU
+#endif
+
+fx  fx_from_i32(i32 val) { return val << FX_BITS; }
+i32 fx_to_i32(fx val) { return val >> FX_BITS; }
+fx  fx_from_q8(q8 val) { return val << (FX_BITS - 8); }
+q8  fx_to_q8(fx val) { return val >> (FX_BITS - 8); }
+
+fx fx_mul(fx a, fx b) { return (fx)(((i64)a * (i64)b) >> FX_BITS); }
+fx fx_div(fx a, fx b) { return (fx)(((i64)a << FX_BITS) / b); }
+
+fx fx_from_q16(q16 val) { return (fx)(((i64)val << FX_BITS) >> 16); }
+
+// a at t = 0, b at t = Q16(1)
+fx fx_lerp(fx a, fx b, q16 t) { return a + (fx)(((i64)(b - a) * t) >> 16); }
+
 typedef float f32;
 typedef f32   rad;
 typedef f32   deg;
@@ -141,8 +210,8 @@ v2i v2i_from_v2(v2 v) {
 }
 
 typedef union {
-    struct { q8 x, y, z; };
-    struct { q8 r, g, b; };
+    struct { fx x, y, z; };
+    struct { fx r, g, b; };
 } v3;
 
 typedef union {
@@ -168,80 +237,771 @@ inline v3 v3_sub(v3 a, v3 b) {
 
 inline v3 v3_mul(v3 a, v3 b) {
     return (v3){
-        .x = q8_mul64(a.x, b.x),
-        .y = q8_mul64(a.y, b.y),
-        .z = q8_mul64(a.z, b.z),
+        .x = fx_mul(a.x, b.x),
+        .y = fx_mul(a.y, b.y),
+        .z = fx_mul(a.z, b.z),
     };
 }
 
-inline q8 v3_dot(v3 a, v3 b) {
-    return q8_mul64(a.x, b.x) + q8_mul64(a.y, b.y) + q8_mul64(a.z, b.z);
+inline fx v3_dot(v3 a, v3 b) {
+    return fx_mul(a.x, b.x) + fx_mul(a.y, b.y) + fx_mul(a.z, b.z);
 }
 
 inline v3 v3_cross(v3 a, v3 b) {
     return (v3){
-        .x = q8_mul64(a.y, b.z) - q8_mul64(a.z, b.y),
-        .y = q8_mul64(a.z, b.x) - q8_mul64(a.x, b.z),
-        .z = q8_mul64(a.x, b.y) - q8_mul64(a.y, b.x),
+        .x = fx_mul(a.y, b.z) - fx_mul(a.z, b.y),
+        .y = fx_mul(a.z, b.x) - fx_mul(a.x, b.z),
+        .z = fx_mul(a.x, b.y) - fx_mul(a.y, b.x),
     };
 }
 
+inline v3 v3_lerp(v3 a, v3 b, q16 t) {
+    return (v3){
+        .x = fx_lerp(a.x, b.x, t),
+        .y = fx_lerp(a.y, b.y, t),
+        .z = fx_lerp(a.z, b.z, t),
+    };
+}
+
+// Batched v3 math over structure-of-arrays, for systems that touch many positions at once. Every
+// function gives bit-exact results with its scalar v3_* counterpart, including the truncation of
+// fx_mul to 32 bits. dst may alias a or b.
+typedef struct {
+    fx *x, *y, *z;
+} v3soa;
+
+#if defined(__AVX2__)
+// fx_mul on 8 lanes. Only bits FX_BITS..FX_BITS + 31 of each 64-bit product survive, so a logical
+// shift works as well as the arithmetic one scalar code does.
+static inline __m256i fxx8_mul(__m256i a, __m256i b) {
+    __m256i even = _mm256_srli_epi64(_mm256_mul_epi32(a, b), FX_BITS);
+    __m256i odd  = _mm256_mul_epi32(_mm256_srli_epi64(a, 32), _mm256_srli_epi64(b, 32));
+    odd          = _mm256_slli_epi64(_mm256_srli_epi64(odd, FX_BITS), 32);
+    return _mm256_blend_epi32(even, odd, 0xAA);
+}
+
+#define I32X8_LOAD(ptr) _mm256_loadu_si256((__m256i *)(ptr))
+#define I32X8_STORE(ptr, val) _mm256_storeu_si256((__m256i *)(ptr), val)
+#endif
+
+#if defined(__SSE4_1__)
+static inline __m128i fxx4_mul(__m128i a, __m128i b) {
+    __m128i even = _mm_srli_epi64(_mm_mul_epi32(a, b), FX_BITS);
+    __m128i odd  = _mm_mul_epi32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    odd          = _mm_slli_epi64(_mm_srli_epi64(odd, FX_BITS), 32);
+    return _mm_blend_epi16(even, odd, 0xCC);
+}
+
+#define I32X4_LOAD(ptr) _mm_loadu_si128((__m128i *)(ptr))
+#define I32X4_STORE(ptr, val) _mm_storeu_si128((__m128i *)(ptr), val)
+#endif
+
+void v3soa_add(v3soa dst, v3soa a, v3soa b, i32 count) {
+    i32 i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= count; i += 8) {
+        I32X8_STORE(dst.x + i, _mm256_add_epi32(I32X8_LOAD(a.x + i), I32X8_LOAD(b.x + i)));
+        I32X8_STORE(dst.y + i, _mm256_add_epi32(I32X8_LOAD(a.y + i), I32X8_LOAD(b.y + i)));
+        I32X8_STORE(dst.z + i, _mm256_add_epi32(I32X8_LOAD(a.z + i), I32X8_LOAD(b.z + i)));
+    }
+#endif
+#if defined(__SSE4_1__)
+    for (; i + 4 <= count; i += 4) {
+        I32X4_STORE(dst.x + i, _mm_add_epi32(I32X4_LOAD(a.x + i), I32X4_LOAD(b.x + i)));
+        I32X4_STORE(dst.y + i, _mm_add_epi32(I32X4_LOAD(a.y + i), I32X4_LOAD(b.y + i)));
+        I32X4_STORE(dst.z + i, _mm_add_epi32(I32X4_LOAD(a.z + i), I32X4_LOAD(b.z + i)));
+    }
+#endif
+    for (; i < count; i++) {
+        dst.x[i] = a.x[i] + b.x[i];
+        dst.y[i] = a.y[i] + b.y[i];
+        dst.z[i] = a.z[i] + b.z[i];
+    }
+}
+
+void v3soa_sub(v3soa dst, v3soa a, v3soa b, i32 count) {
+    i32 i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= count; i += 8) {
+        I32X8_STORE(dst.x + i, _mm256_sub_epi32(I32X8_LOAD(a.x + i), I32X8_LOAD(b.x + i)));
+        I32X8_STORE(dst.y + i, _mm256_sub_epi32(I32X8_LOAD(a.y + i), I32X8_LOAD(b.y + i)));
+        I32X8_STORE(dst.z + i, _mm256_sub_epi32(I32X8_LOAD(a.z + i), I32X8_LOAD(b.z + i)));
+    }
+#endif
+#if defined(__SSE4_1__)
+    for (; i + 4 <= count; i += 4) {
+        I32X4_STORE(dst.x + i, _mm_sub_epi32(I32X4_LOAD(a.x + i), I32X4_LOAD(b.x + i)));
+        I32X4_STORE(dst.y + i, _mm_sub_epi32(I32X4_LOAD(a.y + i), I32X4_LOAD(b.y + i)));
+        I32X4_STORE(dst.z + i, _mm_sub_epi32(I32X4_LOAD(a.z + i), I32X4_LOAD(b.z + i)));
+    }
+#endif
+    for (; i < count; i++) {
+        dst.x[i] = a.x[i] - b.x[i];
+        dst.y[i] = a.y[i] - b.y[i];
+        dst.z[i] = a.z[i] - b.z[i];
+    }
+}
+
+void v3soa_mul(v3soa dst, v3soa a, v3soa b, i32 count) {
+    i32 i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= count; i += 8) {
+        I32X8_STORE(dst.x + i, fxx8_mul(I32X8_LOAD(a.x + i), I32X8_LOAD(b.x + i)));
+        I32X8_STORE(dst.y + i, fxx8_mul(I32X8_LOAD(a.y + i), I32X8_LOAD(b.y + i)));
+        I32X8_STORE(dst.z + i, fxx8_mul(I32X8_LOAD(a.z + i), I32X8_LOAD(b.z + i)));
+    }
+#endif
+#if defined(__SSE4_1__)
+    for (; i + 4 <= count; i += 4) {
+        I32X4_STORE(dst.x + i, fxx4_mul(I32X4_LOAD(a.x + i), I32X4_LOAD(b.x + i)));
+        I32X4_STORE(dst.y + i, fxx4_mul(I32X4_LOAD(a.y + i), I32X4_LOAD(b.y + i)));
+        I32X4_STORE(dst.z + i, fxx4_mul(I32X4_LOAD(a.z + i), I32X4_LOAD(b.z + i)));
+    }
+#endif
+    for (; i < count; i++) {
+        dst.x[i] = fx_mul(a.x[i], b.x[i]);
+        dst.y[i] = fx_mul(a.y[i], b.y[i]);
+        dst.z[i] = fx_mul(a.z[i], b.z[i]);
+    }
+}
+
+// Multiplies every vector by the same scalar
+void v3soa_scale(v3soa dst, v3soa a, fx s, i32 count) {
+    i32 i = 0;
+#if defined(__AVX2__)
+    __m256i s8 = _mm256_set1_epi32(s);
+    for (; i + 8 <= count; i += 8) {
+        I32X8_STORE(dst.x + i, fxx8_mul(I32X8_LOAD(a.x + i), s8));
+        I32X8_STORE(dst.y + i, fxx8_mul(I32X8_LOAD(a.y + i), s8));
+        I32X8_STORE(dst.z + i, fxx8_mul(I32X8_LOAD(a.z + i), s8));
+    }
+#endif
+#if defined(__SSE4_1__)
+    __m128i s4 = _mm_set1_epi32(s);
+    for (; i + 4 <= count; i += 4) {
+        I32X4_STORE(dst.x + i, fxx4_mul(I32X4_LOAD(a.x + i), s4));
+        I32X4_STORE(dst.y + i, fxx4_mul(I32X4_LOAD(a.y + i), s4));
+        I32X4_STORE(dst.z + i, fxx4_mul(I32X4_LOAD(a.z + i), s4));
+    }
+#endif
+    for (; i < count; i++) {
+        dst.x[i] = fx_mul(a.x[i], s);
+        dst.y[i] = fx_mul(a.y[i], s);
+        dst.z[i] = fx_mul(a.z[i], s);
+    }
+}
+
+void v3soa_dot(fx *dst, v3soa a, v3soa b, i32 count) {
+    i32 i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= count; i += 8) {
+        __m256i x = fxx8_mul(I32X8_LOAD(a.x + i), I32X8_LOAD(b.x + i));
+        __m256i y = fxx8_mul(I32X8_LOAD(a.y + i), I32X8_LOAD(b.y + i));
+        __m256i z = fxx8_mul(I32X8_LOAD(a.z + i), I32X8_LOAD(b.z + i));
+        I32X8_STORE(dst + i, _mm256_add_epi32(_mm256_add_epi32(x, y), z));
+    }
+#endif
+#if defined(__SSE4_1__)
+    for (; i + 4 <= count; i += 4) {
+        __m128i x = fxx4_mul(I32X4_LOAD(a.x + i), I32X4_LOAD(b.x + i));
+        __m128i y = fxx4_mul(I32X4_LOAD(a.y + i), I32X4_LOAD(b.y + i));
+        __m128i z = fxx4_mul(I32X4_LOAD(a.z + i), I32X4_LOAD(b.z + i));
+        I32X4_STORE(dst + i, _mm_add_epi32(_mm_add_epi32(x, y), z));
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = fx_mul(a.x[i], b.x[i]) + fx_mul(a.y[i], b.y[i]) + fx_mul(a.z[i], b.z[i]);
+    }
+}
+
+void v3soa_cross(v3soa dst, v3soa a, v3soa b, i32 count) {
+    i32 i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= count; i += 8) {
+        __m256i ax = I32X8_LOAD(a.x + i), ay = I32X8_LOAD(a.y + i), az = I32X8_LOAD(a.z + i);
+        __m256i bx = I32X8_LOAD(b.x + i), by = I32X8_LOAD(b.y + i), bz = I32X8_LOAD(b.z + i);
+        I32X8_STORE(dst.x + i, _mm256_sub_epi32(fxx8_mul(ay, bz), fxx8_mul(az, by)));
+        I32X8_STORE(dst.y + i, _mm256_sub_epi32(fxx8_mul(az, bx), fxx8_mul(ax, bz)));
+        I32X8_STORE(dst.z + i, _mm256_sub_epi32(fxx8_mul(ax, by), fxx8_mul(ay, bx)));
+    }
+#endif
+#if defined(__SSE4_1__)
+    for (; i + 4 <= count; i += 4) {
+        __m128i ax = I32X4_LOAD(a.x + i), ay = I32X4_LOAD(a.y + i), az = I32X4_LOAD(a.z + i);
+        __m128i bx = I32X4_LOAD(b.x + i), by = I32X4_LOAD(b.y + i), bz = I32X4_LOAD(b.z + i);
+        I32X4_STORE(dst.x + i, _mm_sub_epi32(fxx4_mul(ay, bz), fxx4_mul(az, by)));
+        I32X4_STORE(dst.y + i, _mm_sub_epi32(fxx4_mul(az, bx), fxx4_mul(ax, bz)));
+        I32X4_STORE(dst.z + i, _mm_sub_epi32(fxx4_mul(ax, by), fxx4_mul(ay, bx)));
+    }
+#endif
+    for (; i < count; i++) {
+        fx ax = a.x[i], ay = a.y[i], az = a.z[i];
+        fx bx = b.x[i], by = b.y[i], bz = b.z[i];
+        dst.x[i] = fx_mul(ay, bz) - fx_mul(az, by);
+        dst.y[i] = fx_mul(az, bx) - fx_mul(ax, bz);
+        dst.z[i] = fx_mul(ax, by) - fx_mul(ay, bx);
+    }
+}
+
+static inline i32 msb_u32(u32 val) {
+#if defined(__GNUC__) && !defined(__TINYC__)
+    return 31 - __builtin_clz(val);
+#else
+    i32 result = 0;
+    for (i32 shift = 16; shift > 0; shift >>= 1) {
+        if (val >> shift) {
+            val >>= shift;
+            result += shift;
+        }
+    }
+    return result;
+#endif
+}
+
+// Index of the lowest set bit, val must not be 0
+static inline i32 lsb_u32(u32 val) {
+#if defined(__GNUC__) && !defined(__TINYC__)
+    return __builtin_ctz(val);
+#else
+    i32 result = 0;
+    while (!(val & 1)) {
+        val >>= 1;
+        result++;
+    }
+    return result;
+#endif
+}
+
+static inline i32 popcount_u32(u32 val) {
+#if defined(__GNUC__) && !defined(__TINYC__)
+    return __builtin_popcount(val);
+#else
+    val = val - ((val >> 1) & 0x55555555u);
+    val = (val & 0x33333333u) + ((val >> 2) & 0x33333333u);
+    return (i32)((((val + (val >> 4)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24);
+#endif
+}
+
+// recip_table[i] = 2^30 / (1 + (i + 0.5) / 256), 1/m for the middle of each of 256 mantissa ranges
+static const u32 recip_table[256] = {
+    1071648760, 1067487017, 1063357474, 1059259757, 1055193501, 1051158344, 1047153931, 1043179913,
+    1039235943, 1035321683, 1031436799, 1027580961, 1023753843, 1019955128, 1016184499, 1012441646,
+    1008726264, 1005038051, 1001376710, 997741949, 994133479, 990551016, 986994280, 983462994,
+    979956888, 976475691, 973019140, 969586973, 966178935, 962794770, 959434230, 956097068,
+    952783040, 949491907, 946223432, 942977382, 939753528, 936551642, 933371501, 930212883,
+    927075571, 923959351, 920864010, 917789339, 914735131, 911701184, 908687296, 905693268,
+    902718906, 899764016, 896828408, 893911893, 891014285, 888135402, 885275063, 882433088,
+    879609302, 876803531, 874015602, 871245347, 868492597, 865757187, 863038954, 860337737,
+    857653376, 854985714, 852334595, 849699867, 847081377, 844478977, 841892517, 839321853,
+    836766840, 834227335, 831703198, 829194289, 826700472, 824221610, 821757569, 819308217,
+    816873423, 814453058, 812046992, 809655101, 807277260, 804913344, 802563232, 800226803,
+    797903939, 795594521, 793298433, 791015560, 788745788, 786489004, 784245098, 782013960,
+    779795481, 777589553, 775396070, 773214928, 771046022, 768889250, 766744510, 764611702,
+    762490727, 760381485, 758283881, 756197818, 754123201, 752059937, 750007932, 747967094,
+    745937332, 743918557, 741910680, 739913612, 737927267, 735951558, 733986400, 732031710,
+    730087402, 728153396, 726229609, 724315960, 722412370, 720518760, 718635051, 716761165,
+    714897027, 713042560, 711197689, 709362341, 707536440, 705719915, 703912694, 702114705,
+    700325878, 698546142, 696775430, 695013671, 693260799, 691516747, 689781448, 688054836,
+    686336846, 684627415, 682926477, 681233970, 679549832, 677874000, 676206413, 674547011,
+    672895733, 671252520, 669617313, 667990053, 666370684, 664759146, 663155385, 661559343,
+    659970965, 658390196, 656816982, 655251268, 653693001, 652142128, 650598596, 649062354,
+    647533350, 646011532, 644496851, 642989256, 641488698, 639995127, 638508495, 637028753,
+    635555854, 634089751, 632630396, 631177743, 629731746, 628292359, 626859537, 625433235,
+    624013410, 622600016, 621193010, 619792349, 618397991, 617009892, 615628011, 614252306,
+    612882736, 611519259, 610161836, 608810425, 607464988, 606125484, 604791874, 603464121,
+    602142184, 600826026, 599515609, 598210897, 596911850, 595618433, 594330610, 593048343,
+    591771597, 590500337, 589234527, 587974133, 586719118, 585469450, 584225094, 582986017,
+    581752184, 580523563, 579300120, 578081823, 576868640, 575660538, 574457486, 573259451,
+    572066404, 570878311, 569695144, 568516871, 567343461, 566174886, 565011114, 563852117,
+    562697865, 561548329, 560403480, 559263290, 558127730, 556996772, 555870388, 554748551,
+    553631233, 552518406, 551410044, 550306120, 549206607, 548111479, 547020710, 545934274,
+    544852145, 543774297, 542700705, 541631344, 540566189, 539505215, 538448398, 537395713,
+};
+
+// 1/z for z > 0, so |x / z| = |x| * mant >> shift. z is normalized to a Q30 mantissa m in [1, 2),
+// a table gives 1/m to 2^-9 and one Newton-Raphson step squares that error. Newton converges from
+// below, so mant underestimates by a relative error under 2^-18.
+typedef struct {
+    u32 mant;
+    i32 shift;
+} q8recip;
+
+q8recip q8_recip(q8 z) {
+    i32 n = msb_u32((u32)z);
+    u64 m = (u64)z << (30 - n);
+    u64 y = recip_table[(m >> 22) & 0xFF];
+    u64 e = (m * y) >> 30;
+    y     = (y * ((2ull << 30) - e)) >> 30;
+    return (q8recip){.mant = (u32)y, .shift = 22 + n};
+}
+
+// Rounds toward zero like q8_div64, and is at most |a / b| * 2^-18 + 1 smaller in magnitude
+q8 q8_mul_recip(q8 a, q8recip r) {
+    u64 mag = ((u64)(a < 0 ? -(i64)a : a) * r.mant) >> r.shift;
+    return (q8)(a < 0 ? -(i64)mag : (i64)mag);
+}
+
+// q8_div64 without the division, b must not be 0
+q8 q8_div_recip(q8 a, q8 b) {
+    return b < 0 ? q8_mul_recip(-a, q8_recip(-b)) : q8_mul_recip(a, q8_recip(b));
+}
+
+// Perspective divide with one reciprocal per vertex, error bounds as q8_mul_recip. x and z share
+// the fx scale, so their ratio comes out in q8 whatever FX_BITS is.
 v2 v3_project(v3 v) {
     // Prevent division by zero: clamp z to a small minimum
-    q8 min_z = 1; // raw q8 value of 1/256, smallest positive
-    q8 z     = v.z > min_z ? v.z : min_z;
-    return (v2){q8_div64(v.x, z), q8_div64(v.y, z)};
-}
-
-// 64-entry sine table for one quadrant [0, PI/2], in q8 format.
-// sin_table[i] = sin(i * (PI/2) / 64) * 256
-static const i16 sin_table[65] = {
-    0,   6,   13,  19,  25,  31,  38,  44,  50,  56,  62,  68,  74,  80,  86,  92,  98,
-    103, 109, 115, 120, 126, 131, 136, 142, 147, 152, 157, 162, 167, 171, 176, 181, 185,
-    189, 193, 197, 201, 205, 209, 212, 216, 219, 222, 225, 228, 231, 234, 236, 238, 241,
-    243, 244, 246, 248, 249, 251, 252, 253, 254, 254, 255, 255, 256, 256,
+    fx min_z = 1; // raw fx value, smallest positive
+    fx z     = v.z > min_z ? v.z : min_z;
+
+    q8recip r = q8_recip(z);
+    return (v2){q8_mul_recip(v.x, r), q8_mul_recip(v.y, r)};
+}
+
+#if defined(__AVX2__)
+// (a * b) >> shift on unsigned 32-bit lanes through 64-bit products, shift is per lane
+static inline __m256i u32x8_mul_shift(__m256i a, __m256i b, __m256i shift) {
+    __m256i low  = _mm256_set1_epi64x(0xFFFFFFFF);
+    __m256i even = _mm256_srlv_epi64(_mm256_mul_epu32(a, b), _mm256_and_si256(shift, low));
+    __m256i odd  = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), _mm256_srli_epi64(b, 32));
+    odd          = _mm256_slli_epi64(_mm256_srlv_epi64(odd, _mm256_srli_epi64(shift, 32)), 32);
+    return _mm256_blend_epi32(even, odd, 0xAA);
+}
+#endif
+
+// Batched v3_project, bit-exact with it. Under AVX2 this projects 8 vertices at a time, the msb
+// comes from the exponent of a float conversion, corrected when the conversion rounded up.
+void v3_project_array(v2 *dst, v3 *src, i32 count) {
+    i32 i = 0;
+#if defined(__AVX2__)
+    __m256i stride = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+    __m256i one    = _mm256_set1_epi32(1);
+    __m256i thirty = _mm256_set1_epi32(30);
+    for (; i + 8 <= count; i += 8) {
+        const int *base = (const int *)(src + i);
+        __m256i    x    = _mm256_i32gather_epi32(base, stride, 4);
+        __m256i    y    = _mm256_i32gather_epi32(base + 1, stride, 4);
+        __m256i    z    = _mm256_max_epi32(_mm256_i32gather_epi32(base + 2, stride, 4), one);
+
+        __m256i n       = _mm256_srli_epi32(_mm256_castps_si256(_mm256_cvtepi32_ps(z)), 23);
+        n               = _mm256_sub_epi32(n, _mm256_set1_epi32(127));
+        __m256i rounded = _mm256_cmpeq_epi32(_mm256_srlv_epi32(z, n), _mm256_setzero_si256());
+        n               = _mm256_add_epi32(n, rounded);
+
+        __m256i m   = _mm256_sllv_epi32(z, _mm256_sub_epi32(thirty, n));
+        __m256i idx = _mm256_and_si256(_mm256_srli_epi32(m, 22), _mm256_set1_epi32(0xFF));
+        __m256i r   = _mm256_i32gather_epi32((const int *)recip_table, idx, 4);
+        __m256i e   = u32x8_mul_shift(m, r, thirty);
+        r           = u32x8_mul_shift(r, _mm256_sub_epi32(_mm256_set1_epi32(1u << 31), e), thirty);
+
+        __m256i shift = _mm256_add_epi32(n, _mm256_set1_epi32(22));
+        x = _mm256_sign_epi32(u32x8_mul_shift(_mm256_abs_epi32(x), r, shift), x);
+        y = _mm256_sign_epi32(u32x8_mul_shift(_mm256_abs_epi32(y), r, shift), y);
+
+        __m256i lo = _mm256_unpacklo_epi32(x, y), hi = _mm256_unpackhi_epi32(x, y);
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i *)(dst + i + 4), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = v3_project(src[i]);
+    }
+}
+
+static inline i32 msb_u64(u64 val) {
+    return val >> 32 ? 32 + msb_u32((u32)(val >> 32)) : msb_u32((u32)val);
+}
+
+static inline i32 lsb_u64(u64 val) {
+    return (u32)val ? lsb_u32((u32)val) : 32 + lsb_u32((u32)(val >> 32));
+}
+
+// rsqrt_table[i] = 2^30 / sqrt((i + 64.5) / 64), 1/sqrt(x) for the middle of 192 ranges of x in
+// [1, 4), indexed by the top 8 bits of a Q30 x minus 64
+static const u32 rsqrt_table[192] = {
+    1069571937, 1061375863, 1053365364, 1045533543, 1037873853, 1030380081, 1023046322, 1015866961,
+    1008836655, 1001950318, 995203101, 988590382, 982107753, 975751001, 969516107, 963399225,
+    957396679, 951504951, 945720673, 940040618, 934461692, 928980931, 923595489, 918302635,
+    913099745, 907984300, 902953878, 898006148, 893138870, 888349887, 883637122, 878998575,
+    874432318, 869936492, 865509306, 861149030, 856853995, 852622592, 848453263, 844344506,
+    840294869, 836302947, 832367382, 828486860, 824660110, 820885902, 817163045, 813490383,
+    809866800, 806291212, 802762568, 799279851, 795842072, 792448274, 789097526, 785788926,
+    782521599, 779294692, 776107379, 772958857, 769848346, 766775087, 763738342, 760737394,
+    757771545, 754840116, 751942447, 749077893, 746245831, 743445649, 740676754, 737938568,
+    735230528, 732552083, 729902700, 727281856, 724689043, 722123764, 719585535, 717073885,
+    714588353, 712128489, 709693855, 707284021, 704898571, 702537095, 700199195, 697884480,
+    695592571, 693323095, 691075688, 688849996, 686645670, 684462372, 682299768, 680157534,
+    678035353, 675932912, 673849909, 671786046, 669741030, 667714578, 665706409, 663716251,
+    661743836, 659788901, 657851191, 655930453, 654026442, 652138916, 650267639, 648412378,
+    646572906, 644749001, 642940445, 641147024, 639368526, 637604748, 635855486, 634120543,
+    632399724, 630692839, 628999701, 627320126, 625653934, 624000948, 622360996, 620733905,
+    619119510, 617517646, 615928151, 614350868, 612785640, 611232315, 609690743, 608160777,
+    606642271, 605135082, 603639073, 602154103, 600680040, 599216749, 597764100, 596321965,
+    594890217, 593468733, 592057391, 590656069, 589264652, 587883021, 586511063, 585148667,
+    583795720, 582452115, 581117744, 579792502, 578476286, 577168993, 575870523, 574580778,
+    573299660, 572027073, 570762923, 569507118, 568259565, 567020175, 565788860, 564565531,
+    563350103, 562142492, 560942613, 559750385, 558565727, 557388559, 556218802, 555056379,
+    553901213, 552753230, 551612356, 550478516, 549351640, 548231656, 547118494, 546012085,
+    544912362, 543819257, 542732704, 541652637, 540578994, 539511710, 538450722, 537395969,
 };
 
-q8 q8_sin(q8 angle) {
-    // Normalize to [0, TAU)
-    while (angle < 0)
-        angle += Q8_TAU;
-    while (angle >= Q8_TAU)
-        angle -= Q8_TAU;
+// 1/sqrt(x) in Q30 for a Q30 x = m in [1, 4). Two Newton-Raphson steps, y += y * (1 - x * y^2) / 2,
+// take the table's 2^-8 to about 2^-29. Everything stays in integers, so results are the same on
+// every platform.
+static inline u32 rsqrt_newton(u32 m) {
+    i64 y = rsqrt_table[(m >> 24) - 64];
+    for (i32 i = 0; i < 2; i++) {
+        i64 y2  = (y * y) >> 30;
+        i64 xy2 = ((i64)m * y2) >> 30;
+        y += (y * ((1 << 30) - xy2)) >> 31;
+    }
+    return (u32)y;
+}
+
+// n is shifted left by an even s into m = n * 2^(s - 32), a Q30 x in [1, 4), which makes
+// sqrt(n) = m * rsqrt_newton(m) >> (29 + s / 2) and 1/sqrt(n) = rsqrt_newton(m) * 2^(s / 2 - 61)
+static inline i32 rsqrt_shift(u64 n) { return (63 - msb_u64(n)) & ~1; }
+
+// floor(sqrt(n)) for n up to 3 * 2^62. The estimate is corrected by one in either direction, which
+// makes it exact for n below 2^48, covering every fx_sqrt, and within 2^-29 relative above.
+u32 isqrt_u64(u64 n) {
+    if (n == 0) return 0;
+    i32 s = rsqrt_shift(n);
+    u32 m = (u32)((n << s) >> 32);
+    u64 r = ((u64)m * rsqrt_newton(m)) >> (29 + s / 2);
+    if (r * r > n) r--;
+    if ((r + 1) * (r + 1) <= n) r++;
+    return (u32)r;
+}
+
+// 1/sqrt(n) for n > 0 as a q8recip, so x / sqrt(n) = q8_mul_recip(x, rsqrt_u64(n))
+q8recip rsqrt_u64(u64 n) {
+    i32 s = rsqrt_shift(n);
+    u32 m = (u32)((n << s) >> 32);
+    return (q8recip){.mant = rsqrt_newton(m), .shift = 61 - s / 2};
+}
+
+// sqrt and 1/sqrt of a fixed point value with `bits` fractional bits, 0 for a <= 0. The square root
+// is exact (rounded down), the reciprocal one is within 2^-28 relative before rounding to nearest.
+static inline i32 fixed_sqrt(i32 a, i32 bits) {
+    return a > 0 ? (i32)isqrt_u64((u64)a << bits) : 0;
+}
+
+static inline i32 fixed_rsqrt(i32 a, i32 bits) {
+    if (a <= 0) return 0;
+    q8recip r     = rsqrt_u64((u64)a << bits);
+    i32     shift = r.shift - 2 * bits;
+    return (i32)(((u64)r.mant + (1ull << (shift - 1))) >> shift);
+}
+
+q8 q8_sqrt(q8 a) { return fixed_sqrt(a, 8); }
+q8 q8_rsqrt(q8 a) { return fixed_rsqrt(a, 8); }
+fx fx_sqrt(fx a) { return fixed_sqrt(a, FX_BITS); }
+fx fx_rsqrt(fx a) { return fixed_rsqrt(a, FX_BITS); }
 
-    // Quarter: 0=[0,PI/2), 1=[PI/2,PI), 2=[PI,3PI/2), 3=[3PI/2,TAU)
-    q8  quarter_period = Q8_TAU / 4; // 402
-    i32 quadrant       = angle / quarter_period;
-    q8  remainder      = angle % quarter_period;
+// Sum of squares in 64 bits, it can't overflow for any v3
+static inline u64 v3_length_sq64(v3 v) {
+    return (u64)((i64)v.x * v.x) + (u64)((i64)v.y * v.y) + (u64)((i64)v.z * v.z);
+}
+
+// Rounded down, exact for lengths below 2^24 in raw units. Saturates at the largest fx.
+fx v3_length(v3 v) {
+    u32 len = isqrt_u64(v3_length_sq64(v));
+    return len > 0x7FFFFFFF ? 0x7FFFFFFF : (fx)len;
+}
 
-    // Map remainder to table index [0, 64]
-    i32 idx = (i32)remainder * 64 / quarter_period;
-    if (idx > 64) idx = 64;
+// Components are rounded toward zero, so the result is at most a couple of raw units short of unit
+// length. The zero vector stays zero.
+v3 v3_normalize(v3 v) {
+    u64 n = v3_length_sq64(v);
+    if (n == 0) return v;
+
+    q8recip r = rsqrt_u64(n);
+    r.shift -= FX_BITS;
+    return (v3){q8_mul_recip(v.x, r), q8_mul_recip(v.y, r), q8_mul_recip(v.z, r)};
+}
 
-    q8 val;
-    switch (quadrant) {
-    case 0: val = sin_table[idx]; break;
-    case 1: val = sin_table[64 - idx]; break;
-    case 2: val = -sin_table[idx]; break;
-    case 3: val = -sin_table[64 - idx]; break;
-    default: val = 0; break;
+#if defined(__AVX2__)
+// rsqrt_newton on 8 lanes. (y * d) >> 31 is small, so its low 32 bits are the same after a logical
+// shift as after the arithmetic one.
+static inline __m256i u32x8_rsqrt_newton(__m256i m) {
+    __m256i thirty = _mm256_set1_epi32(30);
+    __m256i idx    = _mm256_sub_epi32(_mm256_srli_epi32(m, 24), _mm256_set1_epi32(64));
+    __m256i y      = _mm256_i32gather_epi32((const int *)rsqrt_table, idx, 4);
+    for (i32 i = 0; i < 2; i++) {
+        __m256i y2   = u32x8_mul_shift(y, y, thirty);
+        __m256i d    = _mm256_sub_epi32(_mm256_set1_epi32(1 << 30), u32x8_mul_shift(m, y2, thirty));
+        __m256i even = _mm256_srli_epi64(_mm256_mul_epi32(y, d), 31);
+        __m256i odd  = _mm256_mul_epi32(_mm256_srli_epi64(y, 32), _mm256_srli_epi64(d, 32));
+        odd          = _mm256_slli_epi64(_mm256_srli_epi64(odd, 31), 32);
+        y            = _mm256_add_epi32(y, _mm256_blend_epi32(even, odd, 0xAA));
     }
-    return val;
+    return y;
 }
 
-q8 q8_cos(q8 angle) { return q8_sin(angle + Q8_TAU / 4); }
+// rsqrt_shift on 4 nonzero 64-bit lanes. The msb comes from the exponent of a double built from
+// both 32-bit halves, corrected when the sum rounded up to the next power of two.
+static inline __m256i u64x4_rsqrt_shift(__m256i n) {
+    __m256i magic = _mm256_set1_epi64x(0x4330000000000000); // 2^52, the low 32 bits are exact
+    __m256d two52 = _mm256_castsi256_pd(magic);
+    __m256i hi    = _mm256_or_si256(_mm256_srli_epi64(n, 32), magic);
+    __m256i lo    = _mm256_or_si256(_mm256_and_si256(n, _mm256_set1_epi64x(0xFFFFFFFF)), magic);
+    __m256d d     = _mm256_add_pd(
+        _mm256_mul_pd(_mm256_sub_pd(_mm256_castsi256_pd(hi), two52), _mm256_set1_pd(4294967296.0)),
+        _mm256_sub_pd(_mm256_castsi256_pd(lo), two52));
+
+    __m256i e       = _mm256_srli_epi64(_mm256_castpd_si256(d), 52);
+    e               = _mm256_sub_epi64(e, _mm256_set1_epi64x(1023));
+    __m256i rounded = _mm256_cmpeq_epi64(_mm256_srlv_epi64(n, e), _mm256_setzero_si256());
+    e               = _mm256_add_epi64(e, rounded);
+    return _mm256_andnot_si256(_mm256_set1_epi64x(1), _mm256_sub_epi64(_mm256_set1_epi64x(63), e));
+}
+
+// Squared lengths of 8 vectors as in v3_length_sq64, in the even and odd 64-bit halves, and their
+// m and s / 2 packed back into 8 lanes. Zero lengths are normalized as 1.
+static inline __m256i v3x8_rsqrt_norm(__m256i x, __m256i y, __m256i z, __m256i *n_even,
+                                      __m256i *n_odd, __m256i *half_s) {
+    __m256i ne = _mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epi32(x, x), _mm256_mul_epi32(y, y)),
+                                  _mm256_mul_epi32(z, z));
+    x          = _mm256_srli_epi64(x, 32);
+    y          = _mm256_srli_epi64(y, 32);
+    z          = _mm256_srli_epi64(z, 32);
+    __m256i no = _mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epi32(x, x), _mm256_mul_epi32(y, y)),
+                                  _mm256_mul_epi32(z, z));
+    *n_even    = ne;
+    *n_odd     = no;
+
+    __m256i zero = _mm256_setzero_si256();
+    ne           = _mm256_sub_epi64(ne, _mm256_cmpeq_epi64(ne, zero));
+    no           = _mm256_sub_epi64(no, _mm256_cmpeq_epi64(no, zero));
+    __m256i se   = u64x4_rsqrt_shift(ne);
+    __m256i so   = u64x4_rsqrt_shift(no);
+
+    *half_s = _mm256_blend_epi32(_mm256_srli_epi64(se, 1), _mm256_slli_epi64(so, 31), 0xAA);
+    return _mm256_blend_epi32(_mm256_srli_epi64(_mm256_sllv_epi64(ne, se), 32),
+                              _mm256_sllv_epi64(no, so), 0xAA);
+}
 
-v3 v3_rotate_xz(v3 v, q8 angle) {
-    q8 cos_a = q8_cos(angle);
-    q8 sin_a = q8_sin(angle);
+// Lanes where the unsigned 64-bit r * r is above n, as -1 in r's 32-bit lanes
+static inline __m256i u32x8_square_above(__m256i r, __m256i n_even, __m256i n_odd) {
+    __m256i sign = _mm256_set1_epi64x(0x8000000000000000ull);
+    __m256i ro   = _mm256_srli_epi64(r, 32);
+    __m256i ge   = _mm256_cmpgt_epi64(_mm256_xor_si256(_mm256_mul_epu32(r, r), sign),
+                                      _mm256_xor_si256(n_even, sign));
+    __m256i go   = _mm256_cmpgt_epi64(_mm256_xor_si256(_mm256_mul_epu32(ro, ro), sign),
+                                      _mm256_xor_si256(n_odd, sign));
+    return _mm256_blend_epi32(ge, go, 0xAA);
+}
+#endif
+
+// Batched v3_length, bit-exact with it. Only AVX2 has the variable 64-bit shifts this needs.
+void v3soa_length(fx *dst, v3soa a, i32 count) {
+    i32 i = 0;
+#if defined(__AVX2__)
+    __m256i one = _mm256_set1_epi32(1);
+    for (; i + 8 <= count; i += 8) {
+        __m256i ne, no, half_s;
+        __m256i m = v3x8_rsqrt_norm(I32X8_LOAD(a.x + i), I32X8_LOAD(a.y + i), I32X8_LOAD(a.z + i),
+                                    &ne, &no, &half_s);
+        __m256i shift = _mm256_add_epi32(half_s, _mm256_set1_epi32(29));
+        __m256i r     = u32x8_mul_shift(m, u32x8_rsqrt_newton(m), shift);
+
+        r = _mm256_add_epi32(r, u32x8_square_above(r, ne, no));
+        r = _mm256_add_epi32(r, one);
+        r = _mm256_add_epi32(r, u32x8_square_above(r, ne, no));
+        I32X8_STORE(dst + i, _mm256_min_epu32(r, _mm256_set1_epi32(0x7FFFFFFF)));
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = v3_length((v3){.x = a.x[i], .y = a.y[i], .z = a.z[i]});
+    }
+}
+
+// Batched v3_normalize, bit-exact with it. dst may alias a.
+void v3soa_normalize(v3soa dst, v3soa a, i32 count) {
+    i32 i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= count; i += 8) {
+        __m256i x = I32X8_LOAD(a.x + i), y = I32X8_LOAD(a.y + i), z = I32X8_LOAD(a.z + i);
+        __m256i ne, no, half_s;
+        __m256i m     = v3x8_rsqrt_norm(x, y, z, &ne, &no, &half_s);
+        __m256i r     = u32x8_rsqrt_newton(m);
+        __m256i shift = _mm256_sub_epi32(_mm256_set1_epi32(61 - FX_BITS), half_s);
+
+        x = _mm256_sign_epi32(u32x8_mul_shift(_mm256_abs_epi32(x), r, shift), x);
+        y = _mm256_sign_epi32(u32x8_mul_shift(_mm256_abs_epi32(y), r, shift), y);
+        z = _mm256_sign_epi32(u32x8_mul_shift(_mm256_abs_epi32(z), r, shift), z);
+        I32X8_STORE(dst.x + i, x);
+        I32X8_STORE(dst.y + i, y);
+        I32X8_STORE(dst.z + i, z);
+    }
+#endif
+    for (; i < count; i++) {
+        v3 v     = v3_normalize((v3){.x = a.x[i], .y = a.y[i], .z = a.z[i]});
+        dst.x[i] = v.x;
+        dst.y[i] = v.y;
+        dst.z[i] = v.z;
+    }
+}
+
+// Angles as a fraction of a turn, TURN per full circle. Wrapping around is a mask, so any integer
+// is a valid angle.
+#define TURN_BITS 16
+#define TURN (1 << TURN_BITS)
+
+// q8 radians to turns. Q8_TAU maps to exactly one turn, the period q8_sin always had.
+u32 q8_to_turn(q8 angle) { return (u32)(((i64)angle * 2670988 + 0x8000) >> 16); }
+
+// sin over one turn in 1.1.14, sincos_table[i] = sin(i * TAU / 256) * 16384. The extra entry lets
+// interpolation read idx + 1 without wrapping. Linear interpolation between 256 segments is good to
+// 1e-4, so results are within 0.53 of the exact q8 value, almost all of it from the final rounding.
+#define SINCOS_BITS 8
+static const i16 sincos_table[(1 << SINCOS_BITS) + 1] = {
+    0, 402, 804, 1205, 1606, 2006, 2404, 2801, 3196, 3590, 3981, 4370, 4756, 5139, 5520, 5897, 6270,
+    6639, 7005, 7366, 7723, 8076, 8423, 8765, 9102, 9434, 9760, 10080, 10394, 10702, 11003, 11297,
+    11585, 11866, 12140, 12406, 12665, 12916, 13160, 13395, 13623, 13842, 14053, 14256, 14449,
+    14635, 14811, 14978, 15137, 15286, 15426, 15557, 15679, 15791, 15893, 15986, 16069, 16143,
+    16207, 16261, 16305, 16340, 16364, 16379, 16384, 16379, 16364, 16340, 16305, 16261, 16207,
+    16143, 16069, 15986, 15893, 15791, 15679, 15557, 15426, 15286, 15137, 14978, 14811, 14635,
+    14449, 14256, 14053, 13842, 13623, 13395, 13160, 12916, 12665, 12406, 12140, 11866, 11585,
+    11297, 11003, 10702, 10394, 10080, 9760, 9434, 9102, 8765, 8423, 8076, 7723, 7366, 7005, 6639,
+    6270, 5897, 5520, 5139, 4756, 4370, 3981, 3590, 3196, 2801, 2404, 2006, 1606, 1205, 804, 402, 0,
+    -402, -804, -1205, -1606, -2006, -2404, -2801, -3196, -3590, -3981, -4370, -4756, -5139, -5520,
+    -5897, -6270, -6639, -7005, -7366, -7723, -8076, -8423, -8765, -9102, -9434, -9760, -10080,
+    -10394, -10702, -11003, -11297, -11585, -11866, -12140, -12406, -12665, -12916, -13160, -13395,
+    -13623, -13842, -14053, -14256, -14449, -14635, -14811, -14978, -15137, -15286, -15426, -15557,
+    -15679, -15791, -15893, -15986, -16069, -16143, -16207, -16261, -16305, -16340, -16364, -16379,
+    -16384, -16379, -16364, -16340, -16305, -16261, -16207, -16143, -16069, -15986, -15893, -15791,
+    -15679, -15557, -15426, -15286, -15137, -14978, -14811, -14635, -14449, -14256, -14053, -13842,
+    -13623, -13395, -13160, -12916, -12665, -12406, -12140, -11866, -11585, -11297, -11003, -10702,
+    -10394, -10080, -9760, -9434, -9102, -8765, -8423, -8076, -7723, -7366, -7005, -6639, -6270,
+    -5897, -5520, -5139, -4756, -4370, -3981, -3590, -3196, -2801, -2404, -2006, -1606, -1205, -804,
+    -402, 0,
+};
+
+// sin in 1.1.22, before rounding to the output format
+static inline i32 sincos_interp(u32 turn) {
+    turn &= TURN - 1;
+    i32 idx  = turn >> (TURN_BITS - SINCOS_BITS);
+    i32 frac = turn & ((1 << (TURN_BITS - SINCOS_BITS)) - 1);
+    return sincos_table[idx] * (256 - frac) + sincos_table[idx + 1] * frac;
+}
+
+static inline q8 sincos_lookup(u32 turn) { return (q8)((sincos_interp(turn) + (1 << 13)) >> 14); }
+
+// Both at once, as the point on the unit circle: x = cos, y = sin
+v2 q8_sincos_turn(u32 turn) {
+    return (v2){.x = sincos_lookup(turn + TURN / 4), .y = sincos_lookup(turn)};
+}
+
+v2 q8_sincos(q8 angle) { return q8_sincos_turn(q8_to_turn(angle)); }
+q8 q8_sin(q8 angle) { return sincos_lookup(q8_to_turn(angle)); }
+q8 q8_cos(q8 angle) { return sincos_lookup(q8_to_turn(angle) + TURN / 4); }
+
+// fx radians to turns, FX_TAU is exactly one turn in both formats
+u32 fx_to_turn(fx angle) {
+#ifdef FX_Q16
+    return (u32)(((i64)angle * 2670177 + 0x800000) >> 24);
+#else
+    return q8_to_turn(angle);
+#endif
+}
+
+// sin and cos rounded to fx, so 16.16 keeps the table's full 1e-4 instead of q8's 4e-3
+static inline fx fx_sincos_lookup(u32 turn) {
+    return (fx)((sincos_interp(turn) + (1 << (21 - FX_BITS))) >> (22 - FX_BITS));
+}
+
+fx fx_sin(fx angle) { return fx_sincos_lookup(fx_to_turn(angle)); }
+fx fx_cos(fx angle) { return fx_sincos_lookup(fx_to_turn(angle) + TURN / 4); }
+
+#if defined(__AVX2__)
+static inline __m256i q8x8_to_turn(__m256i angle) {
+    __m256i m     = _mm256_set1_epi32(2670988);
+    __m256i round = _mm256_set1_epi64x(0x8000);
+    __m256i even  = _mm256_add_epi64(_mm256_mul_epi32(angle, m), round);
+    __m256i odd   = _mm256_add_epi64(_mm256_mul_epi32(_mm256_srli_epi64(angle, 32), m), round);
+    even          = _mm256_srli_epi64(even, 16);
+    odd           = _mm256_slli_epi64(_mm256_srli_epi64(odd, 16), 32);
+    return _mm256_blend_epi32(even, odd, 0xAA);
+}
+
+// One 32-bit gather at a 16-bit stride fetches sincos_table[idx] and [idx + 1] together, and
+// pmaddwd weighs and sums the pair the same way sincos_lookup does.
+static inline __m256i q8x8_sincos_lookup(__m256i turn) {
+    __m256i mask   = _mm256_set1_epi32((1 << SINCOS_BITS) - 1);
+    __m256i idx    = _mm256_and_si256(_mm256_srli_epi32(turn, TURN_BITS - SINCOS_BITS), mask);
+    __m256i frac   = _mm256_and_si256(turn, mask);
+    __m256i pair   = _mm256_i32gather_epi32((const int *)sincos_table, idx, 2);
+    __m256i weight = _mm256_or_si256(_mm256_sub_epi32(_mm256_set1_epi32(256), frac),
+                                     _mm256_slli_epi32(frac, 16));
+    __m256i val    = _mm256_madd_epi16(pair, weight);
+    return _mm256_srai_epi32(_mm256_add_epi32(val, _mm256_set1_epi32(1 << 13)), 14);
+}
+#endif
+
+// Batched q8_sincos, bit-exact with it. Either output may be NULL.
+void q8_sincos_array(q8 *sin_out, q8 *cos_out, q8 *angles, i32 count) {
+    i32 i = 0;
+#if defined(__AVX2__)
+    __m256i quarter = _mm256_set1_epi32(TURN / 4);
+    for (; i + 8 <= count; i += 8) {
+        __m256i turn = q8x8_to_turn(I32X8_LOAD(angles + i));
+        if (sin_out) I32X8_STORE(sin_out + i, q8x8_sincos_lookup(turn));
+        if (cos_out) I32X8_STORE(cos_out + i, q8x8_sincos_lookup(_mm256_add_epi32(turn, quarter)));
+    }
+#endif
+    for (; i < count; i++) {
+        u32 turn = q8_to_turn(angles[i]);
+        if (sin_out) sin_out[i] = sincos_lookup(turn);
+        if (cos_out) cos_out[i] = sincos_lookup(turn + TURN / 4);
+    }
+}
+
+v3 v3_rotate_xz(v3 v, fx angle) {
+    u32 turn  = fx_to_turn(angle);
+    fx  cos_a = fx_sincos_lookup(turn + TURN / 4);
+    fx  sin_a = fx_sincos_lookup(turn);
 
     return (v3){
-        .x = q8_mul(v.x, cos_a) - q8_mul(v.z, sin_a),
+        .x = fx_mul(v.x, cos_a) - fx_mul(v.z, sin_a),
         .y = v.y,
-        .z = q8_mul(v.x, sin_a) + q8_mul(v.z, cos_a),
+        .z = fx_mul(v.x, sin_a) + fx_mul(v.z, cos_a),
     };
 }
 
+// Batched v3_rotate_xz around one angle, bit-exact with it. dst may alias a.
+void v3soa_rotate_xz(v3soa dst, v3soa a, fx angle, i32 count) {
+    u32 turn  = fx_to_turn(angle);
+    fx  cos_a = fx_sincos_lookup(turn + TURN / 4);
+    fx  sin_a = fx_sincos_lookup(turn);
+
+    i32 i = 0;
+#if defined(__AVX2__)
+    __m256i c8 = _mm256_set1_epi32(cos_a), s8 = _mm256_set1_epi32(sin_a);
+    for (; i + 8 <= count; i += 8) {
+        __m256i x = I32X8_LOAD(a.x + i), z = I32X8_LOAD(a.z + i);
+        I32X8_STORE(dst.x + i, _mm256_sub_epi32(fxx8_mul(x, c8), fxx8_mul(z, s8)));
+        I32X8_STORE(dst.y + i, I32X8_LOAD(a.y + i));
+        I32X8_STORE(dst.z + i, _mm256_add_epi32(fxx8_mul(x, s8), fxx8_mul(z, c8)));
+    }
+#endif
+#if defined(__SSE4_1__)
+    __m128i c4 = _mm_set1_epi32(cos_a), s4 = _mm_set1_epi32(sin_a);
+    for (; i + 4 <= count; i += 4) {
+        __m128i x = I32X4_LOAD(a.x + i), z = I32X4_LOAD(a.z + i);
+        I32X4_STORE(dst.x + i, _mm_sub_epi32(fxx4_mul(x, c4), fxx4_mul(z, s4)));
+        I32X4_STORE(dst.y + i, I32X4_LOAD(a.y + i));
+        I32X4_STORE(dst.z + i, _mm_add_epi32(fxx4_mul(x, s4), fxx4_mul(z, c4)));
+    }
+#endif
+    for (; i < count; i++) {
+        fx x = a.x[i], z = a.z[i];
+        dst.x[i] = fx_mul(x, cos_a) - fx_mul(z, sin_a);
+        dst.y[i] = a.y[i];
+        dst.z[i] = fx_mul(x, sin_a) + fx_mul(z, cos_a);
+    }
+}
+
 v2 v2_screen(v2 v, v2i screen) {
     // Correct for aspect ratio: use height for both axes to maintain square pixels,
     // then center horizontally.
@@ -257,6 +1017,8 @@ v2 v2_screen(v2 v, v2i screen) {
 
 typedef i32 handle;
 u8         *os_alloc(i32 size);
+u8         *os_alloc_at(u64 base, i32 size); // NULL when the OS has something else there
+void        os_free(void *ptr, i32 size);
 
 typedef struct {
     void *data;
@@ -290,6 +1052,19 @@ Arena arena_new(i32 cap, Arena *parent) {
     };
 }
 
+// At base when it's free, so pointers into the arena are the same in every run, see snapshot_save.
+// Anywhere otherwise.
+Arena arena_new_at(u64 base, i32 cap) {
+    u8 *data = os_alloc_at(base, cap);
+    if (!data) return arena_new(cap, NULL);
+
+    return (Arena){
+        .data = data,
+        .used = 0,
+        .cap  = cap,
+    };
+}
+
 handle arena_mark(Arena *a) { return a->used; }
 void   arena_reset(Arena *a, handle mark) {
     if (mark > a->used) return;
@@ -300,6 +1075,25 @@ u8 *alloc_temp(i32 size) { return alloc(size, &ctx()->temp); }
 #define ALLOC(type) (type *)alloc_perm(sizeof(type))
 #define ALLOC_ARRAY(type, count) (type *)alloc_perm(sizeof(type) * (count))
 
+v3soa v3soa_alloc(i32 count, Arena *a) {
+    q8 *data = (q8 *)alloc(sizeof(q8) * 3 * count, a);
+    return (v3soa){.x = data, .y = data + count, .z = data + 2 * count};
+}
+
+void v3soa_from_v3(v3soa dst, v3 *src, i32 count) {
+    for (i32 i = 0; i < count; i++) {
+        dst.x[i] = src[i].x;
+        dst.y[i] = src[i].y;
+        dst.z[i] = src[i].z;
+    }
+}
+
+void v3soa_to_v3(v3 *dst, v3soa src, i32 count) {
+    for (i32 i = 0; i < count; i++) {
+        dst[i] = (v3){.x = src.x[i], .y = src.y[i], .z = src.z[i]};
+    }
+}
+
 typedef struct {
     u8 *text;
     i32 len;
@@ -318,24 +1112,24 @@ typedef struct {
 } Mesh;
 
 typedef union {
-    q8 val[3][3];
+    fx val[3][3];
 
     struct { // 3d transform
         v3 pos, rot, scale;
     };
 } m3;
 
-const static m3 m3_id = {.val = {{Q8(1), 0, 0}, {0, Q8(1), 0}, {0, 0, Q8(1)}}};
+const static m3 m3_id = {.val = {{FX(1), 0, 0}, {0, FX(1), 0}, {0, 0, FX(1)}}};
 
-typedef q8 m4[4][4];
+typedef fx m4[4][4];
 
-const static m4 m4_id = {{Q8(1), 0, 0, 0}, {0, Q8(1), 0, 0}, {0, 0, Q8(1), 0}, {0, 0, 0, Q8(1)}};
+const static m4 m4_id = {{FX(1), 0, 0, 0}, {0, FX(1), 0, 0}, {0, 0, FX(1), 0}, {0, 0, 0, FX(1)}};
 
 static v3 cube_mesh[8] = {
-    {Q8(1) >> 1, Q8(-1) >> 1, Q8(1) >> 1},  {Q8(-1) >> 1, Q8(-1) >> 1, Q8(1) >> 1},
-    {Q8(-1) >> 1, Q8(1) >> 1, Q8(1) >> 1},  {Q8(1) >> 1, Q8(1) >> 1, Q8(1) >> 1},
-    {Q8(1) >> 1, Q8(-1) >> 1, Q8(-1) >> 1}, {Q8(-1) >> 1, Q8(-1) >> 1, Q8(-1) >> 1},
-    {Q8(-1) >> 1, Q8(1) >> 1, Q8(-1) >> 1}, {Q8(1) >> 1, Q8(1) >> 1, Q8(-1) >> 1},
+    {FX(1) >> 1, FX(-1) >> 1, FX(1) >> 1},  {FX(-1) >> 1, FX(-1) >> 1, FX(1) >> 1},
+    {FX(-1) >> 1, FX(1) >> 1, FX(1) >> 1},  {FX(1) >> 1, FX(1) >> 1, FX(1) >> 1},
+    {FX(1) >> 1, FX(-1) >> 1, FX(-1) >> 1}, {FX(-1) >> 1, FX(-1) >> 1, FX(-1) >> 1},
+    {FX(-1) >> 1, FX(1) >> 1, FX(-1) >> 1}, {FX(1) >> 1, FX(1) >> 1, FX(-1) >> 1},
 };
 
 static v2i cube_edges[12] = {
@@ -380,6 +1174,606 @@ rect col_rect_rect_area(rect a, rect b) {
     return result;
 }
 
+// Many rects as structure-of-arrays, for the batched tests below and the broadphase
+typedef struct {
+    q8 *x, *y, *w, *h;
+} rectsoa;
+
+rectsoa rectsoa_alloc(i32 count, Arena *a) {
+    q8 *data = (q8 *)alloc(sizeof(q8) * 4 * count, a);
+    return (rectsoa){.x = data, .y = data + count, .w = data + 2 * count, .h = data + 3 * count};
+}
+
+static inline rect rectsoa_get(rectsoa rs, i32 i) {
+    return (rect){rs.x[i], rs.y[i], rs.w[i], rs.h[i]};
+}
+
+static inline void rectsoa_set(rectsoa rs, i32 i, rect r) {
+    rs.x[i] = r.x;
+    rs.y[i] = r.y;
+    rs.w[i] = r.w;
+    rs.h[i] = r.h;
+}
+
+// col_rect_rect without branches: a rect misses when it is entirely past one of the four edges
+#if defined(__AVX2__)
+static inline u32 col_rect_rects8(rect r, rectsoa rs, i32 i) {
+    __m256i x = I32X8_LOAD(rs.x + i), y = I32X8_LOAD(rs.y + i);
+    __m256i w = I32X8_LOAD(rs.w + i), h = I32X8_LOAD(rs.h + i);
+
+    __m256i left = _mm256_set1_epi32(r.x), right = _mm256_set1_epi32(r.x + r.w);
+    __m256i top  = _mm256_set1_epi32(r.y), bottom = _mm256_set1_epi32(r.y + r.h);
+
+    __m256i miss = _mm256_cmpgt_epi32(left, _mm256_add_epi32(x, w));
+    miss         = _mm256_or_si256(miss, _mm256_cmpgt_epi32(x, right));
+    miss         = _mm256_or_si256(miss, _mm256_cmpgt_epi32(top, _mm256_add_epi32(y, h)));
+    miss         = _mm256_or_si256(miss, _mm256_cmpgt_epi32(y, bottom));
+    return ~(u32)_mm256_movemask_ps(_mm256_castsi256_ps(miss)) & 0xFF;
+}
+#endif
+
+#if defined(__SSE4_1__)
+static inline u32 col_rect_rects4(rect r, rectsoa rs, i32 i) {
+    __m128i x = I32X4_LOAD(rs.x + i), y = I32X4_LOAD(rs.y + i);
+    __m128i w = I32X4_LOAD(rs.w + i), h = I32X4_LOAD(rs.h + i);
+
+    __m128i left = _mm_set1_epi32(r.x), right = _mm_set1_epi32(r.x + r.w);
+    __m128i top  = _mm_set1_epi32(r.y), bottom = _mm_set1_epi32(r.y + r.h);
+
+    __m128i miss = _mm_cmpgt_epi32(left, _mm_add_epi32(x, w));
+    miss         = _mm_or_si128(miss, _mm_cmpgt_epi32(x, right));
+    miss         = _mm_or_si128(miss, _mm_cmpgt_epi32(top, _mm_add_epi32(y, h)));
+    miss         = _mm_or_si128(miss, _mm_cmpgt_epi32(y, bottom));
+    return ~(u32)_mm_movemask_ps(_mm_castsi128_ps(miss)) & 0xF;
+}
+#endif
+
+// Up to 32 tests starting at rs[i], bit k for rs[i + k]
+static inline u32 col_rect_rects32(rect r, rectsoa rs, i32 i, i32 count) {
+    u32 result = 0;
+    i32 n      = count - i < 32 ? count - i : 32;
+    i32 k      = 0;
+#if defined(__AVX2__)
+    for (; k + 8 <= n; k += 8) {
+        result |= col_rect_rects8(r, rs, i + k) << k;
+    }
+#endif
+#if defined(__SSE4_1__)
+    for (; k + 4 <= n; k += 4) {
+        result |= col_rect_rects4(r, rs, i + k) << k;
+    }
+#endif
+    for (; k < n; k++) {
+        result |= (u32)col_rect_rect(r, rectsoa_get(rs, i + k)) << k;
+    }
+    return result;
+}
+
+// Batched col_rect_rect of r against rs[0..count), with the same results. Bit i of mask is set
+// when r overlaps rs[i], mask needs (count + 31) / 32 words.
+void col_rect_rects(rect r, rectsoa rs, i32 count, u32 *mask) {
+    for (i32 i = 0; i < count; i += 32) {
+        mask[i / 32] = col_rect_rects32(r, rs, i, count);
+    }
+}
+
+// Indices of the rects r overlaps, in order, compacted into hits. hits needs room for count.
+i32 col_rect_rects_hits(rect r, rectsoa rs, i32 count, i32 *hits) {
+    i32 result = 0;
+    for (i32 i = 0; i < count; i += 32) {
+        for (u32 bits = col_rect_rects32(r, rs, i, count); bits; bits &= bits - 1) {
+            hits[result++] = i + lsb_u32(bits);
+        }
+    }
+    return result;
+}
+
+// A point is an empty rect to col_rect_rect, edges included, which is what col_point_rect tests
+void col_point_rects(v2 p, rectsoa rs, i32 count, u32 *mask) {
+    col_rect_rects((rect){p.x, p.y, 0, 0}, rs, count, mask);
+}
+
+i32 col_point_rects_hits(v2 p, rectsoa rs, i32 count, i32 *hits) {
+    return col_rect_rects_hits((rect){p.x, p.y, 0, 0}, rs, count, hits);
+}
+
+// Broadphase
+
+// Uniform grid over the whole plane, with cells hashed into buckets so that only occupied cells
+// cost memory. A collider is linked into every cell its rect touches, and a pair or query hit is
+// only reported from the cell holding the top-left corner of the overlap, so nothing comes out
+// twice. Colliders and links are both kept as SoA arrays, indexed by handle and link.
+typedef struct {
+    i32 x0, y0, x1, y1; // Inclusive, x1 < x0 for free handles
+} GridSpan;
+
+typedef struct {
+    i32       cap, len; // len counts every handle ever given out
+    rectsoa   rects;
+    GridSpan *span;
+    handle   *free;
+    i32       free_len;
+
+    i32     links_cap, links_len, free_link;
+    handle *link_id;
+    i32    *link_next;
+    u64    *link_cell;
+    i32    *buckets; // First link of each bucket, -1 when empty
+    u32     bucket_mask;
+    i32     cell_shift;
+} Grid;
+
+static inline GridSpan grid_span(Grid *g, rect r) {
+    return (GridSpan){
+        .x0 = r.x >> g->cell_shift,
+        .y0 = r.y >> g->cell_shift,
+        .x1 = (r.x + r.w) >> g->cell_shift,
+        .y1 = (r.y + r.h) >> g->cell_shift,
+    };
+}
+
+static inline u64 grid_cell(i32 cx, i32 cy) { return ((u64)(u32)cx << 32) | (u32)cy; }
+
+static inline u32 grid_bucket(Grid *g, i32 cx, i32 cy) {
+    return ((u32)cx * 73856093u ^ (u32)cy * 19349663u) & g->bucket_mask;
+}
+
+// cell_size must be a power of two, cap is the most colliders alive at once and links_cap the most
+// (collider, cell) pairs, so about cap times the cells a typical rect covers
+Grid grid_new(i32 cap, i32 links_cap, q8 cell_size, Arena *a) {
+    if (cell_size <= 0 || (cell_size & (cell_size - 1)))
+        FATAL("Cell size must be a power of two, got %d", cell_size);
+
+    u32 buckets = 1;
+    while (buckets < (u32)links_cap)
+        buckets <<= 1;
+
+    Grid result = {
+        .cap         = cap,
+        .rects       = rectsoa_alloc(cap, a),
+        .span        = (GridSpan *)alloc(sizeof(GridSpan) * cap, a),
+        .free        = (handle *)alloc(sizeof(handle) * cap, a),
+        .links_cap   = links_cap,
+        .free_link   = -1,
+        .link_id     = (handle *)alloc(sizeof(handle) * links_cap, a),
+        .link_next   = (i32 *)alloc(sizeof(i32) * links_cap, a),
+        .link_cell   = (u64 *)alloc(sizeof(u64) * links_cap, a),
+        .buckets     = (i32 *)alloc(sizeof(i32) * buckets, a),
+        .bucket_mask = buckets - 1,
+        .cell_shift  = msb_u32((u32)cell_size),
+    };
+    for (u32 i = 0; i < buckets; i++) {
+        result.buckets[i] = -1;
+    }
+    return result;
+}
+
+static void grid_link(Grid *g, handle id, GridSpan s) {
+    for (i32 cy = s.y0; cy <= s.y1; cy++) {
+        for (i32 cx = s.x0; cx <= s.x1; cx++) {
+            i32 link = g->free_link;
+            if (link != -1) {
+                g->free_link = g->link_next[link];
+            } else {
+                if (g->links_len == g->links_cap)
+                    FATAL("Grid out of links! Capacity: %d", g->links_cap);
+                link = g->links_len++;
+            }
+
+            u32 bucket         = grid_bucket(g, cx, cy);
+            g->link_id[link]   = id;
+            g->link_cell[link] = grid_cell(cx, cy);
+            g->link_next[link] = g->buckets[bucket];
+            g->buckets[bucket] = link;
+        }
+    }
+}
+
+static void grid_unlink(Grid *g, handle id, GridSpan s) {
+    for (i32 cy = s.y0; cy <= s.y1; cy++) {
+        for (i32 cx = s.x0; cx <= s.x1; cx++) {
+            u64  cell = grid_cell(cx, cy);
+            i32 *prev = &g->buckets[grid_bucket(g, cx, cy)];
+            while (*prev != -1) {
+                i32 link = *prev;
+                if (g->link_id[link] == id && g->link_cell[link] == cell) {
+                    *prev              = g->link_next[link];
+                    g->link_next[link] = g->free_link;
+                    g->free_link       = link;
+                    break;
+                }
+                prev = &g->link_next[link];
+            }
+        }
+    }
+}
+
+handle grid_insert(Grid *g, rect r) {
+    handle id;
+    if (g->free_len > 0) {
+        id = g->free[--g->free_len];
+    } else {
+        if (g->len == g->cap) FATAL("Grid is full! Capacity: %d", g->cap);
+        id = g->len++;
+    }
+
+    rectsoa_set(g->rects, id, r);
+    g->span[id] = grid_span(g, r);
+    grid_link(g, id, g->span[id]);
+    return id;
+}
+
+// Relinks only when the rect crosses into different cells, which most moves don't
+void grid_move(Grid *g, handle id, rect r) {
+    rectsoa_set(g->rects, id, r);
+
+    GridSpan old = g->span[id], s = grid_span(g, r);
+    if (old.x0 == s.x0 && old.y0 == s.y0 && old.x1 == s.x1 && old.y1 == s.y1) return;
+
+    grid_unlink(g, id, old);
+    grid_link(g, id, s);
+    g->span[id] = s;
+}
+
+void grid_remove(Grid *g, handle id) {
+    grid_unlink(g, id, g->span[id]);
+    g->span[id]            = (GridSpan){0, 0, -1, -1};
+    g->free[g->free_len++] = id;
+}
+
+// Every overlapping pair once, as col_rect_rect sees them, with from < to. The pairs are allocated
+// contiguously from a, *pairs points at the first.
+i32 grid_pairs(Grid *g, Arena *a, v2i **pairs) {
+    i32 count = 0;
+    *pairs    = (v2i *)((u8 *)a->data + a->used);
+
+    for (handle id = 0; id < g->len; id++) {
+        GridSpan s = g->span[id];
+        rect     r = rectsoa_get(g->rects, id);
+        for (i32 cy = s.y0; cy <= s.y1; cy++) {
+            for (i32 cx = s.x0; cx <= s.x1; cx++) {
+                u64 cell = grid_cell(cx, cy);
+                i32 link = g->buckets[grid_bucket(g, cx, cy)];
+                for (; link != -1; link = g->link_next[link]) {
+                    handle other = g->link_id[link];
+                    if (other <= id || g->link_cell[link] != cell) continue;
+
+                    q8 corner_x = r.x > g->rects.x[other] ? r.x : g->rects.x[other];
+                    q8 corner_y = r.y > g->rects.y[other] ? r.y : g->rects.y[other];
+                    if (corner_x >> g->cell_shift != cx || corner_y >> g->cell_shift != cy)
+                        continue;
+                    if (!col_rect_rect(r, rectsoa_get(g->rects, other))) continue;
+
+                    *(v2i *)alloc(sizeof(v2i), a) = (v2i){.from = id, .to = other};
+                    count++;
+                }
+            }
+        }
+    }
+    return count;
+}
+
+// Colliders overlapping r, allocated contiguously from a like grid_pairs
+i32 grid_query_rect(Grid *g, rect r, Arena *a, handle **hits) {
+    i32 count = 0;
+    *hits     = (handle *)((u8 *)a->data + a->used);
+
+    GridSpan s = grid_span(g, r);
+    for (i32 cy = s.y0; cy <= s.y1; cy++) {
+        for (i32 cx = s.x0; cx <= s.x1; cx++) {
+            u64 cell = grid_cell(cx, cy);
+            i32 link = g->buckets[grid_bucket(g, cx, cy)];
+            for (; link != -1; link = g->link_next[link]) {
+                handle other = g->link_id[link];
+                if (g->link_cell[link] != cell) continue;
+
+                q8 corner_x = r.x > g->rects.x[other] ? r.x : g->rects.x[other];
+                q8 corner_y = r.y > g->rects.y[other] ? r.y : g->rects.y[other];
+                if (corner_x >> g->cell_shift != cx || corner_y >> g->cell_shift != cy) continue;
+                if (!col_rect_rect(r, rectsoa_get(g->rects, other))) continue;
+
+                *(handle *)alloc(sizeof(handle), a) = other;
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+// Colliders containing p, which all share its cell
+i32 grid_query_point(Grid *g, v2 p, Arena *a, handle **hits) {
+    i32 count = 0;
+    *hits     = (handle *)((u8 *)a->data + a->used);
+
+    i32 cx = p.x >> g->cell_shift, cy = p.y >> g->cell_shift;
+    u64 cell = grid_cell(cx, cy);
+    for (i32 link = g->buckets[grid_bucket(g, cx, cy)]; link != -1; link = g->link_next[link]) {
+        handle other = g->link_id[link];
+        if (g->link_cell[link] != cell) continue;
+        if (!col_point_rect(p, rectsoa_get(g->rects, other))) continue;
+
+        *(handle *)alloc(sizeof(handle), a) = other;
+        count++;
+    }
+    return count;
+}
+
+// Tilemap
+
+// Tiles are stored in 32x32 chunks, each one contiguous and the chunks laid out row by row, so a
+// lookup is a few shifts instead of a row pointer load and a region stays within a handful of
+// chunks. Solidity is a bit per tile, one u32 per chunk row, kept in step with the ids from a
+// table of solid ids. The map is not solid outside its bounds.
+//
+// A streamed map (see TileStream) only keeps some chunks, in slots of ids and solid that
+// chunk_slot points into. Chunks that aren't loaded point at slot 0, which stays empty.
+#define TILE_CHUNK_SHIFT 5
+#define TILE_CHUNK (1 << TILE_CHUNK_SHIFT)
+
+typedef struct {
+    v2i  size; // In tiles
+    i32  chunks_w, chunks_h;
+    u8  *ids;          // TILE_CHUNK * TILE_CHUNK per chunk, row-major inside the chunk
+    u32 *solid;        // TILE_CHUNK rows per chunk, bit x of row y
+    u32  solid_ids[8]; // Bit per tile id
+    q8   tile_size;
+    i32  tile_shift;
+    i32  chunks_cap; // Chunks ids and solid have room for
+    i32 *chunk_slot; // NULL unless streamed
+    u32  version;    // Changes with every tile set to a new id, for anything caching the map
+} Tilemap;
+
+// Where tile (x, y) is in ids, for game code reading tiles directly. Writes go through tilemap_set
+// so the solid bits follow.
+static inline i32 tilemap_index(Tilemap *tm, i32 x, i32 y) {
+    i32 chunk = (y >> TILE_CHUNK_SHIFT) * tm->chunks_w + (x >> TILE_CHUNK_SHIFT);
+    if (tm->chunk_slot) chunk = tm->chunk_slot[chunk];
+    return chunk << (2 * TILE_CHUNK_SHIFT) | (y & (TILE_CHUNK - 1)) << TILE_CHUNK_SHIFT |
+           (x & (TILE_CHUNK - 1));
+}
+
+// The solid bits of the chunk row holding tile (x, y)
+static inline u32 *tilemap_solid_word(Tilemap *tm, i32 x, i32 y) {
+    return &tm->solid[tilemap_index(tm, x, y) >> TILE_CHUNK_SHIFT];
+}
+
+static inline bool tilemap_in(Tilemap *tm, i32 x, i32 y) {
+    return (u32)x < (u32)tm->size.w && (u32)y < (u32)tm->size.h;
+}
+
+// tile_size must be a power of two, every tile starts as id 0 and nothing is solid
+Tilemap tilemap_new(v2i size, q8 tile_size, Arena *a) {
+    if (tile_size <= 0 || (tile_size & (tile_size - 1)))
+        FATAL("Tile size must be a power of two, got %d", tile_size);
+
+    i32 chunks_w = (size.w + TILE_CHUNK - 1) >> TILE_CHUNK_SHIFT;
+    i32 chunks_h = (size.h + TILE_CHUNK - 1) >> TILE_CHUNK_SHIFT;
+    i32 rows     = chunks_w * chunks_h * TILE_CHUNK;
+
+    Tilemap result = {
+        .size       = size,
+        .chunks_w   = chunks_w,
+        .chunks_h   = chunks_h,
+        .ids        = alloc(rows * TILE_CHUNK, a),
+        .solid      = (u32 *)alloc(sizeof(u32) * rows, a),
+        .tile_size  = tile_size,
+        .tile_shift = msb_u32((u32)tile_size),
+        .chunks_cap = chunks_w * chunks_h,
+    };
+    for (i32 i = 0; i < rows * TILE_CHUNK; i++) {
+        result.ids[i] = 0;
+    }
+    for (i32 i = 0; i < rows; i++) {
+        result.solid[i] = 0;
+    }
+    return result;
+}
+
+// Tile id at (x, y), 0 outside the map
+static inline u8 tilemap_get(Tilemap *tm, i32 x, i32 y) {
+    return tilemap_in(tm, x, y) ? tm->ids[tilemap_index(tm, x, y)] : 0;
+}
+
+static inline bool tilemap_solid(Tilemap *tm, i32 x, i32 y) {
+    return tilemap_in(tm, x, y) && (*tilemap_solid_word(tm, x, y) >> (x & (TILE_CHUNK - 1)) & 1);
+}
+
+static inline bool tilemap_id_solid(Tilemap *tm, u8 id) {
+    return tm->solid_ids[id >> 5] >> (id & 31) & 1;
+}
+
+// Only changes memory, on a streamed map the tile reverts once its chunk is evicted
+void tilemap_set(Tilemap *tm, i32 x, i32 y, u8 id) {
+    if (!tilemap_in(tm, x, y)) return;
+    if (tm->chunk_slot && tilemap_index(tm, x, y) < TILE_CHUNK * TILE_CHUNK) return;
+
+    u32 *row = tilemap_solid_word(tm, x, y);
+    u32  bit = 1u << (x & (TILE_CHUNK - 1));
+    if (tm->ids[tilemap_index(tm, x, y)] != id) tm->version++;
+    tm->ids[tilemap_index(tm, x, y)] = id;
+    *row = tilemap_id_solid(tm, id) ? *row | bit : *row & ~bit;
+}
+
+// Changes whether an id is solid, updating the bits of every tile that already has it
+void tilemap_set_solid(Tilemap *tm, u8 id, bool solid) {
+    u32 bit                = 1u << (id & 31);
+    tm->solid_ids[id >> 5] = solid ? tm->solid_ids[id >> 5] | bit : tm->solid_ids[id >> 5] & ~bit;
+
+    // ids and solid share their order, tile i is bit i % 32 of solid[i / 32]. Slot 0 of a
+    // streamed map stays empty.
+    i32 tiles = tm->chunks_cap * TILE_CHUNK * TILE_CHUNK;
+    i32 first = tm->chunk_slot ? TILE_CHUNK * TILE_CHUNK : 0;
+    for (i32 i = first; i < tiles; i++) {
+        if (tm->ids[i] != id) continue;
+        u32 *row      = &tm->solid[i >> TILE_CHUNK_SHIFT];
+        u32  tile_bit = 1u << (i & (TILE_CHUNK - 1));
+        *row          = solid ? *row | tile_bit : *row & ~tile_bit;
+    }
+}
+
+// Solid bits of row y from column x0 to x1, both inclusive and in the same chunk
+static inline u32 tilemap_row_bits(Tilemap *tm, i32 y, i32 x0, i32 x1) {
+    u32 mask = (0xFFFFFFFFu >> (31 - (x1 & 31))) & (0xFFFFFFFFu << (x0 & 31));
+    return *tilemap_solid_word(tm, x0, y) & mask;
+}
+
+// Clips a region in tiles to the map, as inclusive bounds. False when nothing is left.
+static inline bool tilemap_clip(Tilemap *tm, i32rect tiles, i32 *x0, i32 *y0, i32 *x1, i32 *y1) {
+    *x0 = tiles.x > 0 ? tiles.x : 0;
+    *y0 = tiles.y > 0 ? tiles.y : 0;
+    *x1 = tiles.x + tiles.w < tm->size.w ? tiles.x + tiles.w - 1 : tm->size.w - 1;
+    *y1 = tiles.y + tiles.h < tm->size.h ? tiles.y + tiles.h - 1 : tm->size.h - 1;
+    return *x0 <= *x1 && *y0 <= *y1;
+}
+
+// Tiles under a world space rect, edges excluded, so a rect resting against a tile isn't in it
+static inline i32rect tilemap_tiles(Tilemap *tm, rect r) {
+    i32 x0 = r.x >> tm->tile_shift, y0 = r.y >> tm->tile_shift;
+    i32 x1 = (r.x + r.w - 1) >> tm->tile_shift, y1 = (r.y + r.h - 1) >> tm->tile_shift;
+    return (i32rect){x0, y0, x1 - x0 + 1, y1 - y0 + 1};
+}
+
+// Counts the solid tiles in a region a chunk column at a time, or stops at the first one
+static i32 tilemap_region_scan(Tilemap *tm, i32rect tiles, bool any) {
+    i32 x0, y0, x1, y1, result = 0;
+    if (!tilemap_clip(tm, tiles, &x0, &y0, &x1, &y1)) return 0;
+
+    for (i32 x = x0; x <= x1; x = (x | (TILE_CHUNK - 1)) + 1) {
+        i32 end = (x | (TILE_CHUNK - 1)) < x1 ? (x | (TILE_CHUNK - 1)) : x1;
+        for (i32 y = y0; y <= y1; y++) {
+            u32 bits = tilemap_row_bits(tm, y, x, end);
+            if (bits && any) return 1;
+            result += popcount_u32(bits);
+        }
+    }
+    return result;
+}
+
+i32 tilemap_region_count(Tilemap *tm, i32rect tiles) {
+    return tilemap_region_scan(tm, tiles, false);
+}
+
+bool tilemap_region_solid(Tilemap *tm, i32rect tiles) {
+    return tilemap_region_scan(tm, tiles, true) > 0;
+}
+
+// Solid tiles under r, as tile coordinates in row order, allocated contiguously from a like
+// grid_query_rect
+i32 tilemap_query_rect(Tilemap *tm, rect r, Arena *a, v2i **hits) {
+    i32 x0, y0, x1, y1, count = 0;
+    *hits = (v2i *)((u8 *)a->data + a->used);
+    if (!tilemap_clip(tm, tilemap_tiles(tm, r), &x0, &y0, &x1, &y1)) return 0;
+
+    for (i32 y = y0; y <= y1; y++) {
+        for (i32 x = x0; x <= x1; x = (x | (TILE_CHUNK - 1)) + 1) {
+            i32 end  = (x | (TILE_CHUNK - 1)) < x1 ? (x | (TILE_CHUNK - 1)) : x1;
+            u32 bits = tilemap_row_bits(tm, y, x, end);
+            for (; bits; bits &= bits - 1) {
+                i32 hit                       = (x & ~(TILE_CHUNK - 1)) + lsb_u32(bits);
+                *(v2i *)alloc(sizeof(v2i), a) = (v2i){.x = hit, .y = y};
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+// The lowest solid column in lo..hi over rows y0..y1, or the highest with last. Each row is read a
+// chunk at a time from the near end, and stops once it can't beat what an earlier row found.
+static bool tilemap_first_solid_col(Tilemap *tm, i32 lo, i32 hi, i32 y0, i32 y1, bool last,
+                                    i32 *col) {
+    i32 x0, x1;
+    if (!tilemap_clip(tm, (i32rect){lo, y0, hi - lo + 1, y1 - y0 + 1}, &x0, &y0, &x1, &y1))
+        return false;
+
+    bool found = false;
+    for (i32 y = y0; y <= y1; y++) {
+        if (!last) {
+            i32 to = found ? *col - 1 : x1;
+            for (i32 x = x0; x <= to; x = (x | (TILE_CHUNK - 1)) + 1) {
+                i32 end  = (x | (TILE_CHUNK - 1)) < to ? (x | (TILE_CHUNK - 1)) : to;
+                u32 bits = tilemap_row_bits(tm, y, x, end);
+                if (!bits) continue;
+                *col  = (x & ~(TILE_CHUNK - 1)) + lsb_u32(bits);
+                found = true;
+                break;
+            }
+        } else {
+            i32 from = found ? *col + 1 : x0;
+            for (i32 x = x1; x >= from; x = (x & ~(TILE_CHUNK - 1)) - 1) {
+                i32 start = (x & ~(TILE_CHUNK - 1)) > from ? (x & ~(TILE_CHUNK - 1)) : from;
+                u32 bits  = tilemap_row_bits(tm, y, start, x);
+                if (!bits) continue;
+                *col  = (x & ~(TILE_CHUNK - 1)) + msb_u32(bits);
+                found = true;
+                break;
+            }
+        }
+    }
+    return found;
+}
+
+// The lowest solid row in lo..hi over columns x0..x1, or the highest with last
+static bool tilemap_first_solid_row(Tilemap *tm, i32 lo, i32 hi, i32 x0, i32 x1, bool last,
+                                    i32 *row) {
+    for (i32 i = 0; i <= hi - lo; i++) {
+        i32 y = last ? hi - i : lo + i;
+        if (!tilemap_region_solid(tm, (i32rect){x0, y, x1 - x0 + 1, 1})) continue;
+        *row = y;
+        return true;
+    }
+    return false;
+}
+
+typedef struct {
+    rect r;            // Where the rect stopped
+    bool hit_x, hit_y; // Whether a solid tile blocked that axis
+} TileSweep;
+
+// Moves r by delta, first along x and then along y, stopping flush against the first solid tile
+// in the way. Only tiles past the leading edge can block, so a rect that starts inside solid tiles
+// can still move out of them.
+TileSweep tilemap_sweep(Tilemap *tm, rect r, v2 delta) {
+    TileSweep result = {.r = r};
+    i32       shift  = tm->tile_shift, hit;
+
+    if (delta.x) {
+        rect s  = result.r;
+        i32  y0 = s.y >> shift, y1 = (s.y + s.h - 1) >> shift;
+        if (delta.x > 0) {
+            i32 lo = ((s.x + s.w - 1) >> shift) + 1, hi = (s.x + s.w - 1 + delta.x) >> shift;
+            result.hit_x = tilemap_first_solid_col(tm, lo, hi, y0, y1, false, &hit);
+            result.r.x   = result.hit_x ? (hit << shift) - s.w : s.x + delta.x;
+        } else {
+            i32 lo = (s.x + delta.x) >> shift, hi = (s.x >> shift) - 1;
+            result.hit_x = tilemap_first_solid_col(tm, lo, hi, y0, y1, true, &hit);
+            result.r.x   = result.hit_x ? (hit + 1) << shift : s.x + delta.x;
+        }
+    }
+
+    if (delta.y) {
+        rect s  = result.r;
+        i32  x0 = s.x >> shift, x1 = (s.x + s.w - 1) >> shift;
+        if (delta.y > 0) {
+            i32 lo = ((s.y + s.h - 1) >> shift) + 1, hi = (s.y + s.h - 1 + delta.y) >> shift;
+            result.hit_y = tilemap_first_solid_row(tm, lo, hi, x0, x1, false, &hit);
+            result.r.y   = result.hit_y ? (hit << shift) - s.h : s.y + delta.y;
+        } else {
+            i32 lo = (s.y + delta.y) >> shift, hi = (s.y >> shift) - 1;
+            result.hit_y = tilemap_first_solid_row(tm, lo, hi, x0, x1, true, &hit);
+            result.r.y   = result.hit_y ? (hit + 1) << shift : s.y + delta.y;
+        }
+    }
+    return result;
+}
+
+// Atomics
+
+i32   atomic_add(volatile i32 *dst, i32 val);                         // Returns the new value
+void *atomic_cas_ptr(void *volatile *dst, void *val, void *expected); // Returns the old value
+i32   read_acquire(volatile i32 *src);                                // Acquire load
+void  write_release(volatile i32 *dst, i32 val);                      // Release store
+
 // Debug
 
 void draw_text(char *text, i32 x, i32 y, col32 color);
@@ -397,6 +1791,14 @@ bool gui_toggle(char *name, q8 x, q8 y, bool *val);
 
 string file_read(char *path);
 i32    file_write(char *path, char *data);
+i32    file_write_bytes(char *path, u8 *data, i32 len);
+i32    file_append_bytes(char *path, u8 *data, i32 len);
+
+// Read-only view of a whole file, NULL when it can't be opened. Pages are read as they are first
+// touched, file_prefetch starts reading a range in the background instead.
+u8  *file_map(char *path, i64 *size);
+void file_unmap(u8 *data, i64 size);
+void file_prefetch(u8 *data, i64 size);
 
 void *image_read(char *path);
 
@@ -429,20 +1831,45 @@ typedef enum {
     KS_PRESSED,
 } KeyState;
 
+typedef enum {
+    HW_CYCLES = 0,
+    HW_INSTRUCTIONS,
+    HW_L1D_MISSES,
+    HW_LLC_MISSES,
+    HW_BRANCH_MISSES,
+    HW_COUNT,
+} HwCounter;
+
+typedef struct {
+    u64 val[HW_COUNT];
+} HwCounters;
+
 typedef struct {
     bool  initialized;
     void *processHandle;
+
+    // Hardware performance counters, read together as one group. Platforms without them leave
+    // hw_available false and ReadHardwareCounters returns zeroes.
+    bool hw_available;
+    i32  hw_group;
+    i32  hw_slot[HW_COUNT]; // Position in the group read, -1 if the counter couldn't be opened
 } Metrics;
 
-Metrics metrics_init();
-u64     ReadPageFaultCount(Metrics);
+Metrics    metrics_init();
+u64        ReadPageFaultCount(Metrics);
+HwCounters ReadHardwareCounters(Metrics);
 
 u64 ReadCPUTimer();
+u64 ReadOSTimer();
+u64 GetOSTimerFreq();
+
+void os_sleep(f64 seconds); // With a high resolution timer where there is one
 
 u64 EstimateCPUTimerFreq();
 
 typedef struct {
     // System
+    cstr osName;
     cstr processorArchitecture;
     u32  numberOfProcessors;
     u32  pageSize;
@@ -471,17 +1898,17 @@ SystemInfo systeminfo_init();
 
 void systeminfo_print(SystemInfo info) {
     INFO("System Information");
-    printf("\t> Platform: \t\t\tWindows %s\n", info.processorArchitecture);
+    printf("\t> Platform: \t\t\t%s %s\n", info.osName, info.processorArchitecture);
     printf("\t> Version: \t\t\t%u.%u.%u\n", info.majorVersion, info.minorVersion, info.buildNumber);
     printf("\t> Processor Count: \t\t%u\n", info.numberOfProcessors);
     printf("\t> CPU Frequency: \t\t%.2f GHz\n", info.cpuFreq);
     printf("\t> Page Size: \t\t\t%u bytes\n", info.pageSize);
 
     INFO("Memory Information");
-    printf("\t> Total Physical Memory: \t%llu MB\n", info.totalPhys / (1024 * 1024));
-    printf("\t> Available Physical Memory: \t%llu MB\n", info.availPhys / (1024 * 1024));
-    printf("\t> Total Virtual Memory: \t%llu MB\n", info.totalVirtual / (1024 * 1024));
-    printf("\t> Available Virtual Memory: \t%llu MB\n", info.availVirtual / (1024 * 1024));
+    printf("\t> Total Physical Memory: \t%" U64_FMT " MB\n", info.totalPhys / (1024 * 1024));
+    printf("\t> Available Physical Memory: \t%" U64_FMT " MB\n", info.availPhys / (1024 * 1024));
+    printf("\t> Total Virtual Memory: \t%" U64_FMT " MB\n", info.totalVirtual / (1024 * 1024));
+    printf("\t> Available Virtual Memory: \t%" U64_FMT " MB\n", info.availVirtual / (1024 * 1024));
 }
 
 typedef struct Data Data;
@@ -492,4 +1919,8 @@ import extern Data *data;
 typedef struct {
     cstr name;
     cstr version;
+    bool idle;   // Wait for input instead of drawing frames while nothing moves, see keep_animating
+    i32  sim_hz; // Fixed rate of simulate, with render once per frame, instead of update
+    // File what init did is saved to, and restored from instead of running it, see game_start
+    cstr snapshot;
 } Info;
\ No newline at end of file
@@ -0,0 +1,289 @@
+#pragma once
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysinfo.h>
+#include <sys/utsname.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#else
+static inline void _mm_pause(void) { __asm__ volatile("yield"); }
+#endif
+
+#include "base.h"
+#include "profiler.h"
+
+// The game is linked statically, there is no hot reload on Linux yet
+typedef struct {
+    void (*init)();
+    Info *info;
+    void (*update)(q8 dt);
+    void (*simulate)(q16 dt);
+    void (*render)(q16 alpha);
+    void (*latch)();   // Optional, see input_latch
+    bool (*restore)(); // Optional, see game_start
+    void (*quit)();
+    i32 (*gamedata_size)();
+} GameDLL;
+
+// State of the headless presenter, see main_headless.c
+typedef struct {
+    u64    frame, frame_count;
+    cstr   dump_ppm; // printf pattern taking the frame number, NULL to not dump
+    string input_script;
+    i32    input_cursor;
+} Platform;
+
+#include "engine.c"
+
+// No image decoder on this platform yet
+void *image_read(char *path) { return NULL; }
+
+string file_read(char *path) {
+    i32 fd = open(path, O_RDONLY);
+    if (fd == -1) return (string){0};
+
+    struct stat st = {0};
+    fstat(fd, &st);
+
+    i32 size = (i32)st.st_size;
+    u8 *text = alloc_perm(size + 1);
+    i32 got  = 0;
+    while (got < size) {
+        i64 n = read(fd, text + got, size - got);
+        if (n <= 0) break;
+        got += (i32)n;
+    }
+    close(fd);
+
+    text[got] = 0;
+    return (string){.text = text, .len = got};
+}
+
+i32 file_write_bytes(char *path, u8 *data, i32 len) {
+    i32 fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) return -1;
+
+    i32 written = 0;
+    while (written < len) {
+        i64 n = write(fd, data + written, len - written);
+        if (n <= 0) break;
+        written += (i32)n;
+    }
+    close(fd);
+
+    return written;
+}
+
+i32 file_append_bytes(char *path, u8 *data, i32 len) {
+    i32 fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd == -1) return -1;
+
+    i32 written = 0;
+    while (written < len) {
+        i64 n = write(fd, data + written, len - written);
+        if (n <= 0) break;
+        written += (i32)n;
+    }
+    close(fd);
+
+    return written;
+}
+
+i32 file_write(char *path, char *data) {
+    return file_write_bytes(path, (u8 *)data, (i32)strlen(data));
+}
+
+u8 *file_map(char *path, i64 *size) {
+    i32 fd = open(path, O_RDONLY);
+    if (fd == -1) return NULL;
+
+    struct stat st = {0};
+    fstat(fd, &st);
+    *size = st.st_size;
+
+    // The mapping keeps the file open
+    void *result = st.st_size > 0 ? mmap(NULL, (u64)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)
+                                  : MAP_FAILED;
+    close(fd);
+    return result == MAP_FAILED ? NULL : (u8 *)result;
+}
+
+void file_unmap(u8 *data, i64 size) { munmap(data, (u64)size); }
+
+void file_prefetch(u8 *data, i64 size) {
+    u64 page  = (u64)sysconf(_SC_PAGESIZE);
+    u64 start = (u64)data & ~(page - 1);
+    madvise((void *)start, (u64)data + (u64)size - start, MADV_WILLNEED);
+}
+
+static i32 perf_open(u32 type, u64 config, i32 group) {
+    struct perf_event_attr attr = {
+        .type           = type,
+        .size           = sizeof(attr),
+        .config         = config,
+        .disabled       = group == -1,
+        .exclude_kernel = 1,
+        .exclude_hv     = 1,
+        .read_format    = PERF_FORMAT_GROUP,
+    };
+    return (i32)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+Metrics metrics_init() {
+    Metrics result = {
+        .initialized = true,
+        .hw_group    = -1,
+    };
+
+    const struct {
+        u32 type;
+        u64 config;
+    } events[HW_COUNT] = {
+        [HW_CYCLES]        = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        [HW_INSTRUCTIONS]  = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        [HW_L1D_MISSES]    = {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                                                      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+        [HW_LLC_MISSES]    = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        [HW_BRANCH_MISSES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    };
+
+    // Cycles lead the group, without them the rest is not worth reading
+    i32 slots = 0;
+    for (i32 i = 0; i < HW_COUNT; i++) {
+        result.hw_slot[i] = -1;
+
+        i32 fd = perf_open(events[i].type, events[i].config, result.hw_group);
+        if (fd == -1) {
+            if (i == HW_CYCLES) break;
+            continue;
+        }
+
+        if (i == HW_CYCLES) result.hw_group = fd;
+        result.hw_slot[i] = slots++;
+    }
+
+    // Usually a perf_event_paranoid setting, a VM without a virtual PMU, or a seccomp filter
+    if (result.hw_group == -1) return result;
+
+    ioctl(result.hw_group, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(result.hw_group, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    result.hw_available = true;
+
+    return result;
+}
+
+u64 ReadPageFaultCount(Metrics m) {
+    struct rusage usage = {0};
+    getrusage(RUSAGE_SELF, &usage);
+
+    u64 result = usage.ru_minflt + usage.ru_majflt;
+    return result;
+}
+
+HwCounters ReadHardwareCounters(Metrics m) {
+    HwCounters result = {0};
+    if (!m.hw_available) return result;
+
+    // PERF_FORMAT_GROUP layout: { nr, values[nr] }
+    u64 buf[1 + HW_COUNT] = {0};
+    if (read(m.hw_group, buf, sizeof(buf)) <= 0) return result;
+
+    for (i32 i = 0; i < HW_COUNT; i++) {
+        if (m.hw_slot[i] != -1 && (u64)m.hw_slot[i] < buf[0]) result.val[i] = buf[1 + m.hw_slot[i]];
+    }
+    return result;
+}
+
+u64 ReadOSTimer() {
+    struct timespec ts = {0};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+}
+
+u64 GetOSTimerFreq() { return 1000000000ull; }
+
+void os_sleep(f64 seconds) {
+    i64             ns = (i64)(seconds * 1000000000.0);
+    struct timespec ts = {.tv_sec = ns / 1000000000, .tv_nsec = ns % 1000000000};
+    while (clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, &ts) == EINTR) {}
+}
+
+SystemInfo systeminfo_init() {
+    persist struct utsname name   = {0}; // Outlives the call, processorArchitecture points into it
+    SystemInfo             result = {0};
+    struct sysinfo         mem    = {0};
+
+    // System
+    uname(&name);
+    result.osName                = "Linux";
+    result.processorArchitecture = name.machine;
+    result.numberOfProcessors    = (u32)sysconf(_SC_NPROCESSORS_ONLN);
+    result.pageSize              = (u32)sysconf(_SC_PAGESIZE);
+    result.allocationGranularity = result.pageSize;
+
+    result.cpuFreq = (f64)(EstimateCPUTimerFreq()) / 1000.0 / 1000.0 / 1000.0;
+
+    // Memory
+    if (sysinfo(&mem) == 0) {
+        result.totalPhys = (u64)mem.totalram * mem.mem_unit;
+        result.availPhys = (u64)mem.freeram * mem.mem_unit;
+    }
+    result.totalVirtual = result.totalPhys + (u64)mem.totalswap * mem.mem_unit;
+    result.availVirtual = result.availPhys + (u64)mem.freeswap * mem.mem_unit;
+
+    // OS, the kernel release looks like "6.8.0-45-generic"
+    sscanf(name.release, "%u.%u.%u", &result.majorVersion, &result.minorVersion,
+           &result.buildNumber);
+
+    systeminfo_print(result);
+
+    return result;
+}
+
+i32 atomic_add(volatile i32 *dst, i32 val) { return __sync_add_and_fetch(dst, val); }
+
+void *atomic_cas_ptr(void *volatile *dst, void *val, void *expected) {
+    return __sync_val_compare_and_swap(dst, expected, val);
+}
+
+i32 read_acquire(volatile i32 *src) { return __atomic_load_n(src, __ATOMIC_ACQUIRE); }
+
+void write_release(volatile i32 *dst, i32 val) { __atomic_store_n(dst, val, __ATOMIC_RELEASE); }
+
+u8 *os_alloc(i32 size) {
+    void *result =
+        mmap(NULL, (u64)size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return result == MAP_FAILED ? NULL : (u8 *)result;
+}
+
+// Kernels before 4.17 take the address as a hint, and may put the mapping somewhere else
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+u8 *os_alloc_at(u64 base, i32 size) {
+    void *result = mmap((void *)base, (u64)size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if (result == MAP_FAILED) return NULL;
+    if (result != (void *)base) {
+        munmap(result, (u64)size);
+        return NULL;
+    }
+    return (u8 *)result;
+}
+
+void os_free(void *ptr, i32 size) { munmap(ptr, (u64)size); }
@@ -4,34 +4,18 @@
 #include "base.h"
 #include "profiler.h"
 
-typedef enum { DCT_RECT, DCT_RECT_OUTLINE, DCT_TEXT, DCT_LINE, DCT_MESH, DCT_COUNT } DrawCmdType;
-
-typedef struct {
-    DrawCmdType t;
-    col32       color;
-
-    union {
-        struct { // text
-            char *text;
-            i32   x, y;
-        };
-
-        struct { // rect
-            rect r;
-        };
-
-        struct { // line
-            v2 from, to;
-        };
-
-        struct { // mesh
-            v3  *vertices;
-            i32  count;
-            v2i *edges;
-            i32  edges_count;
-        };
-    };
-} DrawCmd;
+// TCC has no intrinsics, the engine's spin waits use this one
+static inline void _mm_pause(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __asm__ volatile("pause");
+#elif defined(__aarch64__)
+    __asm__ volatile("yield");
+#elif defined(__arm__)
+    __asm__ volatile("yield");
+#else
+    // no-op
+#endif
+}
 
 typedef struct {
     TCCState *tcc;
@@ -39,6 +23,10 @@ typedef struct {
     void (*init)();
     Info *info;
     void (*update)(q8 dt);
+    void (*simulate)(q16 dt);
+    void (*render)(q16 alpha);
+    void (*latch)();   // Optional, see input_latch
+    bool (*restore)(); // Optional, see game_start
     void (*quit)();
     i32 (*gamedata_size)();
     FILETIME last_write;
@@ -46,200 +34,102 @@ typedef struct {
 } GameDLL;
 
 typedef struct {
-    Context ctx;
-    GameDLL game;
-    u8     *game_memory;
-
-    bool            shutdown;
+    HWND            hwnd;
     MSG             msg;
-    LARGE_INTEGER   freq;
     WINDOWPLACEMENT prev_placement;
-    v2              mouse_pos;
-    KeyState        keys[K_COUNT];
-    v2i             screen_size;
-    u32            *screen_buf;
-    DrawCmd        *draw_queue;
-    u32             draw_size, draw_count;
-    HWND            hwnd;
-    Metrics         metrics;
-    SystemInfo      system_info;
-    Profiler        profiler;
-} EngineData;
-
-#ifdef ENGINE_IMPL
-static EngineData *G;
-#else
-import extern EngineData *G;
-#endif
+    v2i             client_size; // When last presented
+    bool            repaint;     // Part of the window was lost, present all of it next frame
+    HDC             screen_dc;   // With the DIB section G->screen_buf points into, see CreateScreen
+} Platform;
 
-Context *ctx() { return &G->ctx; }
+#include "engine.c"
 
-void draw_mesh(v3 *p, i32 count, v2i *e, i32 edges_count, col32 color) {
-    if (G->draw_count == G->draw_size) return;
-    G->draw_queue[G->draw_count++] = (DrawCmd){.t           = DCT_MESH,
-                                               .vertices    = p,
-                                               .count       = count,
-                                               .edges       = e,
-                                               .edges_count = edges_count,
-                                               .color       = color};
-}
+void *image_read(char *path) { return LoadImage(NULL, path, IMAGE_BITMAP, 0, 0, LR_LOADFROMFILE); }
 
-void draw_rect(rect r, col32 color) {
-    if (G->draw_count == G->draw_size) return;
-    G->draw_queue[G->draw_count++] = (DrawCmd){.t = DCT_RECT, .r = r, .color = color};
-}
+string file_read(char *path) {
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return (string){0};
 
-void draw_rect_outline(rect r, col32 color) {
-    if (G->draw_count == G->draw_size) return;
-    G->draw_queue[G->draw_count++] = (DrawCmd){.t = DCT_RECT_OUTLINE, .r = r, .color = color};
-}
+    i32   size = (i32)GetFileSize(file, NULL);
+    u8   *text = alloc_perm(size + 1);
+    DWORD read = 0;
+    ReadFile(file, text, size, &read, NULL);
+    CloseHandle(file);
 
-void draw_circle(i32 x, i32 y, i32 r, col32 color) {
-    for (i32 y_coord = y - r; y_coord <= y + r; y_coord++) {
-        for (i32 x_coord = x - r; x_coord <= x + r; x_coord++) {
-            i32 dx = x_coord - x;
-            i32 dy = y_coord - y;
-            if (dx * dx + dy * dy <= r * r) {
-                if (x_coord >= 0 && x_coord < G->screen_size.w && y_coord >= 0 &&
-                    y_coord < G->screen_size.h) {
-                    G->screen_buf[y_coord * G->screen_size.w + x_coord] = color;
-                }
-            }
-        }
-    }
+    text[read] = 0;
+    return (string){.text = text, .len = (i32)read};
 }
 
-void draw_circle_outline(i32 x, i32 y, i32 r, col32 color) {
-    for (i32 y_coord = y - r; y_coord <= y + r; y_coord++) {
-        for (i32 x_coord = x - r; x_coord <= x + r; x_coord++) {
-            i32 dx      = x_coord - x;
-            i32 dy      = y_coord - y;
-            i32 dist_sq = dx * dx + dy * dy;
-            if (dist_sq >= (r - 1) * (r - 1) && dist_sq <= r * r) {
-                if (x_coord >= 0 && x_coord < G->screen_size.w && y_coord >= 0 &&
-                    y_coord < G->screen_size.h) {
-                    G->screen_buf[y_coord * G->screen_size.w + x_coord] = color;
-                }
-            }
-        }
-    }
-}
+i32 file_write_bytes(char *path, u8 *data, i32 len) {
+    HANDLE file =
+        CreateFileA(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return -1;
 
-f32 atan2f(f32 y, f32 x) {
-    const f32 PI   = 3.14159265358979f;
-    const f32 PI_2 = 1.57079632679489f;
+    DWORD written = 0;
+    WriteFile(file, data, (DWORD)len, &written, NULL);
+    CloseHandle(file);
 
-    if (x == 0.0f) {
-        if (y > 0.0f) return PI_2;
-        if (y < 0.0f) return -PI_2;
-        return 0.0f;
-    }
-
-    f32 z     = y / x;
-    f32 abs_z = z < 0 ? -z : z;
-
-    f32 angle = z / (1.0f + 0.28662f * abs_z * abs_z);
-
-    if (x < 0.0f) {
-        if (y >= 0.0f)
-            angle += PI;
-        else
-            angle -= PI;
-    }
-
-    return angle;
-}
-
-void draw_arc(i32 x, i32 y, i32 r, rad from, rad to, col32 color) {
-    for (i32 y_coord = y - r; y_coord <= y + r; y_coord++) {
-        for (i32 x_coord = x - r; x_coord <= x + r; x_coord++) {
-            i32 dx = x_coord - x;
-            i32 dy = y_coord - y;
-            if (dx * dx + dy * dy <= r * r) {
-                f32 angle = atan2f((f32)dy, (f32)dx);
-                if (angle >= from && angle <= to) {
-                    if (x_coord >= 0 && x_coord < G->screen_size.w && y_coord >= 0 &&
-                        y_coord < G->screen_size.h) {
-                        G->screen_buf[y_coord * G->screen_size.w + x_coord] = color;
-                    }
-                }
-            }
-        }
-    }
+    return (i32)written;
 }
 
-i32 abs(i32 x) { return x < 0 ? -x : x; }
-
-void render_line(v2i from, v2i to, col32 color) {
-    i32 dx = to.x - from.x;
-    i32 dy = to.y - from.y;
-
-    i32 steps = abs(dx) > abs(dy) ? abs(dx) : abs(dy);
-    if (steps == 0) return;
+i32 file_append_bytes(char *path, u8 *data, i32 len) {
+    HANDLE file =
+        CreateFileA(path, FILE_APPEND_DATA, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return -1;
 
-    f32 x_inc = (f32)dx / steps;
-    f32 y_inc = (f32)dy / steps;
+    DWORD written = 0;
+    WriteFile(file, data, (DWORD)len, &written, NULL);
+    CloseHandle(file);
 
-    f32 x = (f32)from.x;
-    f32 y = (f32)from.y;
-
-    for (i32 i = 0; i <= steps; i++) {
-        if ((i16)x >= 0 && (i16)x < G->screen_size.w && (i16)y >= 0 && (i16)y < G->screen_size.h) {
-            G->screen_buf[(i16)y * G->screen_size.w + (i16)x] = color;
-        }
-        x += x_inc;
-        y += y_inc;
-    }
+    return (i32)written;
 }
 
-void draw_text(char *text, i32 x, i32 y, col32 color) {
-    if (G->draw_count == G->draw_size) return;
-
-    G->draw_queue[G->draw_count++] =
-        (DrawCmd){.t = DCT_TEXT, .color = color, .text = text, .x = x, .y = y};
+i32 file_write(char *path, char *data) {
+    i32 len = 0;
+    while (data[len])
+        len++;
+    return file_write_bytes(path, (u8 *)data, len);
 }
 
-void *image_read(char *path) { return LoadImage(NULL, path, IMAGE_BITMAP, 0, 0, LR_LOADFROMFILE); }
-
-char *string_format(Arena *a, char *fmt, ...) {
-    va_list args;
-    va_start(args, fmt);
+u8 *file_map(char *path, i64 *size) {
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
 
-    va_list copy;
-    va_copy(copy, args);
-
-    i32 needed = vsnprintf(NULL, 0, fmt, args);
-    va_end(args);
-
-    char *result = alloc((u64)needed + 1, a);
-
-    vsnprintf(result, (u64)needed + 1, fmt, copy);
-    va_end(copy);
+    DWORD high = 0, low = GetFileSize(file, &high);
+    *size      = (i64)high << 32 | low;
 
+    // The view keeps both the mapping and the file open
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    u8    *result  = mapping ? (u8 *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (mapping) CloseHandle(mapping);
+    CloseHandle(file);
     return result;
 }
 
-bool gui_button(char *name, q8 x, q8 y) {
-    rect  r     = {x, y, Q8(60), Q8(20)};
-    bool  col   = col_point_rect(G->mouse_pos, r);
-    col32 color = col ? rgb(100, 100, 100) : rgb(30, 30, 30);
+void file_unmap(u8 *data, i64 size) { UnmapViewOfFile(data); }
 
-    draw_rect(r, color);
-    draw_text(name, q8_to_i32(x), q8_to_i32(y), rgb(250, 250, 250));
-
-    return G->keys[K_MOUSE_LEFT] == KS_JUST_PRESSED && col;
-}
-
-bool gui_toggle(char *name, q8 x, q8 y, bool *val) {
-    rect  r     = {x, y, Q8(60), Q8(20)};
-    col32 color = *val ? rgb(100, 100, 100) : rgb(30, 30, 30);
-
-    draw_rect(r, color);
-    draw_text(name, q8_to_i32(x), q8_to_i32(y), rgb(250, 250, 250));
+// PrefetchVirtualMemory is Windows 8 and later, and missing from TCC's kernel32.def
+typedef struct {
+    void  *VirtualAddress;
+    SIZE_T NumberOfBytes;
+} MY_WIN32_MEMORY_RANGE_ENTRY;
+typedef BOOL(__stdcall *PrefetchVirtualMemoryProc)(HANDLE, ULONG_PTR, MY_WIN32_MEMORY_RANGE_ENTRY *,
+                                                   ULONG);
+
+void file_prefetch(u8 *data, i64 size) {
+    persist PrefetchVirtualMemoryProc prefetch = NULL;
+    persist bool                      looked   = false;
+    if (!looked) {
+        prefetch = (PrefetchVirtualMemoryProc)GetProcAddress(GetModuleHandleA("kernel32.dll"),
+                                                             "PrefetchVirtualMemory");
+        looked   = true;
+    }
+    if (!prefetch) return;
 
-    bool pressed = G->keys[K_MOUSE_LEFT] == KS_JUST_PRESSED && col_point_rect(G->mouse_pos, r);
-    if (pressed) *val ^= true;
-    return pressed;
+    MY_WIN32_MEMORY_RANGE_ENTRY range = {.VirtualAddress = data, .NumberOfBytes = (SIZE_T)size};
+    prefetch(GetCurrentProcess(), 1, &range, 0);
 }
 
 // Manually declare what we need instead of Psapi.h
@@ -257,12 +147,6 @@ typedef struct {
     u64 PrivateUsage;
 } MY_PROCESS_MEMORY_COUNTERS_EX;
 
-static f64 now_seconds() {
-    LARGE_INTEGER t;
-    QueryPerformanceCounter(&t);
-    return (f64)t.QuadPart / (f64)G->freq.QuadPart;
-}
-
 // TCC needs these declared as regular C functions with __stdcall
 import BOOL __stdcall K32GetProcessMemoryInfo(HANDLE, MY_PROCESS_MEMORY_COUNTERS_EX *, u32);
 import BOOL __stdcall GlobalMemoryStatusEx(MEMORYSTATUSEX *);
@@ -289,59 +173,45 @@ u64 ReadPageFaultCount(Metrics m) {
     return result;
 }
 
-u64 EstimateCPUTimerFreq() {
-    u64 MillisecondsToWait = 100;
-
-    LARGE_INTEGER OSFreq = {0};
-    QueryPerformanceFrequency(&OSFreq);
-
-    u64           CPUStart = ReadCPUTimer();
-    LARGE_INTEGER OSStart  = {0};
-    QueryPerformanceCounter(&OSStart);
-    LARGE_INTEGER OSEnd      = {0};
-    u64           OSElapsed  = 0;
-    u64           OSWaitTime = OSFreq.QuadPart * MillisecondsToWait / 1000;
-    while (OSElapsed < OSWaitTime) {
-        QueryPerformanceCounter(&OSEnd);
-        OSElapsed = OSEnd.QuadPart - OSStart.QuadPart;
-    }
+// Reading PMCs on Windows needs a kernel driver, so hw_available is never set here
+HwCounters ReadHardwareCounters(Metrics m) { return (HwCounters){0}; }
 
-    u64 CPUEnd     = ReadCPUTimer();
-    u64 CPUElapsed = CPUEnd - CPUStart;
-
-    u64 CPUFreq = 0;
-    if (OSElapsed) {
-        CPUFreq = OSFreq.QuadPart * CPUElapsed / OSElapsed;
-    }
-
-    return CPUFreq;
-};
+u64 ReadOSTimer() {
+    LARGE_INTEGER result = {0};
+    QueryPerformanceCounter(&result);
+    return result.QuadPart;
+}
 
-u64 ReadCPUTimer(void) {
-#if defined(__x86_64__) || defined(__amd64__) || defined(_M_X64) || defined(_M_AMD64) || \
-    defined(__i386__) || defined(_M_IX86)
-    // TCC doesn't support __rdtsc intrinsic; use inline asm instead
-    u32 lo = 0;
-    u32 hi = 0;
-    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
-    return ((u64)hi << 32) | lo;
+u64 GetOSTimerFreq() {
+    LARGE_INTEGER result = {0};
+    QueryPerformanceFrequency(&result);
+    return result.QuadPart;
+}
 
-#elif defined(__aarch64__)
-    // ARMv8 (AArch64): use CNTVCT_EL0
-    u64 cnt = 0;
-    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(cnt));
-    return cnt;
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x2
+#endif
 
-#elif defined(__arm__)
-    // ARMv7-A: use PMCCNTR (if enabled)
-    u32 cc = 0;
-    __asm__ volatile("mrc p15, 0, %0, c9, c13, 0" : "=r"(cc));
-    return (u64)cc;
+// High resolution waitable timers are Windows 10 1803 and later, and not in TCC's kernel32.def, so
+// they're looked up at runtime. Older versions sleep in scheduler ticks.
+void os_sleep(f64 seconds) {
+    typedef HANDLE(WINAPI * CreateTimerEx)(LPSECURITY_ATTRIBUTES, LPCWSTR, DWORD, DWORD);
+    persist HANDLE timer = NULL;
+    persist bool   tried = false;
+    if (!tried) {
+        tried = true;
+        HMODULE       kernel32 = GetModuleHandleA("kernel32.dll");
+        CreateTimerEx create   = (CreateTimerEx)GetProcAddress(kernel32, "CreateWaitableTimerExW");
+        if (create)
+            timer = create(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    }
 
-#else
-    static_assert(false, "Unsupported architecture");
-    return 0;
-#endif
+    LARGE_INTEGER due = {.QuadPart = -(i64)(seconds * 10000000.0)}; // Relative, in 100ns
+    if (timer && SetWaitableTimer(timer, &due, 0, NULL, NULL, false)) {
+        WaitForSingleObject(timer, INFINITE);
+    } else {
+        Sleep((DWORD)(seconds * 1000.0));
+    }
 }
 
 #ifndef PROCESSOR_ARCHITECTURE_ARM64
@@ -361,6 +231,7 @@ SystemInfo systeminfo_init() {
     result.pageSize              = sysInfo.dwPageSize;
     result.allocationGranularity = sysInfo.dwAllocationGranularity;
 
+    result.osName                = "Windows";
     result.processorArchitecture = "Unknown";
     switch (sysInfo.wProcessorArchitecture) {
     case PROCESSOR_ARCHITECTURE_AMD64: result.processorArchitecture = "x64 (AMD/Intel)"; break;
@@ -412,14 +283,14 @@ static void FullscreenWindow(HWND hWnd) {
     DWORD dwStyle = GetWindowLong(hWnd, GWL_STYLE);
 
     if (dwStyle & WS_OVERLAPPEDWINDOW) {
-        GetWindowPlacement(hWnd, &G->prev_placement);
+        GetWindowPlacement(hWnd, &G->platform.prev_placement);
 
         SetWindowLong(hWnd, GWL_STYLE, dwStyle & ~WS_OVERLAPPEDWINDOW);
         SetWindowPos(hWnd, HWND_TOP, 0, 0, GetSystemMetrics(SM_CXSCREEN),
                      GetSystemMetrics(SM_CYSCREEN), SWP_NOOWNERZORDER | SWP_FRAMECHANGED);
     } else {
         SetWindowLong(hWnd, GWL_STYLE, dwStyle | WS_OVERLAPPEDWINDOW);
-        SetWindowPlacement(hWnd, &G->prev_placement);
+        SetWindowPlacement(hWnd, &G->platform.prev_placement);
         SetWindowPos(hWnd, NULL, 0, 0, 0, 0,
                      SWP_NOMOVE | SWP_NOSIZE | SWP_NOZORDER | SWP_FRAMECHANGED);
     }
@@ -443,10 +314,181 @@ static void CenterWindow(HWND hWnd) {
     SetWindowPos(hWnd, NULL, xpos, ypos, 0, 0, SWP_NOSIZE | SWP_NOZORDER | SWP_NOACTIVATE);
 }
 
+// The framebuffer is a DIB section, so GDI draws text right into it and presents from it without
+// copying the screen. screen_size never changes, StretchBlt scales it to the window.
+static u32 *CreateScreen() {
+    BITMAPINFOHEADER bmi = {
+        .biSize        = sizeof(BITMAPINFOHEADER),
+        .biWidth       = G->screen_size.w,
+        .biHeight      = -G->screen_size.h,
+        .biPlanes      = 1,
+        .biBitCount    = 32,
+        .biCompression = BI_RGB,
+    };
+    void   *bits = NULL;
+    HBITMAP bmp  = CreateDIBSection(NULL, (BITMAPINFO *)&bmi, DIB_RGB_COLORS, &bits, NULL, 0);
+    if (!bmp) return NULL;
+
+    G->platform.screen_dc = CreateCompatibleDC(NULL);
+    SelectObject(G->platform.screen_dc, bmp);
+    SetBkMode(G->platform.screen_dc, TRANSPARENT);
+    return (u32 *)bits;
+}
+
+// Presents the damaged parts of the screen, see damage_update, with the queued text drawn by GDI.
+// Everything is presented when the window was resized or lost part of its contents.
+static void PresentWindow() {
+    Damage *d   = &G->damage;
+    HDC     hdc = GetDC(G->platform.hwnd);
+    RECT    rc  = {0};
+    GetClientRect(G->platform.hwnd, &rc);
+
+    v2i  client  = {.w = rc.right - rc.left, .h = rc.bottom - rc.top};
+    bool resized = client.w != G->platform.client_size.w || client.h != G->platform.client_size.h;
+    bool full    = G->platform.repaint || resized;
+    G->platform.repaint     = false;
+    G->platform.client_size = client;
+    if (!full && !d->rects_count) {
+        ReleaseDC(G->platform.hwnd, hdc);
+        return;
+    }
+
+    HDC buf_dc = G->platform.screen_dc;
+
+    // Text is blended, so it only goes over pixels rasterized this frame. Anywhere else it's
+    // already there from an earlier frame.
+    HRGN damaged = CreateRectRgn(0, 0, 0, 0);
+    for (i32 i = 0; i < d->rects_count; i++) {
+        i32rect r    = d->rects[i];
+        HRGN    rect = CreateRectRgn(r.x, r.y, r.x + r.w, r.y + r.h);
+        CombineRgn(damaged, damaged, rect, RGN_OR);
+        DeleteObject(rect);
+    }
+    SelectClipRgn(buf_dc, damaged);
+    DeleteObject(damaged);
+
+    for (i32 i = 0; i < G->draw_count; i++) {
+        DrawCmd next = G->draw_queue[i];
+        if (next.t == DCT_TEXT) {
+            RECT r = {
+                .left   = next.x,
+                .top    = next.y,
+                .right  = G->screen_size.w,
+                .bottom = G->screen_size.h,
+            };
+            SetTextColor(buf_dc, next.color);
+            DrawText(buf_dc, next.text, -1, &r, DT_LEFT | DT_TOP);
+        }
+    }
+
+    GdiFlush(); // The rasterizers write to the same pixels next frame
+
+    // Each rect is stretched on its own, with edges rounded the same way for the ones next to it
+    SetStretchBltMode(hdc, COLORONCOLOR);
+    if (full) {
+        StretchBlt(hdc, 0, 0, client.w, client.h, buf_dc, 0, 0, G->screen_size.w,
+                   G->screen_size.h, SRCCOPY);
+    } else {
+        for (i32 i = 0; i < d->rects_count; i++) {
+            i32rect r  = d->rects[i];
+            i32     x0 = r.x * client.w / G->screen_size.w;
+            i32     y0 = r.y * client.h / G->screen_size.h;
+            i32     x1 = (r.x + r.w) * client.w / G->screen_size.w;
+            i32     y1 = (r.y + r.h) * client.h / G->screen_size.h;
+            StretchBlt(hdc, x0, y0, x1 - x0, y1 - y0, buf_dc, r.x, r.y, r.w, r.h, SRCCOPY);
+        }
+    }
+
+    ReleaseDC(G->platform.hwnd, hdc);
+}
+
+// Window messages that are input go to the input ring, see input_push
+static void PushInput(MSG *msg) {
+    InputEvent e = {.time = ReadOSTimer()};
+    switch (msg->message) {
+    case WM_LBUTTONDOWN:
+    case WM_LBUTTONUP: e.key = K_MOUSE_LEFT; break;
+    case WM_MBUTTONDOWN:
+    case WM_MBUTTONUP: e.key = K_MOUSE_MID; break;
+    case WM_RBUTTONDOWN:
+    case WM_RBUTTONUP: e.key = K_MOUSE_RIGHT; break;
+
+    case WM_KEYDOWN:
+    case WM_KEYUP:
+        switch (msg->wParam) {
+        case VK_UP: e.key = K_UP; break;
+        case VK_DOWN: e.key = K_DOWN; break;
+        case VK_LEFT: e.key = K_LEFT; break;
+        case VK_RIGHT: e.key = K_RIGHT; break;
+        case 'W': e.key = K_W; break;
+        case 'A': e.key = K_A; break;
+        case 'R': e.key = K_R; break;
+        case 'S': e.key = K_S; break;
+
+        default: return;
+        }
+        break;
+
+    case WM_MOUSEMOVE:
+        e.t   = IE_MOUSE_MOVE;
+        e.pos = (v2){
+            .x = Q8(msg->lParam & 0xFFFF),
+            .y = Q8((msg->lParam >> 16) & 0xFFFF),
+        };
+        input_push(e);
+        return;
+
+    default: return;
+    }
+
+    bool up = msg->message == WM_LBUTTONUP || msg->message == WM_MBUTTONUP ||
+              msg->message == WM_RBUTTONUP || msg->message == WM_KEYUP;
+    e.t     = up ? IE_KEY_UP : IE_KEY_DOWN;
+    input_push(e);
+}
+
+// Options of the windowed builds: --replay input.rec runs a recorded session and quits after it,
+// see input_replay_frame, and --max-speed doesn't pace frames
+static bool ParseCommandLine(char *cmd, InputRecording *replay, bool *max_speed) {
+    *max_speed = strstr(cmd, "--max-speed") != NULL;
+
+    char *arg = strstr(cmd, "--replay ");
+    if (!arg) return true;
+
+    char path[MAX_PATH] = {0};
+    if (sscanf(arg, "--replay %259s", path) != 1) return false;
+
+    *replay = input_record_load(path);
+    if (!replay->data) ERR("Couldn't load input recording %s", path);
+    return replay->data != NULL;
+}
+
+#define IDLE_WAIT_MS 250 // How often hot reload is checked for while idle
+
+// Blocks until the OS has something for the window when the game opted into idling and nothing
+// changed since the last frame. Returns whether it did, in which case that frame shouldn't run.
+static bool WaitIdle() {
+    if (!G->game.info->idle || G->animating || G->platform.repaint || G->profiler.overlay)
+        return false;
+
+    // Keys that were just pressed or released still need a frame to settle, and events that came
+    // in while latching are still in the ring
+    for (i32 i = 0; i < K_COUNT; i++) {
+        if (G->keys[i] == KS_JUST_PRESSED || G->keys[i] == KS_JUST_RELEASED) return false;
+    }
+    if (G->input_ring.head != G->input_ring.tail) return false;
+
+    // MsgWaitForMultipleObjects only wakes for messages that arrived since the last peek
+    if (HIWORD(GetQueueStatus(QS_ALLINPUT))) return false;
+
+    MsgWaitForMultipleObjects(0, NULL, false, IDLE_WAIT_MS, QS_ALLINPUT);
+    return true;
+}
+
 #define THREAD_COUNT 8
 
-static inline i64 read_acquire(volatile i64 *src) {
-    i64 val = *src;
+i32 read_acquire(volatile i32 *src) {
+    i32 val = *src;
 #if defined(__x86_64__) || defined(__i386__)
     __asm__ volatile("" ::: "memory"); // compiler barrier (x86 has strong ordering)
 #elif defined(__aarch64__)
@@ -459,29 +501,28 @@ static inline i64 read_acquire(volatile i64 *src) {
     return val;
 }
 
-static inline void _mm_pause(void) {
+void write_release(volatile i32 *dst, i32 val) {
 #if defined(__x86_64__) || defined(__i386__)
-    __asm__ volatile("pause");
-#elif defined(__aarch64__)
-    __asm__ volatile("yield");
-#elif defined(__arm__)
-    __asm__ volatile("yield");
+    __asm__ volatile("" ::: "memory"); // compiler barrier (x86 has strong ordering)
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ volatile("dmb ish" ::: "memory");
 #else
-    // no-op
+    __asm__ volatile("" ::: "memory"); // fallback: compiler barrier only
 #endif
+    *dst = val;
 }
 
 void thread_barrier(void) {
-    static volatile i64 barrier_count      = 0;
-    static volatile i64 barrier_generation = 0;
+    static volatile i32 barrier_count      = 0;
+    static volatile i32 barrier_generation = 0;
     static i32          barrier_total      = THREAD_COUNT;
 
-    i64 gen       = read_acquire(&barrier_generation);
-    i64 new_count = InterlockedIncrement(&barrier_count);
+    i32 gen       = read_acquire(&barrier_generation);
+    i32 new_count = InterlockedIncrement((volatile LONG *)&barrier_count);
 
     if (new_count == barrier_total) {
-        InterlockedExchange(&barrier_count, 0);
-        InterlockedIncrement(&barrier_generation);
+        InterlockedExchange((volatile LONG *)&barrier_count, 0);
+        InterlockedIncrement((volatile LONG *)&barrier_generation);
     } else {
         while (read_acquire(&barrier_generation) == gen) {
             YieldProcessor();
@@ -489,58 +530,20 @@ void thread_barrier(void) {
     }
 }
 
-u8 *os_alloc(i32 size) {
-    return (u8 *)VirtualAlloc(NULL, (SIZE_T)size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+i32 atomic_add(volatile i32 *dst, i32 val) {
+    return InterlockedExchangeAdd((volatile LONG *)dst, val) + val;
 }
 
-void render_filled_triangle(v2i p0, v2i p1, v2i p2, col32 color) {
-    // Sort vertices by y coordinate (p0.y <= p1.y <= p2.y)
-    if (p0.y > p1.y) {
-        v2i tmp = p0;
-        p0      = p1;
-        p1      = tmp;
-    }
-    if (p0.y > p2.y) {
-        v2i tmp = p0;
-        p0      = p2;
-        p2      = tmp;
-    }
-    if (p1.y > p2.y) {
-        v2i tmp = p1;
-        p1      = p2;
-        p2      = tmp;
-    }
-
-    i32 total_height = p2.y - p0.y;
-    if (total_height == 0) return;
-
-    for (i32 y = p0.y; y <= p2.y; y++) {
-        if (y < 0 || y >= G->screen_size.h) continue;
-
-        bool second_half    = (y > p1.y) || (p1.y == p0.y);
-        i32  segment_height = second_half ? (p2.y - p1.y) : (p1.y - p0.y);
-        if (segment_height == 0) continue;
-
-        f32 alpha = (f32)(y - p0.y) / (f32)total_height;
-        f32 beta  = second_half ? (f32)(y - p1.y) / (f32)segment_height
-                                : (f32)(y - p0.y) / (f32)segment_height;
-
-        i32 xa = (i32)(p0.x + (p2.x - p0.x) * alpha);
-        i32 xb =
-            second_half ? (i32)(p1.x + (p2.x - p1.x) * beta) : (i32)(p0.x + (p1.x - p0.x) * beta);
+void *atomic_cas_ptr(void *volatile *dst, void *val, void *expected) {
+    return InterlockedCompareExchangePointer(dst, val, expected);
+}
 
-        if (xa > xb) {
-            i32 tmp = xa;
-            xa      = xb;
-            xb      = tmp;
-        }
+u8 *os_alloc(i32 size) {
+    return (u8 *)VirtualAlloc(NULL, (SIZE_T)size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+}
 
-        // Clamp to screen
-        if (xa < 0) xa = 0;
-        if (xb >= G->screen_size.w) xb = G->screen_size.w - 1;
+u8 *os_alloc_at(u64 base, i32 size) {
+    return (u8 *)VirtualAlloc((void *)base, (SIZE_T)size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+}
 
-        for (i32 x = xa; x <= xb; x++) {
-            G->screen_buf[y * G->screen_size.w + x] = color;
-        }
-    }
-}
\ No newline at end of file
+void os_free(void *ptr, i32 size) { VirtualFree(ptr, 0, MEM_RELEASE); }
@@ -0,0 +1,1176 @@
+#define ENGINE_IMPL
+#include "base_linux.c"
+#include "profiler.c"
+
+#include <stdlib.h>
+
+// <math.h> would clash with log() from base.h
+f64 sin(f64 x);
+f64 cos(f64 x);
+f64 sqrt(f64 x);
+
+// Microbenchmarks for the software rasterizer, the batched math and the collision tests. Every
+// raster case draws `count` primitives of one kind into an offscreen buffer per repetition, every
+// math case runs one v3soa function over `count` vectors, every broadphase case moves `size` rects
+// `count` times and finds the overlapping pairs, every collision case tests `count` queries
+// against `size` rects, and every tile case runs `count` queries on a `size` squared tilemap,
+// timed with RepProfiler. Results can be written as a tab-separated file and compared against one
+// from an earlier run:
+//     ./handmade_bench --out before.tsv
+//     ./handmade_bench --baseline before.tsv
+// Math checksums depend on the fx format, so only compare builds with the same FX_Q16 setting:
+//     CFLAGS=-DFX_Q16 ./run_bench.sh
+
+typedef enum {
+    BK_LINE,
+    BK_TRIANGLE,
+    BK_RECT,
+    BK_CIRCLE,
+    BK_ARC,
+    BK_TEXT,
+    BK_MESH,
+    BK_TILES,
+
+    BK_V3_ADD,
+    BK_V3_SUB,
+    BK_V3_MUL,
+    BK_V3_SCALE,
+    BK_V3_DOT,
+    BK_V3_CROSS,
+    BK_V3_ROTATE,
+    BK_V3_LENGTH,
+    BK_V3_NORMALIZE,
+    BK_SINCOS,
+    BK_PROJECT,
+
+    BK_GRID_PAIRS,
+    BK_BRUTE_PAIRS,
+
+    BK_COL_LOOP,
+    BK_COL_RECTS,
+    BK_COL_HITS,
+    BK_COL_POINTS,
+
+    BK_TILE_ROWS,
+    BK_TILE_REGION,
+    BK_TILE_SWEEP,
+    BK_TILE_STREAM,
+    BK_TILE_CACHE,
+
+    BK_COUNT,
+} BenchKind;
+
+static cstr bench_kind_names[BK_COUNT] = {
+    [BK_LINE] = "line",          [BK_TRIANGLE] = "triangle",  [BK_RECT] = "rect",
+    [BK_CIRCLE] = "circle",      [BK_ARC] = "arc",            [BK_TEXT] = "text",
+    [BK_MESH] = "mesh",          [BK_V3_ADD] = "v3soa_add",   [BK_V3_SUB] = "v3soa_sub",
+    [BK_V3_MUL] = "v3soa_mul",   [BK_V3_SCALE] = "v3soa_scale", [BK_V3_DOT] = "v3soa_dot",
+    [BK_V3_CROSS] = "v3soa_cross", [BK_V3_ROTATE] = "v3soa_rotate", [BK_V3_LENGTH] = "v3soa_length",
+    [BK_V3_NORMALIZE] = "v3soa_normalize", [BK_SINCOS] = "sincos", [BK_PROJECT] = "project",
+    [BK_GRID_PAIRS] = "grid_pairs", [BK_BRUTE_PAIRS] = "brute_pairs", [BK_COL_LOOP] = "col_loop",
+    [BK_COL_RECTS] = "col_rects", [BK_COL_HITS] = "col_rects_hits", [BK_COL_POINTS] = "col_points",
+    [BK_TILE_ROWS] = "tile_rows", [BK_TILE_REGION] = "tile_region", [BK_TILE_SWEEP] = "tile_sweep",
+    [BK_TILE_STREAM] = "tile_stream", [BK_TILES] = "tiles", [BK_TILE_CACHE] = "tile_cache",
+};
+
+typedef struct {
+    BenchKind kind;
+    i32       size;  // Line length, triangle and rect side, radius, characters, mesh vertices,
+                     // vectors per math call, colliders or tilemap side
+    i32       count; // Primitives, math calls, broadphase steps, queries or frames per repetition
+} BenchCase;
+
+static const BenchCase bench_cases[] = {
+    {BK_LINE, 16, 10000},    {BK_LINE, 128, 2000},     {BK_LINE, 512, 500},
+    {BK_TRIANGLE, 8, 10000}, {BK_TRIANGLE, 64, 1000},  {BK_TRIANGLE, 256, 100},
+    {BK_RECT, 8, 10000},     {BK_RECT, 64, 1000},      {BK_RECT, 256, 100},
+    {BK_CIRCLE, 4, 10000},   {BK_CIRCLE, 32, 500},     {BK_CIRCLE, 128, 30},
+    {BK_ARC, 4, 10000},      {BK_ARC, 32, 500},        {BK_ARC, 128, 30},
+    {BK_TEXT, 16, 1000},     {BK_TEXT, 64, 250},       {BK_MESH, 8, 2000},
+    {BK_MESH, 64, 200},      {BK_MESH, 512, 25},       {BK_TILES, 8, 50},
+    {BK_TILES, 32, 100},     {BK_V3_ADD, 1024, 64},
+    {BK_V3_ADD, 262144, 1},  {BK_V3_SUB, 1024, 64},    {BK_V3_MUL, 1024, 64},
+    {BK_V3_MUL, 262144, 1},  {BK_V3_SCALE, 1024, 64},  {BK_V3_DOT, 1024, 64},
+    {BK_V3_DOT, 262144, 1},  {BK_V3_CROSS, 1024, 64},  {BK_V3_CROSS, 262144, 1},
+    {BK_V3_ROTATE, 1024, 64}, {BK_V3_ROTATE, 262144, 1}, {BK_V3_LENGTH, 1024, 64},
+    {BK_V3_LENGTH, 262144, 1}, {BK_V3_NORMALIZE, 1024, 64}, {BK_V3_NORMALIZE, 262144, 1},
+    {BK_SINCOS, 1024, 64},   {BK_SINCOS, 262144, 1},   {BK_PROJECT, 1024, 64},
+    {BK_PROJECT, 262144, 1}, {BK_GRID_PAIRS, 1024, 16}, {BK_GRID_PAIRS, 4096, 4},
+    {BK_BRUTE_PAIRS, 1024, 16}, {BK_BRUTE_PAIRS, 4096, 1}, {BK_COL_LOOP, 4096, 64},
+    {BK_COL_RECTS, 4096, 64}, {BK_COL_HITS, 4096, 64}, {BK_COL_POINTS, 4096, 64},
+    {BK_TILE_ROWS, 4096, 4096}, {BK_TILE_REGION, 4096, 4096}, {BK_TILE_SWEEP, 4096, 4096},
+    {BK_TILE_STREAM, 4096, 1024}, {BK_TILE_CACHE, 8, 240}, {BK_TILE_CACHE, 8, 241},
+    {BK_TILE_CACHE, 32, 240},
+};
+
+typedef struct {
+    char name[32];
+    u64  items, bytes; // Pixels written or vectors processed per repetition, and bytes touched
+    u64  checksum;     // Hash of one repetition's output
+    f64  min_ms, avg_ms, mitems_s, gb_s;
+} BenchResult;
+
+typedef struct {
+    i32  repeats;
+    cstr filter;
+    bool verbose;
+
+    char  **strings;   // BK_TEXT, one per case
+    Mesh    ring;      // BK_MESH, rebuilt for each case
+    Tilemap tiles;     // BK_TILES, rebuilt for each case
+    v3     *verts;     // BK_PROJECT input, the math case's a as AoS
+    v2     *projected; // BK_PROJECT output
+    u64     sink;      // Results of cases that only return values, so they aren't optimized out
+} Bench;
+
+static Bench bench;
+
+// Screen space extent of one primitive, so every instance is placed fully on screen
+static v2i bench_extent(BenchCase c) {
+    switch (c.kind) {
+    case BK_CIRCLE:
+    case BK_ARC: return (v2i){.w = c.size * 2 + 1, .h = c.size * 2 + 1};
+    case BK_TEXT: return (v2i){.w = c.size * FONT_W, .h = FONT_H};
+    case BK_LINE:
+    case BK_TRIANGLE:
+    case BK_RECT: return (v2i){.w = c.size + 1, .h = c.size + 1};
+    default: return (v2i){0};
+    }
+}
+
+// A closed polygon at z = 2, which projects to a circle of a quarter screen height
+static void bench_ring(i32 vertices) {
+    Mesh *m        = &bench.ring;
+    m->verts_count = vertices;
+    m->edges_count = vertices;
+    m->verts       = (v3 *)alloc_temp(sizeof(v3) * vertices);
+    m->edges       = (v2i *)alloc_temp(sizeof(v2i) * vertices);
+
+    for (i32 i = 0; i < vertices; i++) {
+        fx angle    = (fx)((i64)FX_TAU * i / vertices);
+        m->verts[i] = (v3){.x = fx_cos(angle), .y = fx_sin(angle), .z = FX(2)};
+        m->edges[i] = (v2i){.from = i, .to = (i + 1) % vertices};
+    }
+}
+
+// Draws the i-th instance of a case. Positions are a fixed sequence and shapes repeat every
+// four instances, so every run rasterizes exactly the same pixels.
+static void bench_draw(BenchCase c, i32 i, col32 color) {
+    v2i extent = bench_extent(c);
+    i32 x      = (i32)((u32)i * 7919u % (u32)(G->screen_size.w - extent.w + 1));
+    i32 y      = (i32)((u32)i * 104729u % (u32)(G->screen_size.h - extent.h + 1));
+    i32 s      = c.size;
+
+    switch (c.kind) {
+    case BK_LINE: {
+        const v2i ends[4] = {
+            {.x = s, .y = 0},
+            {.x = 0, .y = s},
+            {.x = s, .y = s},
+            {.x = s, .y = s / 3},
+        };
+        v2i end = ends[i % 4];
+        render_line((v2i){.x = x, .y = y}, (v2i){.x = x + end.x, .y = y + end.y}, color);
+        break;
+    }
+    case BK_TRIANGLE: {
+        render_filled_triangle((v2i){.x = x, .y = y}, (v2i){.x = x + s, .y = y + s / 3},
+                               (v2i){.x = x + s / 3, .y = y + s}, color);
+        break;
+    }
+    case BK_RECT: render_rect((i32rect){x, y, s, s}, color); break;
+    case BK_CIRCLE: draw_circle(x + s, y + s, s, color); break;
+    case BK_ARC: draw_arc(x + s, y + s, s, -1.5707963f, 3.1415926f, color); break;
+    case BK_TEXT: render_text(bench.strings[i % 4], x, y, color); break;
+    case BK_MESH: {
+        Mesh *m = &bench.ring;
+        render_mesh(m->verts, m->verts_count, m->edges, m->edges_count, color);
+        break;
+    }
+    case BK_TILES: {
+        col32     colors[3] = {color, color, color};
+        TileLayer layer     = {&bench.tiles, colors, 3, Q8(1), true};
+        v2        camera    = {Q8(x) * 13 + (q8)(i * 37 & 0xFF), Q8(y) * 13 + (q8)(i * 91 & 0xFF)};
+        G->draw_count       = 0;
+        draw_tiles(&layer, camera);
+        render_draw_queue();
+        break;
+    }
+    default: break;
+    }
+}
+
+static void bench_clear() {
+    memset(G->screen_buf, 0, sizeof(u32) * G->screen_size.w * G->screen_size.h);
+}
+
+static u64 bench_hash(u32 *data, i32 count, u64 seed) {
+    u64 result = seed ? seed : 0xcbf29ce484222325ull;
+    for (i32 i = 0; i < count; i++) {
+        result ^= data[i];
+        result *= 0x100000001b3ull;
+    }
+    return result;
+}
+
+static i32 bench_count_pixels(col32 color) {
+    i32 result = 0;
+    for (i32 i = 0; i < G->screen_size.w * G->screen_size.h; i++) {
+        result += G->screen_buf[i] == color;
+    }
+    return result;
+}
+
+static void bench_finish(RepProfiler *rep, BenchResult *result) {
+    f64 freq         = (f64)GetOSTimerFreq();
+    f64 min_secs     = (f64)rep->min.time / freq;
+    result->min_ms   = min_secs * 1000.0;
+    result->avg_ms   = (f64)rep->avg.time / (f64)rep->repeats / freq * 1000.0;
+    result->mitems_s = (f64)result->items / min_secs / 1000000.0;
+    result->gb_s     = to_gb((f64)result->bytes / min_secs);
+
+    if (bench.verbose) repprofiler_print(rep);
+}
+
+// Mostly raw values within +-2^19, a quarter of them over the full 32 bits to cover the
+// truncation of overflowing products
+static fx bench_random(u32 *state) {
+    u32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return (x & 3) ? (fx)((i32)x >> 12) : (fx)x;
+}
+
+// Ids 0 to 3 at random, with 3 left transparent by bench_draw
+static void bench_tilemap(i32 tile) {
+    bench.tiles = tilemap_new((v2i){512, 512}, Q8(tile), &ctx()->temp);
+    u32 state   = 0x2545F491u;
+    for (i32 y = 0; y < 512; y++) {
+        for (i32 x = 0; x < 512; x++) {
+            tilemap_set(&bench.tiles, x, y, (u8)(bench_random(&state) & 3));
+        }
+    }
+}
+
+static void bench_math(BenchKind kind, v3soa dst, fx *dots, v3soa a, v3soa b, fx s, i32 n) {
+    switch (kind) {
+    case BK_V3_ADD: v3soa_add(dst, a, b, n); break;
+    case BK_V3_SUB: v3soa_sub(dst, a, b, n); break;
+    case BK_V3_MUL: v3soa_mul(dst, a, b, n); break;
+    case BK_V3_SCALE: v3soa_scale(dst, a, s, n); break;
+    case BK_V3_DOT: v3soa_dot(dots, a, b, n); break;
+    case BK_V3_CROSS: v3soa_cross(dst, a, b, n); break;
+    case BK_V3_ROTATE: v3soa_rotate_xz(dst, a, s, n); break;
+    case BK_V3_LENGTH: v3soa_length(dots, a, n); break;
+    case BK_V3_NORMALIZE: v3soa_normalize(dst, a, n); break;
+    case BK_SINCOS: q8_sincos_array(dst.y, dst.x, a.x, n); break;
+    case BK_PROJECT: v3_project_array(bench.projected, bench.verts, n); break;
+    default: break;
+    }
+}
+
+// Documented bound of v3_project against the exact division: |x / z| * 2^-18 + 1
+static bool bench_project_in_bounds(v3 v, v2 p) {
+    q8  got[2] = {p.x, p.y};
+    fx  num[2] = {v.x, v.y};
+    for (i32 k = 0; k < 2; k++) {
+        i64 exact = ((i64)num[k] << 8) / v.z;
+        if (exact != (q8)exact) continue; // Overflows either way
+
+        i64 err   = got[k] > exact ? got[k] - exact : exact - got[k];
+        i64 bound = (exact < 0 ? -exact : exact) / 262144 + 1;
+        if (err > bound) return false;
+    }
+    return true;
+}
+
+// v3_rotate_xz against rotation in doubles. Each term is off by the table (1e-4), the angle
+// rounded to a turn (5e-5) and sin and cos rounded to fx, plus 1 from truncating the product.
+static bool bench_rotate_in_bounds(v3 v, v3 r, fx angle) {
+    f64 rad      = (f64)angle / (1 << FX_BITS), c = cos(rad), s = sin(rad);
+    f64 mag      = (f64)(v.x < 0 ? -(i64)v.x : v.x) + (f64)(v.z < 0 ? -(i64)v.z : v.z);
+    f64 bound    = mag * (1.5e-4 + 1.0 / (2 << FX_BITS)) + 2.0;
+    f64 exact[2] = {v.x * c - v.z * s, v.x * s + v.z * c};
+    fx  got[2]   = {r.x, r.z};
+    for (i32 k = 0; k < 2; k++) {
+        f64 err = got[k] - exact[k];
+        if (exact[k] + bound >= 2147483648.0 || exact[k] - bound < -2147483648.0)
+            continue; // Wraps around either way
+        if (err > bound || err < -bound) return false;
+    }
+    return true;
+}
+
+// v3_length against a bit-by-bit square root, exact below 2^48 and within 2^-29 above
+static bool bench_length_in_bounds(v3 v, fx len) {
+    u64 n = v3_length_sq64(v), exact = 0;
+    for (i32 bit = 31; bit >= 0; bit--) {
+        u64 next = exact | (1ull << bit);
+        if (next * next <= n) exact = next;
+    }
+    if (exact > 0x7FFFFFFF) exact = 0x7FFFFFFF;
+
+    u64 err = (u64)len > exact ? (u64)len - exact : exact - (u64)len;
+    return n < (1ull << 48) ? err == 0 : err <= (exact >> 28) + 1;
+}
+
+// v3_normalize against the division in doubles, rounded toward zero after a 2^-28 relative error
+static bool bench_normalize_in_bounds(v3 v, v3 r) {
+    f64 len = sqrt((f64)v.x * v.x + (f64)v.y * v.y + (f64)v.z * v.z);
+    if (len == 0.0) return r.x == 0 && r.y == 0 && r.z == 0;
+
+    fx  num[3] = {v.x, v.y, v.z}, got[3] = {r.x, r.y, r.z};
+    for (i32 k = 0; k < 3; k++) {
+        f64 exact = num[k] * (f64)(1 << FX_BITS) / len;
+        f64 err   = got[k] - exact;
+        f64 bound = (exact < 0 ? -exact : exact) / (1 << 28) + 1.0;
+        if (err > bound || err < -bound) return false;
+    }
+    return true;
+}
+
+// Batched math is checked bit for bit against the scalar functions before being timed
+static void bench_math_run(BenchCase c, BenchResult *result) {
+    handle mark = arena_mark(&ctx()->temp);
+    i32    n    = c.size;
+    v3soa  a    = v3soa_alloc(n, &ctx()->temp);
+    v3soa  b    = v3soa_alloc(n, &ctx()->temp);
+    v3soa  dst  = v3soa_alloc(n, &ctx()->temp);
+    fx    *dots = (fx *)alloc_temp(sizeof(fx) * n);
+    fx     s    = FX(3) + 77; // Scale, and the angle of BK_V3_ROTATE
+
+    u32 state     = 0x9E3779B9u;
+    fx *inputs[6] = {a.x, a.y, a.z, b.x, b.y, b.z};
+    for (i32 i = 0; i < n; i++) {
+        for (i32 k = 0; k < 6; k++) {
+            inputs[k][i] = bench_random(&state);
+        }
+    }
+    memset(dst.x, 0, sizeof(fx) * 3 * n);
+
+    // Depths are kept positive and away from 0, so most x / z fit in a q8
+    bench.verts     = (v3 *)alloc_temp(sizeof(v3) * n);
+    bench.projected = (v2 *)alloc_temp(sizeof(v2) * n);
+    for (i32 i = 0; i < n; i++) {
+        bench.verts[i] = (v3){.x = a.x[i], .y = a.y[i], .z = (a.z[i] & 0xFFFFFF) + FX(1) / 8};
+    }
+
+    bench_math(c.kind, dst, dots, a, b, s, n);
+    for (i32 i = 0; i < n; i++) {
+        v3 va  = {.x = a.x[i], .y = a.y[i], .z = a.z[i]};
+        v3 vb  = {.x = b.x[i], .y = b.y[i], .z = b.z[i]};
+        v3 got = {.x = dst.x[i], .y = dst.y[i], .z = dst.z[i]}, expected = got;
+
+        switch (c.kind) {
+        case BK_V3_ADD: expected = v3_add(va, vb); break;
+        case BK_V3_SUB: expected = v3_sub(va, vb); break;
+        case BK_V3_MUL: expected = v3_mul(va, vb); break;
+        case BK_V3_SCALE: expected = v3_mul(va, (v3){.x = s, .y = s, .z = s}); break;
+        case BK_V3_CROSS: expected = v3_cross(va, vb); break;
+        case BK_V3_ROTATE: {
+            expected = v3_rotate_xz(va, s);
+            if (!bench_rotate_in_bounds(va, expected, s))
+                FATAL("%s is outside its error bound at %d", result->name, i);
+            break;
+        }
+        case BK_V3_DOT: {
+            got      = (v3){.x = dots[i]};
+            expected = (v3){.x = v3_dot(va, vb)};
+            break;
+        }
+        case BK_V3_LENGTH: {
+            got      = (v3){.x = dots[i]};
+            expected = (v3){.x = v3_length(va)};
+            if (!bench_length_in_bounds(va, expected.x))
+                FATAL("%s is outside its error bound at %d", result->name, i);
+            break;
+        }
+        case BK_V3_NORMALIZE: {
+            expected = v3_normalize(va);
+            if (!bench_normalize_in_bounds(va, expected))
+                FATAL("%s is outside its error bound at %d", result->name, i);
+            break;
+        }
+        case BK_SINCOS: {
+            v2 sc      = q8_sincos(va.x);
+            expected.x = sc.x;
+            expected.y = sc.y;
+            break;
+        }
+        case BK_PROJECT: {
+            v2 p     = v3_project(bench.verts[i]);
+            got      = (v3){.x = bench.projected[i].x, .y = bench.projected[i].y};
+            expected = (v3){.x = p.x, .y = p.y};
+            if (!bench_project_in_bounds(bench.verts[i], p))
+                FATAL("%s is outside its error bound at %d", result->name, i);
+            break;
+        }
+        default: break;
+        }
+
+        if (got.x != expected.x || got.y != expected.y || got.z != expected.z)
+            FATAL("%s differs from the scalar version at %d", result->name, i);
+    }
+
+    // dst is one allocation, x then y then z
+    u32 *out       = (u32 *)dst.x;
+    i32  out_len   = 3 * n;
+    u64  bytes_per = 3 * sizeof(v3);
+    switch (c.kind) {
+    case BK_V3_SCALE:
+    case BK_V3_ROTATE:
+    case BK_V3_NORMALIZE: bytes_per = 2 * sizeof(v3); break;
+    case BK_V3_DOT: {
+        out       = (u32 *)dots;
+        out_len   = n;
+        bytes_per = 2 * sizeof(v3) + sizeof(fx);
+        break;
+    }
+    case BK_V3_LENGTH: {
+        out       = (u32 *)dots;
+        out_len   = n;
+        bytes_per = sizeof(v3) + sizeof(fx);
+        break;
+    }
+    case BK_SINCOS: {
+        out_len   = 2 * n;
+        bytes_per = 3 * sizeof(q8);
+        break;
+    }
+    case BK_PROJECT: {
+        out       = (u32 *)bench.projected;
+        out_len   = 2 * n;
+        bytes_per = sizeof(v3) + sizeof(v2);
+        break;
+    }
+    default: break;
+    }
+    result->checksum = bench_hash(out, out_len, 0);
+    result->items    = (u64)n * c.count;
+    result->bytes    = result->items * bytes_per;
+
+    RepProfiler rep = repprofiler_new(result->name, bench.repeats);
+    while (rep.repeats < rep.maxRepeats) {
+        rep_begin(&rep);
+        for (i32 i = 0; i < c.count; i++) {
+            bench_math(c.kind, dst, dots, a, b, s, n);
+        }
+        rep_add_bytes(&rep, result->bytes);
+        rep_end(&rep);
+    }
+    arena_reset(&ctx()->temp, mark);
+
+    bench_finish(&rep, result);
+}
+
+// Rects of 8 to 39 pixels spread over a square world sized for the same density at every count,
+// each moving a few pixels per step and bouncing off the edges
+static void bench_scene_step(rect *rects, v2 *vel, i32 n, q8 world) {
+    for (i32 i = 0; i < n; i++) {
+        rect *r = &rects[i];
+        r->x += vel[i].x;
+        r->y += vel[i].y;
+        if (r->x < 0 || r->x + r->w > world) vel[i].x = -vel[i].x;
+        if (r->y < 0 || r->y + r->h > world) vel[i].y = -vel[i].y;
+    }
+}
+
+static i32 bench_brute_pairs(rect *rects, i32 n, v2i **pairs) {
+    i32 count = 0;
+    *pairs    = (v2i *)((u8 *)ctx()->temp.data + ctx()->temp.used);
+    for (i32 i = 0; i < n; i++) {
+        for (i32 j = i + 1; j < n; j++) {
+            if (!col_rect_rect(rects[i], rects[j])) continue;
+            *(v2i *)alloc_temp(sizeof(v2i)) = (v2i){.from = i, .to = j};
+            count++;
+        }
+    }
+    return count;
+}
+
+static int bench_pair_order(const void *a, const void *b) {
+    const v2i *pa = a, *pb = b;
+    if (pa->from != pb->from) return pa->from < pb->from ? -1 : 1;
+    return pa->to < pb->to ? -1 : pa->to > pb->to;
+}
+
+// The grid's pairs, sorted, have to be exactly the brute force ones. Returns their hash.
+static u64 bench_grid_check(Grid *g, rect *rects, i32 n, cstr name) {
+    handle mark = arena_mark(&ctx()->temp);
+    v2i   *got, *expected;
+    i32    got_len      = grid_pairs(g, &ctx()->temp, &got);
+    i32    expected_len = bench_brute_pairs(rects, n, &expected);
+    qsort(got, got_len, sizeof(v2i), bench_pair_order);
+
+    if (got_len != expected_len)
+        FATAL("%s found %d pairs instead of %d", name, got_len, expected_len);
+    for (i32 i = 0; i < got_len; i++) {
+        if (got[i].from != expected[i].from || got[i].to != expected[i].to)
+            FATAL("%s differs from brute force at pair %d", name, i);
+    }
+
+    u64 result = bench_hash((u32 *)got, got_len * 2, 0);
+    arena_reset(&ctx()->temp, mark);
+    return result;
+}
+
+static void bench_scene(rect *rects, v2 *vel, i32 n, q8 world) {
+    u32 state = 0x2545F491u;
+    for (i32 i = 0; i < n; i++) {
+        u32 bits = (u32)bench_random(&state);
+        q8  size = Q8(8 + (bits & 31));
+        rects[i] = (rect){(q8)((bits >> 5) % (u32)(world - size)),
+                          (q8)((u32)bench_random(&state) % (u32)(world - size)), size, size};
+        vel[i]   = (v2){(q8)(bits >> 20 & 0x3FF) - 0x200, (q8)(bits >> 10 & 0x3FF) - 0x200};
+    }
+}
+
+static void bench_grid_run(BenchCase c, BenchResult *result) {
+    handle mark  = arena_mark(&ctx()->temp);
+    i32    n     = c.size;
+    q8     world = Q8(64) * (i32)sqrt(n);
+    rect  *rects = (rect *)alloc_temp(sizeof(rect) * n);
+    v2    *vel   = (v2 *)alloc_temp(sizeof(v2) * n);
+    bench_scene(rects, vel, n, world);
+
+    // Cells of 64 pixels, so a rect covers at most four of them
+    Grid g = grid_new(n, 4 * n, Q8(64), &ctx()->temp);
+    for (i32 i = 0; i < n; i++) {
+        grid_insert(&g, rects[i]);
+    }
+    result->checksum = bench_grid_check(&g, rects, n, result->name);
+    result->items    = (u64)n * c.count;
+    result->bytes    = result->items * sizeof(rect);
+
+    handle      frame_mark = arena_mark(&ctx()->temp);
+    RepProfiler rep        = repprofiler_new(result->name, bench.repeats);
+    while (rep.repeats < rep.maxRepeats) {
+        rep_begin(&rep);
+        for (i32 k = 0; k < c.count; k++) {
+            v2i *pairs;
+            bench_scene_step(rects, vel, n, world);
+            if (c.kind == BK_GRID_PAIRS) {
+                for (i32 i = 0; i < n; i++) {
+                    grid_move(&g, i, rects[i]);
+                }
+                grid_pairs(&g, &ctx()->temp, &pairs);
+            } else {
+                bench_brute_pairs(rects, n, &pairs);
+            }
+            arena_reset(&ctx()->temp, frame_mark);
+        }
+        rep_add_bytes(&rep, result->bytes);
+        rep_end(&rep);
+    }
+
+    // Moves relinked and freed cells all through the run, the grid has to still agree
+    if (c.kind == BK_GRID_PAIRS) bench_grid_check(&g, rects, n, result->name);
+    arena_reset(&ctx()->temp, mark);
+
+    bench_finish(&rep, result);
+}
+
+// What the batched tests replace, one col_rect_rect per AoS rect
+static void bench_col_loop(rect r, rect *rects, i32 n, u32 *mask) {
+    memset(mask, 0, sizeof(u32) * ((n + 31) / 32));
+    for (i32 i = 0; i < n; i++) {
+        mask[i / 32] |= (u32)col_rect_rect(r, rects[i]) << (i % 32);
+    }
+}
+
+static void bench_col(BenchKind kind, i32 q, rect *rects, rectsoa rs, i32 n, u32 *mask,
+                      i32 *hits) {
+    rect r = rects[(u32)q * 7919u % (u32)n];
+    switch (kind) {
+    case BK_COL_LOOP: bench_col_loop(r, rects, n, mask); break;
+    case BK_COL_RECTS: col_rect_rects(r, rs, n, mask); break;
+    case BK_COL_HITS: col_rect_rects_hits(r, rs, n, hits); break;
+    case BK_COL_POINTS: {
+        v2 p = {r.x + r.w / 2, r.y + r.h / 2};
+        col_point_rects_hits(p, rs, n, hits);
+        break;
+    }
+    default: break;
+    }
+}
+
+// Every query is one of the scene's rects, or its center for the point case, tested against all
+// of them. Masks and hit lists have to match the scalar tests exactly.
+static void bench_col_run(BenchCase c, BenchResult *result) {
+    handle  mark  = arena_mark(&ctx()->temp);
+    i32     n     = c.size;
+    q8      world = Q8(64) * (i32)sqrt(n);
+    rect   *rects = (rect *)alloc_temp(sizeof(rect) * n);
+    v2     *vel   = (v2 *)alloc_temp(sizeof(v2) * n);
+    rectsoa rs    = rectsoa_alloc(n, &ctx()->temp);
+    i32     words = (n + 31) / 32;
+    u32    *mask  = (u32 *)alloc_temp(sizeof(u32) * words);
+    i32    *hits  = (i32 *)alloc_temp(sizeof(i32) * n);
+    bench_scene(rects, vel, n, world);
+    for (i32 i = 0; i < n; i++) {
+        rectsoa_set(rs, i, rects[i]);
+    }
+
+    u64 hash = 0;
+    for (i32 q = 0; q < c.count; q++) {
+        rect r      = rects[(u32)q * 7919u % (u32)n];
+        v2   p      = {r.x + r.w / 2, r.y + r.h / 2};
+        bool points = c.kind == BK_COL_POINTS;
+
+        i32 hits_len = points ? col_point_rects_hits(p, rs, n, hits)
+                              : col_rect_rects_hits(r, rs, n, hits);
+        if (points) {
+            col_point_rects(p, rs, n, mask);
+        } else {
+            col_rect_rects(r, rs, n, mask);
+        }
+
+        i32 expected = 0;
+        for (i32 i = 0; i < n; i++) {
+            bool hit = points ? col_point_rect(p, rects[i]) : col_rect_rect(r, rects[i]);
+            if (hit != ((mask[i / 32] >> (i % 32)) & 1))
+                FATAL("%s mask differs from the scalar test at query %d, rect %d", result->name,
+                      q, i);
+            if (!hit) continue;
+            if (expected >= hits_len || hits[expected] != i)
+                FATAL("%s hits differ from the scalar test at query %d, rect %d", result->name, q,
+                      i);
+            expected++;
+        }
+        if (expected != hits_len)
+            FATAL("%s found %d hits instead of %d at query %d", result->name, hits_len, expected,
+                  q);
+        hash = bench_hash(mask, words, hash);
+    }
+    result->checksum = hash;
+    result->items    = (u64)n * c.count;
+    result->bytes    = result->items * sizeof(rect);
+
+    RepProfiler rep = repprofiler_new(result->name, bench.repeats);
+    while (rep.repeats < rep.maxRepeats) {
+        rep_begin(&rep);
+        for (i32 q = 0; q < c.count; q++) {
+            bench_col(c.kind, q, rects, rs, n, mask, hits);
+        }
+        rep_add_bytes(&rep, result->bytes);
+        rep_end(&rep);
+    }
+    arena_reset(&ctx()->temp, mark);
+
+    bench_finish(&rep, result);
+}
+
+// A 16x16 tile region, partly off the map near the edges
+static i32rect bench_tile_region(i32 q, i32 side) {
+    i32 x = (i32)((u32)q * 7919u % (u32)side) - 8;
+    i32 y = (i32)((u32)q * 104729u % (u32)side) - 8;
+    return (i32rect){x, y, 16, 16};
+}
+
+// A rect a bit smaller than a tile, moving up to four tiles along each axis
+static void bench_tile_move(i32 q, Tilemap *tm, rect *r, v2 *delta) {
+    i32rect region = bench_tile_region(q, tm->size.w);
+    u32     bits   = (u32)q * 2654435761u, more = (u32)q * 0x85EBCA6Bu;
+    *r             = (rect){Q8(region.x + 8) * 32 + (q8)(bits & 0x1FFF), Q8(region.y + 8) * 32,
+                            tm->tile_size - Q8(8), tm->tile_size - Q8(8)};
+    *delta         = (v2){(q8)(bits >> 16) - 0x8000, (q8)(more >> 16) - 0x8000};
+}
+
+// What Tilemap replaces, a row pointer per tile row and a solid table lookup per tile
+static i32 bench_rows_count(u8 **rows, bool *solid_ids, i32 side, i32rect t) {
+    i32 x0 = t.x > 0 ? t.x : 0, x1 = t.x + t.w < side ? t.x + t.w : side;
+    i32 y0 = t.y > 0 ? t.y : 0, y1 = t.y + t.h < side ? t.y + t.h : side;
+    i32 result = 0;
+    for (i32 y = y0; y < y1; y++) {
+        for (i32 x = x0; x < x1; x++) {
+            result += solid_ids[rows[y][x]];
+        }
+    }
+    return result;
+}
+
+// tilemap_sweep a tile at a time through tilemap_solid, for checking the bitmask scans
+static TileSweep bench_sweep_ref(Tilemap *tm, rect r, v2 delta) {
+    TileSweep result = {.r = r};
+    i32       shift  = tm->tile_shift;
+
+    if (delta.x) {
+        i32 step = delta.x > 0 ? 1 : -1;
+        i32 from = delta.x > 0 ? ((r.x + r.w - 1) >> shift) + 1 : (r.x >> shift) - 1;
+        i32 to   = delta.x > 0 ? (r.x + r.w - 1 + delta.x) >> shift : (r.x + delta.x) >> shift;
+        result.r.x += delta.x;
+        for (i32 col = from; col * step <= to * step && !result.hit_x; col += step) {
+            for (i32 y = r.y >> shift; y <= (r.y + r.h - 1) >> shift; y++) {
+                if (!tilemap_solid(tm, col, y)) continue;
+                result.hit_x = true;
+                result.r.x   = delta.x > 0 ? (col << shift) - r.w : (col + 1) << shift;
+                break;
+            }
+        }
+    }
+
+    r = result.r;
+    if (delta.y) {
+        i32 step = delta.y > 0 ? 1 : -1;
+        i32 from = delta.y > 0 ? ((r.y + r.h - 1) >> shift) + 1 : (r.y >> shift) - 1;
+        i32 to   = delta.y > 0 ? (r.y + r.h - 1 + delta.y) >> shift : (r.y + delta.y) >> shift;
+        result.r.y += delta.y;
+        for (i32 row = from; row * step <= to * step && !result.hit_y; row += step) {
+            for (i32 x = r.x >> shift; x <= (r.x + r.w - 1) >> shift; x++) {
+                if (!tilemap_solid(tm, x, row)) continue;
+                result.hit_y = true;
+                result.r.y   = delta.y > 0 ? (row << shift) - r.h : (row + 1) << shift;
+                break;
+            }
+        }
+    }
+    return result;
+}
+
+// One tile in eight is solid, both as a Tilemap and as the row pointers it replaces. Region counts
+// and sweeps have to match a tile at a time reference before they are timed.
+static void bench_tile_run(BenchCase c, BenchResult *result) {
+    handle  mark     = arena_mark(&ctx()->temp);
+    i32     side     = c.size;
+    Tilemap tm       = tilemap_new((v2i){side, side}, Q8(32), &ctx()->temp);
+    u8    **rows     = (u8 **)alloc_temp(sizeof(u8 *) * side);
+    bool    solid[8] = {[7] = true};
+    u32     state    = 0x9E3779B9u;
+    tilemap_set_solid(&tm, 7, true);
+    for (i32 y = 0; y < side; y++) {
+        rows[y] = (u8 *)alloc_temp(side);
+        for (i32 x = 0; x < side; x++) {
+            rows[y][x] = (u8)(bench_random(&state) & 7);
+            tilemap_set(&tm, x, y, rows[y][x]);
+        }
+    }
+
+    u64 hash = 0;
+    for (i32 q = 0; q < c.count; q++) {
+        u32 out[6];
+        if (c.kind == BK_TILE_SWEEP) {
+            rect r;
+            v2   delta;
+            bench_tile_move(q, &tm, &r, &delta);
+            TileSweep got = tilemap_sweep(&tm, r, delta), expected = bench_sweep_ref(&tm, r, delta);
+            if (got.r.x != expected.r.x || got.r.y != expected.r.y ||
+                got.hit_x != expected.hit_x || got.hit_y != expected.hit_y)
+                FATAL("%s differs from the reference at query %d", result->name, q);
+            out[0] = got.r.x;
+            out[1] = got.r.y;
+            out[2] = got.hit_x | got.hit_y << 1;
+        } else {
+            i32rect t        = bench_tile_region(q, side);
+            i32     expected = 0;
+            for (i32 y = t.y; y < t.y + t.h; y++) {
+                for (i32 x = t.x; x < t.x + t.w; x++) {
+                    expected += tilemap_solid(&tm, x, y);
+                }
+            }
+            i32 got = c.kind == BK_TILE_ROWS ? bench_rows_count(rows, solid, side, t)
+                                             : tilemap_region_count(&tm, t);
+            if (got != expected)
+                FATAL("%s counted %d solid tiles instead of %d at query %d", result->name, got,
+                      expected, q);
+            out[0] = got;
+        }
+        hash = bench_hash(out, c.kind == BK_TILE_SWEEP ? 3 : 1, hash);
+    }
+    result->checksum = hash;
+    result->items    = c.count;
+    result->bytes    = c.kind == BK_TILE_ROWS ? result->items * 16 * 16 : result->items * 16 * 4;
+
+    i32         sink = 0;
+    RepProfiler rep  = repprofiler_new(result->name, bench.repeats);
+    while (rep.repeats < rep.maxRepeats) {
+        rep_begin(&rep);
+        for (i32 q = 0; q < c.count; q++) {
+            if (c.kind == BK_TILE_SWEEP) {
+                rect r;
+                v2   delta;
+                bench_tile_move(q, &tm, &r, &delta);
+                sink += tilemap_sweep(&tm, r, delta).r.x;
+            } else if (c.kind == BK_TILE_ROWS) {
+                sink += bench_rows_count(rows, solid, side, bench_tile_region(q, side));
+            } else {
+                sink += tilemap_region_count(&tm, bench_tile_region(q, side));
+            }
+        }
+        rep_add_bytes(&rep, result->bytes);
+        rep_end(&rep);
+    }
+    bench.sink += sink;
+    arena_reset(&ctx()->temp, mark);
+
+    bench_finish(&rep, result);
+}
+
+#define BENCH_TMAP "handmade_bench.tmap"
+
+// A 1080p view panning diagonally at 16 pixels per frame, streaming the map through 64 chunk slots
+static rect bench_stream_view(i32 frame, v2 *motion) {
+    *motion = (v2){Q8(16), Q8(8)};
+    return (rect){Q8(1024) + motion->x * frame, Q8(1024) + motion->y * frame, Q8(1920), Q8(1080)};
+}
+
+// Every frame's view has to read the same tiles as the map that was saved
+static void bench_stream_run(BenchCase c, BenchResult *result) {
+    handle  mark  = arena_mark(&ctx()->temp);
+    i32     side  = c.size;
+    Tilemap src   = tilemap_new((v2i){side, side}, Q8(32), &ctx()->temp);
+    u32     state = 0x9E3779B9u;
+    tilemap_set_solid(&src, 7, true);
+    for (i32 y = 0; y < side; y++) {
+        for (i32 x = 0; x < side; x++) {
+            tilemap_set(&src, x, y, (u8)(bench_random(&state) & 7));
+        }
+    }
+    if (!tilemap_save(&src, BENCH_TMAP)) FATAL("Couldn't write %s", BENCH_TMAP);
+
+    TileStream stream;
+    if (!tilestream_open(&stream, BENCH_TMAP, 64, &ctx()->temp))
+        FATAL("Couldn't open %s", BENCH_TMAP);
+
+    u64 hash = 0;
+    for (i32 frame = 0; frame < c.count; frame++) {
+        v2   motion;
+        rect view = bench_stream_view(frame, &motion);
+        tilestream_update(&stream, view, motion);
+
+        i32rect t = tilemap_tiles(&stream.map, view);
+        for (i32 y = t.y; y < t.y + t.h; y++) {
+            for (i32 x = t.x; x < t.x + t.w; x++) {
+                if (tilemap_get(&stream.map, x, y) != tilemap_get(&src, x, y) ||
+                    tilemap_solid(&stream.map, x, y) != tilemap_solid(&src, x, y))
+                    FATAL("%s read a wrong tile at %d, %d on frame %d", result->name, x, y, frame);
+            }
+        }
+        i32 solid = tilemap_region_count(&stream.map, t);
+        hash      = bench_hash((u32 *)&solid, 1, hash);
+    }
+    result->checksum = hash;
+    result->items    = c.count;
+    result->bytes    = (u64)stream.loads * TILE_CHUNK * TILE_CHUNK;
+    INFO("%s: %d chunk loads, %d of them not prefetched, and %d evictions in %d frames",
+         result->name, stream.loads, stream.misses, stream.evictions, c.count);
+    tilestream_close(&stream);
+
+    // Every repetition starts cold, from a freshly opened file
+    RepProfiler rep = repprofiler_new(result->name, bench.repeats);
+    while (rep.repeats < rep.maxRepeats) {
+        handle open_mark = arena_mark(&ctx()->temp);
+        tilestream_open(&stream, BENCH_TMAP, 64, &ctx()->temp);
+
+        rep_begin(&rep);
+        for (i32 frame = 0; frame < c.count; frame++) {
+            v2   motion;
+            rect view = bench_stream_view(frame, &motion);
+            tilestream_update(&stream, view, motion);
+        }
+        rep_add_bytes(&rep, result->bytes);
+        rep_end(&rep);
+
+        tilestream_close(&stream);
+        arena_reset(&ctx()->temp, open_mark);
+    }
+    remove(BENCH_TMAP);
+    arena_reset(&ctx()->temp, mark);
+
+    bench_finish(&rep, result);
+}
+
+// A camera panning right by 3 and a third pixels per frame, and down by one
+static v2 bench_cache_camera(i32 frame) {
+    return (v2){Q8(frame * 3) + Q8(1) / 3 * frame, Q8(frame)};
+}
+
+// Every frame has to match the same layer drawn from scratch. Id 3 is transparent with an odd
+// frame count, so both ways of compositing are covered.
+static void bench_cache_run(BenchCase c, BenchResult *result) {
+    handle    mark      = arena_mark(&ctx()->temp);
+    i32       pixels    = G->screen_size.w * G->screen_size.h;
+    col32     colors[4] = {rgb(200, 40, 40), rgb(40, 200, 40), rgb(40, 40, 200), rgb(40, 40, 40)};
+    TileLayer layer     = {&bench.tiles, colors, 4 - (c.count & 1), Q8(1), true};
+    TileCache cache     = tile_cache_new(layer, &ctx()->temp);
+    u32      *expected  = ALLOC_ARRAY(u32, pixels);
+    bench_tilemap(c.size);
+
+    u64 hash = 0;
+    for (i32 frame = 0; frame < c.count; frame++) {
+        handle frame_mark = arena_mark(&ctx()->temp);
+        // A new tile every 60 frames forces a full redraw
+        if (frame % 60 == 59) tilemap_set(&bench.tiles, frame, frame, (u8)(frame & 3));
+
+        bench_clear();
+        G->draw_count = 0;
+        draw_tiles(&layer, bench_cache_camera(frame));
+        render_draw_queue();
+        memcpy(expected, G->screen_buf, sizeof(u32) * pixels);
+
+        bench_clear();
+        G->draw_count = 0;
+        draw_tile_cache(&cache, bench_cache_camera(frame));
+        render_draw_queue();
+        if (memcmp(expected, G->screen_buf, sizeof(u32) * pixels) != 0)
+            FATAL("%s differs from the uncached layer on frame %d", result->name, frame);
+
+        hash = bench_hash(G->screen_buf, pixels, hash);
+        arena_reset(&ctx()->temp, frame_mark);
+    }
+    result->checksum = hash;
+    result->items    = (u64)pixels * c.count;
+    result->bytes    = result->items * sizeof(col32);
+    INFO("%s: %d full redraws and %d scrolls in %d frames, %s", result->name, cache.redraws,
+         cache.strips, c.count, cache.opaque ? "opaque" : "transparent");
+
+    RepProfiler rep = repprofiler_new(result->name, bench.repeats);
+    while (rep.repeats < rep.maxRepeats) {
+        handle frame_mark = arena_mark(&ctx()->temp);
+        tile_cache_invalidate(&cache);
+
+        rep_begin(&rep);
+        for (i32 frame = 0; frame < c.count; frame++) {
+            G->draw_count = 0;
+            draw_tile_cache(&cache, bench_cache_camera(frame));
+            render_draw_queue();
+            arena_reset(&ctx()->temp, frame_mark);
+        }
+        rep_add_bytes(&rep, result->bytes);
+        rep_end(&rep);
+    }
+    arena_reset(&ctx()->temp, mark);
+
+    bench_finish(&rep, result);
+}
+
+static bool bench_run(BenchCase c, BenchResult *result) {
+    v2i extent = bench_extent(c);
+    if (extent.w > G->screen_size.w || extent.h > G->screen_size.h) return false;
+
+    snprintf(result->name, sizeof(result->name), "%s/%dx%d", bench_kind_names[c.kind], c.size,
+             c.count);
+    if (bench.filter && !strstr(result->name, bench.filter)) return false;
+
+    if (c.kind == BK_TILE_CACHE) {
+        bench_cache_run(c, result);
+        return true;
+    }
+    if (c.kind == BK_TILE_STREAM) {
+        bench_stream_run(c, result);
+        return true;
+    }
+    if (c.kind >= BK_TILE_ROWS) {
+        bench_tile_run(c, result);
+        return true;
+    }
+    if (c.kind >= BK_COL_LOOP) {
+        bench_col_run(c, result);
+        return true;
+    }
+    if (c.kind >= BK_GRID_PAIRS) {
+        bench_grid_run(c, result);
+        return true;
+    }
+    if (c.kind >= BK_V3_ADD) {
+        bench_math_run(c, result);
+        return true;
+    }
+
+    handle mark = arena_mark(&ctx()->temp);
+    if (c.kind == BK_TEXT) {
+        bench.strings = (char **)alloc_temp(sizeof(char *) * 4);
+        for (i32 i = 0; i < 4; i++) {
+            bench.strings[i] = (char *)alloc_temp(c.size + 1);
+            for (i32 k = 0; k < c.size; k++) {
+                i32 ch              = FONT_FIRST + 1 + (i * 31 + k) % (FONT_LAST - FONT_FIRST);
+                bench.strings[i][k] = (char)ch;
+            }
+            bench.strings[i][c.size] = 0;
+        }
+    }
+    if (c.kind == BK_MESH) bench_ring(c.size);
+    if (c.kind == BK_TILES) bench_tilemap(c.size);
+    handle frame_mark = arena_mark(&ctx()->temp);
+
+    // Pixels written, counted once per distinct shape on an empty buffer. Overlapping instances
+    // still count in full, since the kernel writes them again.
+    u64 shape_pixels = 0;
+    for (i32 i = 0; i < 4; i++) {
+        bench_clear();
+        bench_draw(c, i, WHITE);
+        shape_pixels += bench_count_pixels(WHITE);
+        arena_reset(&ctx()->temp, frame_mark);
+    }
+    result->items = shape_pixels * c.count / 4;
+    result->bytes = result->items * sizeof(col32);
+
+    // Reference output, colors vary per instance so ordering changes show up in the hash
+    bench_clear();
+    for (i32 i = 0; i < c.count; i++) {
+        bench_draw(c, i, rgb((i * 37) & 0xFF, (i * 101) & 0xFF, (i * 211) & 0xFF));
+        arena_reset(&ctx()->temp, frame_mark);
+    }
+    result->checksum = bench_hash(G->screen_buf, G->screen_size.w * G->screen_size.h, 0);
+
+    RepProfiler rep = repprofiler_new(result->name, bench.repeats);
+    while (rep.repeats < rep.maxRepeats) {
+        rep_begin(&rep);
+        for (i32 i = 0; i < c.count; i++) {
+            bench_draw(c, i, WHITE);
+        }
+        rep_add_bytes(&rep, result->bytes);
+        rep_end(&rep);
+        arena_reset(&ctx()->temp, frame_mark);
+    }
+    arena_reset(&ctx()->temp, mark);
+
+    bench_finish(&rep, result);
+    return true;
+}
+
+// Compares against a file written with --out. Returns the number of cases that got slower than
+// the threshold or changed their output.
+static i32 bench_compare(cstr path, BenchResult *results, i32 results_len, f64 threshold) {
+    string baseline = file_read((char *)path);
+    if (!baseline.text) {
+        ERR("Couldn't read baseline %s", path);
+        return 1;
+    }
+
+    INFO("Comparing against %s, threshold %.1f%%", path, threshold);
+    printf("\t%-26s %10s %10s %8s\n", "case", "base ms", "new ms", "delta");
+
+    i32   regressions = 0;
+    char *line        = (char *)baseline.text;
+    while (line && *line) {
+        char *next = strchr(line, '\n');
+        if (next) *next++ = 0;
+
+        char name[32] = {0};
+        u64  items = 0, checksum = 0;
+        f64  min_ms = 0;
+        if (line[0] == '#' ||
+            sscanf(line, "%31s %lu %lf %*f %*f %*f %lx", name, &items, &min_ms, &checksum) < 4) {
+            line = next;
+            continue;
+        }
+
+        for (i32 i = 0; i < results_len; i++) {
+            BenchResult *r = &results[i];
+            if (strcmp(r->name, name) != 0) continue;
+
+            f64  delta   = (r->min_ms - min_ms) / min_ms * 100.0;
+            bool slower  = delta > threshold;
+            bool changed = r->checksum != checksum;
+            printf("\t%-26s %10.3f %10.3f %+7.1f%%%s%s\n", name, min_ms, r->min_ms, delta,
+                   slower ? "  SLOWER" : delta < -threshold ? "  faster" : "",
+                   changed ? "  OUTPUT CHANGED" : "");
+            regressions += slower || changed;
+        }
+        line = next;
+    }
+
+    return regressions;
+}
+
+static void usage(cstr exe) {
+    printf("Usage: %s [--repeats N] [--size WxH] [--filter text] [--out results.tsv] "
+           "[--baseline results.tsv] [--threshold percent] [--verbose] [--hw-counters]\n",
+           exe);
+}
+
+i32 main(i32 argc, char **argv) {
+    v2i  screen_size = {.w = 1280, .h = 720};
+    cstr out_path = NULL, baseline_path = NULL;
+    f64  threshold   = 5.0;
+    bool hw_counters = false;
+
+    bench.repeats = 30;
+    for (i32 i = 1; i < argc; i++) {
+        cstr arg  = argv[i];
+        bool more = i + 1 < argc;
+        if (strcmp(arg, "--repeats") == 0 && more) {
+            bench.repeats = atoi(argv[++i]);
+        } else if (strcmp(arg, "--size") == 0 && more) {
+            sscanf(argv[++i], "%dx%d", &screen_size.w, &screen_size.h);
+        } else if (strcmp(arg, "--filter") == 0 && more) {
+            bench.filter = argv[++i];
+        } else if (strcmp(arg, "--out") == 0 && more) {
+            out_path = argv[++i];
+        } else if (strcmp(arg, "--baseline") == 0 && more) {
+            baseline_path = argv[++i];
+        } else if (strcmp(arg, "--threshold") == 0 && more) {
+            threshold = atof(argv[++i]);
+        } else if (strcmp(arg, "--verbose") == 0) {
+            bench.verbose = true;
+        } else if (strcmp(arg, "--hw-counters") == 0) {
+            hw_counters = true;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    {
+        Arena perm = arena_new(MB(128), NULL);
+
+        G  = (EngineData *)alloc(sizeof(EngineData), &perm);
+        *G = (EngineData){
+            .ctx =
+                {
+                    .perm = perm,
+                },
+            .screen_size = screen_size,
+            .metrics     = metrics_init(),
+            .system_info = systeminfo_init(),
+            .profiler    = profiler_new("Handmade Renderer (bench)"),
+        };
+        ctx()->temp   = arena_new(MB(80), &ctx()->perm);
+        G->screen_buf = ALLOC_ARRAY(u32, G->screen_size.w * G->screen_size.h);
+        G->draw_size  = 16; // BK_TILES goes through the queue
+        G->draw_queue = ALLOC_ARRAY(DrawCmd, G->draw_size);
+    }
+    if (hw_counters) profiler_enable_hw_counters();
+
+    i32          cases_len   = sizeof(bench_cases) / sizeof(bench_cases[0]);
+    BenchResult *results     = ALLOC_ARRAY(BenchResult, cases_len);
+    i32          results_len = 0;
+
+    INFO("%d repeats at %dx%d, best time of each case, fx is %d.%d", bench.repeats,
+         G->screen_size.w, G->screen_size.h, 31 - FX_BITS, FX_BITS);
+    printf("\t%-26s %10s %10s %10s %8s %10s\n", "case", "min ms", "avg ms", "Mitems/s", "GB/s",
+           "items");
+    for (i32 i = 0; i < cases_len; i++) {
+        BenchResult *r = &results[results_len];
+        if (!bench_run(bench_cases[i], r)) continue;
+        results_len++;
+
+        printf("\t%-26s %10.3f %10.3f %10.1f %8.3f %10lu\n", r->name, r->min_ms, r->avg_ms,
+               r->mitems_s, r->gb_s, r->items);
+    }
+
+    if (out_path) {
+        FILE *file = fopen(out_path, "w");
+        if (!file) FATAL("Couldn't open %s", out_path);
+
+        fprintf(file, "# %s %s, %dx%d, %d repeats\n", G->system_info.osName,
+                G->system_info.processorArchitecture, G->screen_size.w, G->screen_size.h,
+                bench.repeats);
+        fprintf(file, "# case\titems\tmin_ms\tavg_ms\tmitems_s\tgb_s\tchecksum\n");
+        for (i32 i = 0; i < results_len; i++) {
+            BenchResult *r = &results[i];
+            fprintf(file, "%s\t%lu\t%.4f\t%.4f\t%.2f\t%.4f\t%016lx\n", r->name, r->items,
+                    r->min_ms, r->avg_ms, r->mitems_s, r->gb_s, r->checksum);
+        }
+        fclose(file);
+        INFO("Wrote %d results to %s", results_len, out_path);
+    }
+
+    i32 regressions = 0;
+    if (baseline_path) regressions = bench_compare(baseline_path, results, results_len, threshold);
+
+    profiler_end();
+    return regressions ? 2 : 0;
+}
@@ -0,0 +1,2083 @@
+#pragma once
+
+// Platform independent part of the engine: draw queue, software rasterizer and GUI. Each platform
+// layer defines GameDLL and Platform, then includes this file.
+
+typedef enum {
+    DCT_RECT,
+    DCT_RECT_OUTLINE,
+    DCT_TEXT,
+    DCT_LINE,
+    DCT_MESH,
+    DCT_TILES,
+    DCT_LAYER,
+    DCT_COUNT
+} DrawCmdType;
+
+typedef struct {
+    DrawCmdType t;
+    col32       color;
+
+    union {
+        struct { // text
+            char *text;
+            i32   x, y;
+        };
+
+        struct { // rect
+            rect r;
+        };
+
+        struct { // line
+            v2 from, to;
+        };
+
+        struct { // mesh
+            v3  *vertices;
+            i32  count;
+            v2i *edges;
+            i32  edges_count;
+        };
+
+        struct { // tiles, a window of ids row by row, ids without a color are transparent
+            u8    *ids;
+            col32 *colors;
+            i32    colors_count, tile; // Tile side in pixels
+            v2i    window, corner;     // Window size in tiles, screen position of its first tile
+        };
+
+        struct { // layer, a TileCache seen from a pixel scroll position
+            struct TileCache *cache;
+            v2i               scroll;
+        };
+    };
+} DrawCmd;
+
+typedef enum {
+    IE_KEY_DOWN,
+    IE_KEY_UP,
+    IE_MOUSE_MOVE,
+} InputEventType;
+
+typedef struct {
+    u64            time; // ReadOSTimer when the platform got it
+    InputEventType t;
+    Key            key; // Key events
+    v2             pos; // Mouse moves, in window pixels
+} InputEvent;
+
+#define INPUT_RING_SIZE 256 // A power of two
+
+// Single producer, single consumer: the platform layer pushes events as it gets them, the frame
+// takes them out, see input_push and input_begin_frame
+typedef struct {
+    InputEvent   events[INPUT_RING_SIZE];
+    volatile i32 head, tail; // Only ever written by the producer and the consumer respectively
+    i32          dropped;
+} InputRing;
+
+// Events in the order they came, copied out of the ring into the temp arena
+typedef struct {
+    InputEvent *events;
+    i32         count;
+    u64         time; // ReadOSTimer when the view was taken
+} InputView;
+
+// The parts of the screen that change from one frame to the next, see damage_update
+typedef struct {
+    i32      shift, cells_w, cells_h; // Cells of 2^shift pixels, at most 64 of them per row
+    u64     *hash, *prev;             // Per cell, of the commands over it this frame and the last
+    u64     *rows;                    // A bit per damaged cell
+    i32rect *rects;                   // The damaged cells merged into rects, in pixels
+    i32rect *bounds;                  // Of each queued command, in the temp arena
+    i32      rects_count, pixels;     // pixels is the area of all the rects
+    bool     valid;                   // prev holds a frame, otherwise everything is damaged
+} Damage;
+
+typedef struct {
+    Context ctx;
+    GameDLL game;
+    u8     *game_memory;
+
+    bool       shutdown;
+    bool       animating;   // The game asked for another frame, see keep_animating
+    f64        sim_time;    // Passed but not simulated yet, under a step, see game_frame
+    u64        sim_dropped; // Steps skipped by frames too far behind, reported by pacer_print
+    v2         mouse_pos;
+    KeyState   keys[K_COUNT];
+    InputRing  input_ring;
+    InputView  input;      // This frame's events, keys and mouse_pos already include them
+    InputView  input_late; // Came in while the frame was made, see input_latch
+    v2i        screen_size;
+    u32       *screen_buf;
+    DrawCmd   *draw_queue;
+    u32        draw_size, draw_count;
+    Damage     damage;
+    i32rect    clip; // Rasterizers only write inside it while set, see render_damage
+    Metrics    metrics;
+    SystemInfo system_info;
+    Profiler   profiler;
+    Platform   platform;
+
+    struct InputRecording *input_replay; // Input comes from it instead of the platform while set
+} EngineData;
+
+#ifdef ENGINE_IMPL
+static EngineData *G;
+#else
+import extern EngineData *G;
+#endif
+
+Context *ctx() { return &G->ctx; }
+
+static f64 now_seconds() { return (f64)ReadOSTimer() / (f64)GetOSTimerFreq(); }
+
+// Called from update while something moves on its own. A game with Info.idle set gets no frames
+// when it doesn't call it, until there's input or the window needs painting.
+void keep_animating() { G->animating = true; }
+
+static bool input_ring_push(InputEvent e) {
+    InputRing *r    = &G->input_ring;
+    i32        head = r->head;
+    if (head - read_acquire(&r->tail) == INPUT_RING_SIZE) {
+        r->dropped++;
+        return false;
+    }
+
+    r->events[head & (INPUT_RING_SIZE - 1)] = e;
+    write_release(&r->head, head + 1);
+    return true;
+}
+
+// Producer side, the platform layer's. Returns false and drops the event when the ring is full, or
+// while a recording is replayed.
+bool input_push(InputEvent e) { return !G->input_replay && input_ring_push(e); }
+
+static u64  input_replay_clock();
+static void input_replay_late();
+
+// Consumer side: copies what was pushed so far, taking it out of the ring when consume is set
+static InputView input_view(bool consume) {
+    InputRing *r    = &G->input_ring;
+    i32        tail = r->tail;
+    i32        head = read_acquire(&r->head);
+
+    InputView result = {
+        .events = (InputEvent *)alloc_temp(sizeof(InputEvent) * (head - tail)),
+        .count  = head - tail,
+        .time   = G->input_replay ? input_replay_clock() : ReadOSTimer(),
+    };
+    for (i32 i = 0; i < result.count; i++)
+        result.events[i] = r->events[(tail + i) & (INPUT_RING_SIZE - 1)];
+
+    if (consume) write_release(&r->tail, head);
+    return result;
+}
+
+// Call at the start of a frame, once the platform pushed what it had. Keys settle from the last
+// frame's presses and releases, then take this frame's events in order.
+void input_begin_frame() {
+    for (i32 i = 0; i < K_COUNT; i++) {
+        if (G->keys[i] == KS_JUST_RELEASED) G->keys[i] = KS_RELEASED;
+        if (G->keys[i] == KS_JUST_PRESSED) G->keys[i] = KS_PRESSED;
+    }
+
+    G->input      = input_view(true);
+    G->input_late = (InputView){0};
+    for (i32 i = 0; i < G->input.count; i++) {
+        InputEvent *e = &G->input.events[i];
+        switch (e->t) {
+        case IE_KEY_DOWN: G->keys[e->key] = KS_JUST_PRESSED; break;
+        case IE_KEY_UP: G->keys[e->key] = KS_JUST_RELEASED; break;
+        case IE_MOUSE_MOVE: G->mouse_pos = e->pos; break;
+        }
+    }
+}
+
+// How many times the key went down this frame, a press and release in one frame included
+i32 input_presses(Key key) {
+    i32 result = 0;
+    for (i32 i = 0; i < G->input.count; i++) {
+        InputEvent *e = &G->input.events[i];
+        result += e->t == IE_KEY_DOWN && e->key == key;
+    }
+    return result;
+}
+
+// Late latch, call right before rasterizing once the platform pushed what came in since the frame
+// started. The game's latch gets those events in input_late and can move what it queued, like
+// the camera, see draw_shift. They stay in the ring, the next frame gets them like any other.
+void input_latch() {
+    if (!G->game.latch) return;
+    if (G->input_replay) input_replay_late();
+    G->input_late = input_view(false);
+    G->game.latch();
+}
+
+#define SIM_MAX_STEPS 8 // Per frame, past that the game slows down instead of falling behind
+
+// Runs the game for a frame that took dt seconds. Games with Info.sim_hz get as many steps of
+// simulate as fit in the time that passed, then a render with how far into the next step the
+// frame is, to draw between the last two states. Other games get one update with dt.
+void game_frame(f64 dt) {
+    GameDLL *g = &G->game;
+    if (!g->info->sim_hz) {
+        g->update((q8)(dt * 256.0));
+        return;
+    }
+
+    f64 step = 1.0 / g->info->sim_hz;
+    G->sim_time += dt;
+    for (i32 i = 0; i < SIM_MAX_STEPS && G->sim_time >= step; i++) {
+        g->simulate((q16)(step * 65536.0));
+        G->sim_time -= step;
+    }
+
+    // A frame that can't keep up would have even more steps to run the next one. The time past
+    // the cap is dropped instead, only the fraction of a step is kept.
+    if (G->sim_time >= step) {
+        u64 behind = (u64)(G->sim_time / step);
+        G->sim_time -= (f64)behind * step;
+        G->sim_dropped += behind;
+    }
+
+    g->render((q16)(G->sim_time / step * 65536.0));
+}
+
+u64 ReadCPUTimer(void) {
+#if defined(__x86_64__) || defined(__amd64__) || defined(_M_X64) || defined(_M_AMD64) || \
+    defined(__i386__) || defined(_M_IX86)
+    // TCC doesn't support __rdtsc intrinsic; use inline asm instead
+    u32 lo = 0;
+    u32 hi = 0;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((u64)hi << 32) | lo;
+
+#elif defined(__aarch64__)
+    // ARMv8 (AArch64): use CNTVCT_EL0
+    u64 cnt = 0;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(cnt));
+    return cnt;
+
+#elif defined(__arm__)
+    // ARMv7-A: use PMCCNTR (if enabled)
+    u32 cc = 0;
+    __asm__ volatile("mrc p15, 0, %0, c9, c13, 0" : "=r"(cc));
+    return (u64)cc;
+
+#else
+    static_assert(false, "Unsupported architecture");
+    return 0;
+#endif
+}
+
+u64 EstimateCPUTimerFreq() {
+    u64 MillisecondsToWait = 100;
+
+    u64 OSFreq     = GetOSTimerFreq();
+    u64 CPUStart   = ReadCPUTimer();
+    u64 OSStart    = ReadOSTimer();
+    u64 OSElapsed  = 0;
+    u64 OSWaitTime = OSFreq * MillisecondsToWait / 1000;
+    while (OSElapsed < OSWaitTime) {
+        OSElapsed = ReadOSTimer() - OSStart;
+    }
+
+    u64 CPUEnd     = ReadCPUTimer();
+    u64 CPUElapsed = CPUEnd - CPUStart;
+
+    u64 CPUFreq = 0;
+    if (OSElapsed) {
+        CPUFreq = OSFreq * CPUElapsed / OSElapsed;
+    }
+
+    return CPUFreq;
+}
+
+// Frame pacing: sleeps most of the way to the next frame, then spins for the rest, since the OS
+// wakes threads up late by anything from a few microseconds to a scheduler tick. The spin margin
+// follows how late the sleeps have been lately. Jitter is how late each frame started, in OS timer
+// ticks like the rest of the profiler.
+#define PACER_MARGIN_MIN 0.0002 // Seconds always left to spin
+#define PACER_MARGIN_DECAY 0.98 // Per frame, the margin shrinks back after a late wake up
+
+typedef struct {
+    f64       period, next; // In seconds, next is when the coming frame should start
+    f64       margin;       // Left to spin after sleeping
+    f64       jitter_sum, jitter_max;
+    u64       frames, dropped; // dropped counts frames more than a period late
+    Histogram jitter;
+} Pacer;
+
+Pacer pacer_new(f64 period) {
+    return (Pacer){.period = period, .next = now_seconds(), .margin = PACER_MARGIN_MIN};
+}
+
+// Starts pacing over from now, for when the loop stopped on purpose, see WaitIdle
+void pacer_reset(Pacer *p) { p->next = now_seconds(); }
+
+// Returns once the next frame is due
+void pacer_wait(Pacer *p) {
+    p->next += p->period;
+
+    f64 now   = now_seconds();
+    f64 sleep = p->next - now - p->margin;
+    if (sleep > 0.0) {
+        os_sleep(sleep);
+
+        f64 woke   = now_seconds();
+        f64 late   = (woke - now) - sleep;
+        f64 margin = p->margin * PACER_MARGIN_DECAY;
+        if (late > margin) margin = late;
+        if (margin > p->period / 2) margin = p->period / 2;
+        p->margin = margin < PACER_MARGIN_MIN ? PACER_MARGIN_MIN : margin;
+        now       = woke;
+    }
+
+    while (now < p->next) {
+        _mm_pause();
+        now = now_seconds();
+    }
+
+    f64 jitter = now - p->next;
+    histogram_add(&p->jitter, (u64)(jitter * (f64)GetOSTimerFreq()));
+    p->jitter_sum += jitter;
+    if (jitter > p->jitter_max) p->jitter_max = jitter;
+    p->frames++;
+
+    // Too far behind to catch up, running frames back to back would only make it worse
+    if (jitter > p->period) {
+        p->dropped++;
+        p->next = now;
+    }
+}
+
+void pacer_print(Pacer *p) {
+    if (G->sim_dropped)
+        WARN("Simulation fell behind, %" U64_FMT " steps were skipped", G->sim_dropped);
+    if (!p->frames) return;
+    INFO("Paced %" U64_FMT " frames at %.2f ms: %.1f us average jitter, %.1f us worst, %" U64_FMT
+         " dropped",
+         p->frames, p->period * 1000.0, p->jitter_sum / p->frames * 1000000.0,
+         p->jitter_max * 1000000.0, p->dropped);
+
+    const f64 percentiles[] = {50.0, 90.0, 99.0, 99.9};
+    printf("\t> Percentile \tJitter\n");
+    for (i32 i = 0; i < 4; i++) {
+        // The histogram is clamped to the worst jitter it saw, in ticks. Clamping to jitter_max too
+        // keeps the rounding from printing a percentile above the worst reported above.
+        f64 jitter = (f64)histogram_percentile(&p->jitter, percentiles[i]) / (f64)GetOSTimerFreq();
+        if (jitter > p->jitter_max) jitter = p->jitter_max;
+        printf("\t> p%-5g \t%.1f us\n", percentiles[i], jitter * 1000000.0);
+    }
+}
+
+void draw_mesh(v3 *p, i32 count, v2i *e, i32 edges_count, col32 color) {
+    if (G->draw_count == G->draw_size) return;
+    G->draw_queue[G->draw_count++] = (DrawCmd){.t           = DCT_MESH,
+                                               .vertices    = p,
+                                               .count       = count,
+                                               .edges       = e,
+                                               .edges_count = edges_count,
+                                               .color       = color};
+}
+
+void draw_rect(rect r, col32 color) {
+    if (G->draw_count == G->draw_size) return;
+    G->draw_queue[G->draw_count++] = (DrawCmd){.t = DCT_RECT, .r = r, .color = color};
+}
+
+void draw_rect_outline(rect r, col32 color) {
+    if (G->draw_count == G->draw_size) return;
+    G->draw_queue[G->draw_count++] = (DrawCmd){.t = DCT_RECT_OUTLINE, .r = r, .color = color};
+}
+
+// A tilemap drawn as colored tiles, scrolled by the camera times parallax. Without wrap nothing is
+// drawn outside the map, with it the map repeats in every direction.
+typedef struct {
+    Tilemap *map;
+    col32   *colors; // Per tile id, ids from colors_count up are transparent
+    i32      colors_count;
+    q8       parallax; // Q8(1) scrolls with the camera, less lags behind it like a backdrop
+    bool     wrap;
+} TileLayer;
+
+// The world space rect a layer shows when the screen's top-left corner is at camera
+rect tile_layer_view(TileLayer *layer, v2 camera) {
+    return (rect){q8_mul(camera.x, layer->parallax), q8_mul(camera.y, layer->parallax),
+                  Q8(G->screen_size.w), Q8(G->screen_size.h)};
+}
+
+// Gathers the ids of the tiles overlapping view, a rect in layer pixels, into a DCT_TILES command
+// placed relative to origin. Returns false with an empty window when a layer without wrap has no
+// tiles there. Tiles have to be at least a pixel wide.
+static bool tile_window(TileLayer *layer, i32rect view, v2i origin, DrawCmd *out) {
+    Tilemap *tm    = layer->map;
+    i32      shift = tm->tile_shift - 8; // log2 of the tile side in pixels
+    i32      x0    = view.x >> shift;
+    i32      y0    = view.y >> shift;
+    i32      x1    = (view.x + view.w - 1) >> shift;
+    i32      y1    = (view.y + view.h - 1) >> shift;
+
+    *out = (DrawCmd){
+        .t            = DCT_TILES,
+        .colors       = layer->colors,
+        .colors_count = layer->colors_count,
+        .tile         = 1 << shift,
+    };
+    if (!layer->wrap) {
+        x0 = x0 > 0 ? x0 : 0;
+        y0 = y0 > 0 ? y0 : 0;
+        x1 = x1 < tm->size.w - 1 ? x1 : tm->size.w - 1;
+        y1 = y1 < tm->size.h - 1 ? y1 : tm->size.h - 1;
+        if (x0 > x1 || y0 > y1) return false;
+    }
+
+    v2i window = {.w = x1 - x0 + 1, .h = y1 - y0 + 1};
+    u8 *ids    = alloc_temp(window.w * window.h);
+    i32 map_y  = layer->wrap ? (y0 % tm->size.h + tm->size.h) % tm->size.h : y0;
+    for (i32 y = 0; y < window.h; y++) {
+        i32 map_x = layer->wrap ? (x0 % tm->size.w + tm->size.w) % tm->size.w : x0;
+        for (i32 x = 0; x < window.w; x++) {
+            ids[y * window.w + x] = tm->ids[tilemap_index(tm, map_x, map_y)];
+            if (++map_x == tm->size.w) map_x = 0;
+        }
+        if (++map_y == tm->size.h) map_y = 0;
+    }
+
+    out->ids    = ids;
+    out->window = window;
+    out->corner = (v2i){.x = (x0 << shift) - origin.x, .y = (y0 << shift) - origin.y};
+    return true;
+}
+
+// Queues the layer, gathering only the window of tiles in view. Tiles on the edges are cut by the
+// screen, so the layer scrolls a pixel at a time. There's a tile more on every side, so the window
+// can be moved by less than a tile when latching, see draw_shift.
+void draw_tiles(TileLayer *layer, v2 camera) {
+    if (G->draw_count == G->draw_size) return;
+
+    rect    view   = tile_layer_view(layer, camera);
+    v2i     origin = {.x = view.x >> 8, .y = view.y >> 8};
+    i32     tile   = 1 << (layer->map->tile_shift - 8);
+    i32rect pixels = {origin.x - tile, origin.y - tile, G->screen_size.w + 2 * tile,
+                      G->screen_size.h + 2 * tile};
+    DrawCmd cmd;
+    if (tile_window(layer, pixels, origin, &cmd)) G->draw_queue[G->draw_count++] = cmd;
+}
+
+// A layer that rarely changes, kept rasterized in a screen sized buffer of its own. The buffer
+// wraps around, scrolling moves the screen's origin in it and only draws the strips it exposes.
+// Setting a tile of the map to a new id redraws everything, other changes, like new colors, need
+// tile_cache_invalidate.
+//
+// Layers snap to whole pixels, so a sub-pixel scroll shows the same pixels and costs nothing.
+typedef struct TileCache {
+    TileLayer layer;
+    u32      *pixels;      // TILE_CACHE_CLEAR where the layer is transparent
+    v2i       scroll;      // Layer pixel at the top-left of the screen
+    v2i       origin;      // Where that pixel is in the buffer
+    u32       map_version; // Of the map when pixels were drawn
+    bool      valid;
+    bool      opaque;          // No transparent pixels, so presenting it is a plain copy
+    i32       redraws, strips; // Full redraws and scrolls drawn as strips, for profiling
+} TileCache;
+
+#define TILE_CACHE_CLEAR 0xFF000000 // The framebuffer is 0x00RRGGBB, the top byte is never set
+
+TileCache tile_cache_new(TileLayer layer, Arena *a) {
+    i32 pixels = G->screen_size.w * G->screen_size.h;
+    return (TileCache){.layer = layer, .pixels = (u32 *)alloc(sizeof(u32) * pixels, a)};
+}
+
+void tile_cache_invalidate(TileCache *cache) { cache->valid = false; }
+
+void draw_tile_cache(TileCache *cache, v2 camera) {
+    if (G->draw_count == G->draw_size) return;
+
+    rect view = tile_layer_view(&cache->layer, camera);
+    G->draw_queue[G->draw_count++] =
+        (DrawCmd){.t = DCT_LAYER, .cache = cache, .scroll = {.x = view.x >> 8, .y = view.y >> 8}};
+}
+
+// Moves the commands queued from first up to last by offset pixels, for a camera that moved after
+// they were queued, see input_latch. Meshes are in world space and text is left where it is.
+void draw_shift(u32 first, u32 last, v2i offset) {
+    for (u32 i = first; i < last && i < G->draw_count; i++) {
+        DrawCmd *cmd = &G->draw_queue[i];
+        switch (cmd->t) {
+        case DCT_RECT:
+        case DCT_RECT_OUTLINE: {
+            cmd->r.x += Q8(offset.x);
+            cmd->r.y += Q8(offset.y);
+            break;
+        }
+        case DCT_LINE: {
+            cmd->from = (v2){cmd->from.x + Q8(offset.x), cmd->from.y + Q8(offset.y)};
+            cmd->to   = (v2){cmd->to.x + Q8(offset.x), cmd->to.y + Q8(offset.y)};
+            break;
+        }
+        case DCT_TILES: {
+            cmd->corner.x += offset.x;
+            cmd->corner.y += offset.y;
+            break;
+        }
+        case DCT_LAYER: {
+            cmd->scroll.x -= offset.x;
+            cmd->scroll.y -= offset.y;
+            break;
+        }
+        default: break;
+        }
+    }
+}
+
+void draw_circle(i32 x, i32 y, i32 r, col32 color) {
+    for (i32 y_coord = y - r; y_coord <= y + r; y_coord++) {
+        for (i32 x_coord = x - r; x_coord <= x + r; x_coord++) {
+            i32 dx = x_coord - x;
+            i32 dy = y_coord - y;
+            if (dx * dx + dy * dy <= r * r) {
+                if (x_coord >= 0 && x_coord < G->screen_size.w && y_coord >= 0 &&
+                    y_coord < G->screen_size.h) {
+                    G->screen_buf[y_coord * G->screen_size.w + x_coord] = color;
+                }
+            }
+        }
+    }
+}
+
+void draw_circle_outline(i32 x, i32 y, i32 r, col32 color) {
+    for (i32 y_coord = y - r; y_coord <= y + r; y_coord++) {
+        for (i32 x_coord = x - r; x_coord <= x + r; x_coord++) {
+            i32 dx      = x_coord - x;
+            i32 dy      = y_coord - y;
+            i32 dist_sq = dx * dx + dy * dy;
+            if (dist_sq >= (r - 1) * (r - 1) && dist_sq <= r * r) {
+                if (x_coord >= 0 && x_coord < G->screen_size.w && y_coord >= 0 &&
+                    y_coord < G->screen_size.h) {
+                    G->screen_buf[y_coord * G->screen_size.w + x_coord] = color;
+                }
+            }
+        }
+    }
+}
+
+f32 atan2f(f32 y, f32 x) {
+    const f32 PI   = 3.14159265358979f;
+    const f32 PI_2 = 1.57079632679489f;
+
+    if (x == 0.0f) {
+        if (y > 0.0f) return PI_2;
+        if (y < 0.0f) return -PI_2;
+        return 0.0f;
+    }
+
+    f32 z     = y / x;
+    f32 abs_z = z < 0 ? -z : z;
+
+    f32 angle = z / (1.0f + 0.28662f * abs_z * abs_z);
+
+    if (x < 0.0f) {
+        if (y >= 0.0f)
+            angle += PI;
+        else
+            angle -= PI;
+    }
+
+    return angle;
+}
+
+void draw_arc(i32 x, i32 y, i32 r, rad from, rad to, col32 color) {
+    for (i32 y_coord = y - r; y_coord <= y + r; y_coord++) {
+        for (i32 x_coord = x - r; x_coord <= x + r; x_coord++) {
+            i32 dx = x_coord - x;
+            i32 dy = y_coord - y;
+            if (dx * dx + dy * dy <= r * r) {
+                f32 angle = atan2f((f32)dy, (f32)dx);
+                if (angle >= from && angle <= to) {
+                    if (x_coord >= 0 && x_coord < G->screen_size.w && y_coord >= 0 &&
+                        y_coord < G->screen_size.h) {
+                        G->screen_buf[y_coord * G->screen_size.w + x_coord] = color;
+                    }
+                }
+            }
+        }
+    }
+}
+
+i32 abs(i32 x) { return x < 0 ? -x : x; }
+
+// Where rasterizers may write, the whole screen unless clip is set
+static inline i32rect render_clip() {
+    if (G->clip.w > 0) return G->clip;
+    return (i32rect){0, 0, G->screen_size.w, G->screen_size.h};
+}
+
+void render_line(v2i from, v2i to, col32 color) {
+    i32 dx = to.x - from.x;
+    i32 dy = to.y - from.y;
+
+    i32 steps = abs(dx) > abs(dy) ? abs(dx) : abs(dy);
+    if (steps == 0) return;
+
+    f32 x_inc = (f32)dx / steps;
+    f32 y_inc = (f32)dy / steps;
+
+    f32     x    = (f32)from.x;
+    f32     y    = (f32)from.y;
+    i32rect clip = render_clip();
+
+    for (i32 i = 0; i <= steps; i++) {
+        i16 px = (i16)x, py = (i16)y;
+        if (px >= clip.x && px < clip.x + clip.w && py >= clip.y && py < clip.y + clip.h) {
+            G->screen_buf[py * G->screen_size.w + px] = color;
+        }
+        x += x_inc;
+        y += y_inc;
+    }
+}
+
+void draw_text(char *text, i32 x, i32 y, col32 color) {
+    if (G->draw_count == G->draw_size) return;
+
+    G->draw_queue[G->draw_count++] =
+        (DrawCmd){.t = DCT_TEXT, .color = color, .text = text, .x = x, .y = y};
+}
+
+char *string_format(Arena *a, char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+
+    va_list copy;
+    va_copy(copy, args);
+
+    i32 needed = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+
+    char *result = (char *)alloc((u64)needed + 1, a);
+
+    vsnprintf(result, (u64)needed + 1, fmt, copy);
+    va_end(copy);
+
+    return result;
+}
+
+bool gui_button(char *name, q8 x, q8 y) {
+    rect  r     = {x, y, Q8(60), Q8(20)};
+    bool  col   = col_point_rect(G->mouse_pos, r);
+    col32 color = col ? rgb(100, 100, 100) : rgb(30, 30, 30);
+
+    draw_rect(r, color);
+    draw_text(name, q8_to_i32(x), q8_to_i32(y), rgb(250, 250, 250));
+
+    return G->keys[K_MOUSE_LEFT] == KS_JUST_PRESSED && col;
+}
+
+bool gui_toggle(char *name, q8 x, q8 y, bool *val) {
+    rect  r     = {x, y, Q8(60), Q8(20)};
+    col32 color = *val ? rgb(100, 100, 100) : rgb(30, 30, 30);
+
+    draw_rect(r, color);
+    draw_text(name, q8_to_i32(x), q8_to_i32(y), rgb(250, 250, 250));
+
+    bool pressed = G->keys[K_MOUSE_LEFT] == KS_JUST_PRESSED && col_point_rect(G->mouse_pos, r);
+    if (pressed) *val ^= true;
+    return pressed;
+}
+
+void render_filled_triangle(v2i p0, v2i p1, v2i p2, col32 color) {
+    // Sort vertices by y coordinate (p0.y <= p1.y <= p2.y)
+    if (p0.y > p1.y) {
+        v2i tmp = p0;
+        p0      = p1;
+        p1      = tmp;
+    }
+    if (p0.y > p2.y) {
+        v2i tmp = p0;
+        p0      = p2;
+        p2      = tmp;
+    }
+    if (p1.y > p2.y) {
+        v2i tmp = p1;
+        p1      = p2;
+        p2      = tmp;
+    }
+
+    i32 total_height = p2.y - p0.y;
+    if (total_height == 0) return;
+
+    i32rect clip = render_clip();
+    for (i32 y = p0.y; y <= p2.y; y++) {
+        if (y < clip.y || y >= clip.y + clip.h) continue;
+
+        bool second_half    = (y > p1.y) || (p1.y == p0.y);
+        i32  segment_height = second_half ? (p2.y - p1.y) : (p1.y - p0.y);
+        if (segment_height == 0) continue;
+
+        f32 alpha = (f32)(y - p0.y) / (f32)total_height;
+        f32 beta  = second_half ? (f32)(y - p1.y) / (f32)segment_height
+                                : (f32)(y - p0.y) / (f32)segment_height;
+
+        i32 xa = (i32)(p0.x + (p2.x - p0.x) * alpha);
+        i32 xb =
+            second_half ? (i32)(p1.x + (p2.x - p1.x) * beta) : (i32)(p0.x + (p1.x - p0.x) * beta);
+
+        if (xa > xb) {
+            i32 tmp = xa;
+            xa      = xb;
+            xb      = tmp;
+        }
+
+        // Clamp to screen
+        if (xa < clip.x) xa = clip.x;
+        if (xb >= clip.x + clip.w) xb = clip.x + clip.w - 1;
+
+        for (i32 x = xa; x <= xb; x++) {
+            G->screen_buf[y * G->screen_size.w + x] = color;
+        }
+    }
+}
+
+// Clipped once, instead of testing every pixel
+void render_rect(i32rect r, col32 color) {
+    i32rect c  = render_clip();
+    i32     x0 = r.x > c.x ? r.x : c.x, x1 = r.x + r.w < c.x + c.w ? r.x + r.w : c.x + c.w;
+    i32     y0 = r.y > c.y ? r.y : c.y, y1 = r.y + r.h < c.y + c.h ? r.y + r.h : c.y + c.h;
+    for (i32 y = y0; y < y1; y++) {
+        u32 *row = G->screen_buf + y * G->screen_size.w;
+        for (i32 x = x0; x < x1; x++) {
+            row[x] = color;
+        }
+    }
+}
+
+void render_rect_outline(i32rect r, col32 color) {
+    render_rect((i32rect){r.x, r.y, r.w, 1}, color);
+    render_rect((i32rect){r.x, r.y + r.h - 1, r.w, 1}, color);
+    render_rect((i32rect){r.x, r.y, 1, r.h}, color);
+    render_rect((i32rect){r.x + r.w - 1, r.y, 1, r.h}, color);
+}
+
+void render_tiles(u8 *ids, col32 *colors, i32 colors_count, i32 tile, v2i window, v2i corner) {
+    for (i32 y = 0; y < window.h; y++) {
+        for (i32 x = 0; x < window.w; x++) {
+            u8 id = ids[y * window.w + x];
+            if (id >= colors_count) continue;
+            i32rect r = {corner.x + x * tile, corner.y + y * tile, tile, tile};
+            render_rect(r, colors[id]);
+        }
+    }
+}
+
+// Clears a rect of the screen in the cache and draws the tiles over it, in up to four pieces when
+// it wraps around the buffer. Returns whether all of it is opaque.
+static bool tile_cache_draw(TileCache *cache, i32rect area) {
+    i32  w = G->screen_size.w, h = G->screen_size.h;
+    i32  bx = (area.x + cache->origin.x) % w, by = (area.y + cache->origin.y) % h;
+    bool result = cache->layer.wrap;
+
+    for (i32 py = 0; py < area.h;) {
+        i32 y  = (by + py) % h;
+        i32 ph = h - y < area.h - py ? h - y : area.h - py;
+        for (i32 px = 0; px < area.w;) {
+            i32     x     = (bx + px) % w;
+            i32     pw    = w - x < area.w - px ? w - x : area.w - px;
+            i32rect piece = {x, y, pw, ph};
+            render_rect(piece, TILE_CACHE_CLEAR);
+
+            // Tiles land at their layer pixel minus origin, cut to the piece so they don't spill
+            // into pixels on the other side of the wrap
+            DrawCmd t;
+            v2i     layer  = {cache->scroll.x + area.x + px, cache->scroll.y + area.y + py};
+            v2i     origin = {layer.x - x, layer.y - y};
+            if (!tile_window(&cache->layer, (i32rect){layer.x, layer.y, pw, ph}, origin, &t)) {
+                result = false;
+                px += pw;
+                continue;
+            }
+            for (i32 ty = 0; ty < t.window.h; ty++) {
+                for (i32 tx = 0; tx < t.window.w; tx++) {
+                    u8 id = t.ids[ty * t.window.w + tx];
+                    if (id >= t.colors_count) {
+                        result = false;
+                        continue;
+                    }
+
+                    i32 x0 = t.corner.x + tx * t.tile, y0 = t.corner.y + ty * t.tile;
+                    i32 x1 = x0 + t.tile, y1 = y0 + t.tile;
+                    x0     = x0 > x ? x0 : x;
+                    y0     = y0 > y ? y0 : y;
+                    x1     = x1 < x + pw ? x1 : x + pw;
+                    y1     = y1 < y + ph ? y1 : y + ph;
+                    render_rect((i32rect){x0, y0, x1 - x0, y1 - y0}, t.colors[id]);
+                }
+            }
+            px += pw;
+        }
+        py += ph;
+    }
+    return result;
+}
+
+// Copies the pixels of src that aren't TILE_CACHE_CLEAR over dst
+static void tile_cache_blend(u32 *dst, u32 *src, i32 n) {
+    i32 i = 0;
+#if defined(__AVX2__)
+    __m256i clear8 = _mm256_set1_epi32((i32)TILE_CACHE_CLEAR);
+    for (; i + 8 <= n; i += 8) {
+        __m256i s    = _mm256_loadu_si256((__m256i *)(src + i));
+        __m256i d    = _mm256_loadu_si256((__m256i *)(dst + i));
+        __m256i keep = _mm256_cmpeq_epi32(s, clear8);
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_blendv_epi8(s, d, keep));
+    }
+#endif
+#if defined(__SSE4_1__)
+    __m128i clear4 = _mm_set1_epi32((i32)TILE_CACHE_CLEAR);
+    for (; i + 4 <= n; i += 4) {
+        __m128i s    = I32X4_LOAD(src + i);
+        __m128i keep = _mm_cmpeq_epi32(s, clear4);
+        I32X4_STORE(dst + i, _mm_blendv_epi8(s, I32X4_LOAD(dst + i), keep));
+    }
+#endif
+    // Tiles make long runs, which are copied whole
+    while (i < n) {
+        i32 start = i;
+        while (i < n && src[i] != TILE_CACHE_CLEAR)
+            i++;
+        memcpy(dst + start, src + start, sizeof(u32) * (i - start));
+        while (i < n && src[i] == TILE_CACHE_CLEAR)
+            i++;
+    }
+}
+
+// Brings the cache to scroll and composites it over the screen
+void render_tile_cache(TileCache *cache, v2i scroll) {
+    i32 w = G->screen_size.w, h = G->screen_size.h;
+    i32 dx = scroll.x - cache->scroll.x, dy = scroll.y - cache->scroll.y;
+    if (cache->map_version != cache->layer.map->version || dx <= -w || dx >= w || dy <= -h ||
+        dy >= h)
+        cache->valid = false;
+
+    // Everything below draws into the cache instead of the screen, all of it
+    u32    *screen = G->screen_buf;
+    i32rect clip   = render_clip(), saved = G->clip;
+    G->screen_buf  = cache->pixels;
+    G->clip        = (i32rect){0};
+    if (!cache->valid) {
+        cache->scroll = scroll;
+        cache->origin = (v2i){0};
+        cache->opaque = tile_cache_draw(cache, (i32rect){0, 0, w, h});
+        cache->valid  = true;
+        cache->redraws++;
+    } else if (dx || dy) {
+        // The pixels that stay in view don't move, the exposed strips overwrite the ones that left
+        cache->scroll   = scroll;
+        cache->origin.x = (cache->origin.x + dx + w) % w;
+        cache->origin.y = (cache->origin.y + dy + h) % h;
+        if (dx) {
+            i32rect exposed = {dx > 0 ? w - dx : 0, 0, dx > 0 ? dx : -dx, h};
+            cache->opaque &= tile_cache_draw(cache, exposed);
+        }
+        if (dy) {
+            i32rect exposed = {0, dy > 0 ? h - dy : 0, w, dy > 0 ? dy : -dy};
+            cache->opaque &= tile_cache_draw(cache, exposed);
+        }
+        cache->strips++;
+    }
+    cache->map_version = cache->layer.map->version;
+    G->screen_buf      = screen;
+    G->clip            = saved;
+
+    // Each screen row is the end of a buffer row followed by its start, both cut to the clip
+    i32 split = w - cache->origin.x;
+    i32 x0 = clip.x, x1 = clip.x + clip.w;
+    i32 a0 = x0, a1 = x1 < split ? x1 : split;
+    i32 b0 = x0 > split ? x0 : split, b1 = x1;
+    for (i32 y = clip.y; y < clip.y + clip.h; y++) {
+        u32 *src = cache->pixels + ((cache->origin.y + y) % h) * w + cache->origin.x;
+        u32 *dst = G->screen_buf + y * w;
+        if (cache->opaque) {
+            if (a1 > a0) memcpy(dst + a0, src + a0, sizeof(u32) * (a1 - a0));
+            if (b1 > b0) memcpy(dst + b0, src + b0 - w, sizeof(u32) * (b1 - b0));
+        } else {
+            if (a1 > a0) tile_cache_blend(dst + a0, src + a0, a1 - a0);
+            if (b1 > b0) tile_cache_blend(dst + b0, src + b0 - w, b1 - b0);
+        }
+    }
+}
+
+void render_mesh(v3 *verts, i32 count, v2i *edges, i32 edges_count, col32 color) {
+    v2  *projected    = (v2 *)alloc_temp(sizeof(v2) * count);
+    v2i *screen_verts = (v2i *)alloc_temp(sizeof(v2i) * count);
+    v3_project_array(projected, verts, count);
+    for (i32 v = 0; v < count; v++) {
+        screen_verts[v] = v2i_from_v2(v2_screen(projected[v], G->screen_size));
+    }
+
+    for (i32 v = 0; v < edges_count; v++) {
+        v2i edge = edges[v];
+        render_line(screen_verts[edge.from], screen_verts[edge.to], color);
+    }
+}
+
+// 8x12 bitmap font for ASCII 32..126, one byte per row with the MSB on the left
+#define FONT_W 8
+#define FONT_H 12
+#define FONT_FIRST 32
+#define FONT_LAST 126
+
+static const u8 font_8x12[(FONT_LAST - FONT_FIRST + 1) * FONT_H] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08, 0x08, 0x08,
+    0x08, 0x08, 0x08, 0x00, 0x08, 0x00, 0x00, 0x00, 0x00, 0x14, 0x14, 0x14, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x0A, 0x12, 0x3F, 0x14, 0x14, 0x7E, 0x28, 0x28, 0x00, 0x00, 0x00,
+    0x00, 0x08, 0x1E, 0x28, 0x28, 0x1C, 0x0A, 0x0A, 0x3C, 0x08, 0x08, 0x00, 0x00, 0x30, 0x48, 0x32,
+    0x04, 0x10, 0x2E, 0x0A, 0x0E, 0x00, 0x00, 0x00, 0x00, 0x1C, 0x20, 0x30, 0x30, 0x28, 0x46, 0x66,
+    0x3E, 0x00, 0x00, 0x00, 0x00, 0x08, 0x08, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x04, 0x08, 0x08, 0x18, 0x10, 0x10, 0x18, 0x08, 0x08, 0x04, 0x00, 0x00, 0x10, 0x08, 0x08, 0x08,
+    0x08, 0x08, 0x08, 0x08, 0x18, 0x10, 0x00, 0x00, 0x00, 0x08, 0x2A, 0x1C, 0x1C, 0x2A, 0x08, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08, 0x08, 0x7E, 0x08, 0x08, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08, 0x08, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x1C, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08,
+    0x08, 0x00, 0x00, 0x00, 0x00, 0x06, 0x04, 0x04, 0x08, 0x08, 0x10, 0x10, 0x20, 0x20, 0x00, 0x00,
+    0x00, 0x1C, 0x36, 0x22, 0x22, 0x2A, 0x22, 0x36, 0x1C, 0x00, 0x00, 0x00, 0x00, 0x38, 0x08, 0x08,
+    0x08, 0x08, 0x08, 0x08, 0x3E, 0x00, 0x00, 0x00, 0x00, 0x3C, 0x26, 0x06, 0x04, 0x08, 0x18, 0x30,
+    0x3E, 0x00, 0x00, 0x00, 0x00, 0x1C, 0x26, 0x06, 0x1C, 0x06, 0x02, 0x26, 0x3C, 0x00, 0x00, 0x00,
+    0x00, 0x0C, 0x0C, 0x14, 0x24, 0x24, 0x7E, 0x04, 0x04, 0x00, 0x00, 0x00, 0x00, 0x3C, 0x20, 0x20,
+    0x3C, 0x06, 0x02, 0x06, 0x3C, 0x00, 0x00, 0x00, 0x00, 0x1C, 0x30, 0x20, 0x3C, 0x26, 0x22, 0x26,
+    0x1C, 0x00, 0x00, 0x00, 0x00, 0x3E, 0x04, 0x04, 0x04, 0x08, 0x08, 0x18, 0x10, 0x00, 0x00, 0x00,
+    0x00, 0x1C, 0x26, 0x26, 0x1C, 0x26, 0x22, 0x26, 0x1C, 0x00, 0x00, 0x00, 0x00, 0x1C, 0x26, 0x22,
+    0x26, 0x1E, 0x02, 0x04, 0x3C, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08, 0x08, 0x00, 0x00, 0x08,
+    0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08, 0x08, 0x00, 0x00, 0x08, 0x08, 0x10, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x02, 0x1C, 0x60, 0x1C, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x7E, 0x00, 0x7E, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x60, 0x1C, 0x06, 0x1C, 0x60,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x3C, 0x06, 0x04, 0x08, 0x08, 0x08, 0x00, 0x08, 0x00, 0x00, 0x00,
+    0x00, 0x1C, 0x22, 0x22, 0x4E, 0x52, 0x52, 0x4E, 0x20, 0x30, 0x1C, 0x00, 0x00, 0x18, 0x18, 0x14,
+    0x14, 0x24, 0x3E, 0x22, 0x62, 0x00, 0x00, 0x00, 0x00, 0x3C, 0x26, 0x26, 0x3C, 0x22, 0x22, 0x22,
+    0x3C, 0x00, 0x00, 0x00, 0x00, 0x1C, 0x32, 0x20, 0x20, 0x20, 0x20, 0x32, 0x1C, 0x00, 0x00, 0x00,
+    0x00, 0x38, 0x24, 0x22, 0x22, 0x22, 0x22, 0x24, 0x38, 0x00, 0x00, 0x00, 0x00, 0x3E, 0x20, 0x20,
+    0x3E, 0x20, 0x20, 0x20, 0x3E, 0x00, 0x00, 0x00, 0x00, 0x3E, 0x20, 0x20, 0x3E, 0x20, 0x20, 0x20,
+    0x20, 0x00, 0x00, 0x00, 0x00, 0x1C, 0x32, 0x20, 0x20, 0x26, 0x22, 0x32, 0x1C, 0x00, 0x00, 0x00,
+    0x00, 0x22, 0x22, 0x22, 0x3E, 0x22, 0x22, 0x22, 0x22, 0x00, 0x00, 0x00, 0x00, 0x3E, 0x08, 0x08,
+    0x08, 0x08, 0x08, 0x08, 0x3E, 0x00, 0x00, 0x00, 0x00, 0x1C, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,
+    0x38, 0x00, 0x00, 0x00, 0x00, 0x22, 0x24, 0x28, 0x38, 0x28, 0x24, 0x26, 0x22, 0x00, 0x00, 0x00,
+    0x00, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3E, 0x00, 0x00, 0x00, 0x00, 0x66, 0x76, 0x76,
+    0x7A, 0x6A, 0x62, 0x62, 0x62, 0x00, 0x00, 0x00, 0x00, 0x22, 0x32, 0x32, 0x2A, 0x2A, 0x2E, 0x26,
+    0x26, 0x00, 0x00, 0x00, 0x00, 0x1C, 0x26, 0x22, 0x22, 0x22, 0x22, 0x26, 0x1C, 0x00, 0x00, 0x00,
+    0x00, 0x3C, 0x22, 0x22, 0x26, 0x3C, 0x20, 0x20, 0x20, 0x00, 0x00, 0x00, 0x00, 0x1C, 0x26, 0x22,
+    0x22, 0x22, 0x22, 0x26, 0x1C, 0x04, 0x00, 0x00, 0x00, 0x3C, 0x26, 0x26, 0x26, 0x3C, 0x24, 0x22,
+    0x22, 0x00, 0x00, 0x00, 0x00, 0x1C, 0x20, 0x20, 0x30, 0x0C, 0x02, 0x26, 0x1C, 0x00, 0x00, 0x00,
+    0x00, 0x7E, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x00, 0x00, 0x00, 0x00, 0x22, 0x22, 0x22,
+    0x22, 0x22, 0x22, 0x26, 0x1C, 0x00, 0x00, 0x00, 0x00, 0x62, 0x22, 0x26, 0x24, 0x14, 0x14, 0x18,
+    0x18, 0x00, 0x00, 0x00, 0x00, 0x43, 0x42, 0x4A, 0x7A, 0x32, 0x36, 0x36, 0x26, 0x00, 0x00, 0x00,
+    0x00, 0x22, 0x34, 0x14, 0x08, 0x18, 0x14, 0x26, 0x62, 0x00, 0x00, 0x00, 0x00, 0x62, 0x26, 0x14,
+    0x18, 0x08, 0x08, 0x08, 0x08, 0x00, 0x00, 0x00, 0x00, 0x3E, 0x02, 0x04, 0x08, 0x08, 0x10, 0x20,
+    0x3E, 0x00, 0x00, 0x00, 0x1C, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x1C, 0x00, 0x00,
+    0x00, 0x20, 0x20, 0x10, 0x10, 0x08, 0x08, 0x04, 0x04, 0x06, 0x00, 0x00, 0x18, 0x08, 0x08, 0x08,
+    0x08, 0x08, 0x08, 0x08, 0x08, 0x18, 0x00, 0x00, 0x00, 0x18, 0x14, 0x22, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x7F,
+    0x10, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x3C,
+    0x06, 0x3E, 0x22, 0x26, 0x3E, 0x00, 0x00, 0x00, 0x20, 0x20, 0x20, 0x3C, 0x36, 0x22, 0x22, 0x36,
+    0x3C, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1E, 0x30, 0x20, 0x20, 0x30, 0x1E, 0x00, 0x00, 0x00,
+    0x02, 0x02, 0x02, 0x1E, 0x26, 0x26, 0x26, 0x26, 0x1E, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1C,
+    0x22, 0x3E, 0x20, 0x20, 0x1E, 0x00, 0x00, 0x00, 0x0E, 0x08, 0x08, 0x3E, 0x08, 0x08, 0x08, 0x08,
+    0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1E, 0x26, 0x26, 0x26, 0x26, 0x1E, 0x04, 0x3C, 0x00,
+    0x20, 0x20, 0x20, 0x3C, 0x36, 0x22, 0x22, 0x22, 0x22, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x38,
+    0x08, 0x08, 0x08, 0x08, 0x3E, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x38, 0x08, 0x08, 0x08, 0x08,
+    0x08, 0x08, 0x38, 0x00, 0x20, 0x20, 0x20, 0x26, 0x2C, 0x38, 0x3C, 0x24, 0x22, 0x00, 0x00, 0x00,
+    0x38, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x0E, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x3E,
+    0x2A, 0x2A, 0x2A, 0x2A, 0x2A, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x3C, 0x36, 0x22, 0x22, 0x22,
+    0x22, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1C, 0x26, 0x22, 0x22, 0x26, 0x1C, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x3C, 0x36, 0x22, 0x22, 0x36, 0x3C, 0x20, 0x20, 0x00, 0x00, 0x00, 0x00, 0x1E,
+    0x26, 0x22, 0x22, 0x26, 0x1E, 0x02, 0x02, 0x00, 0x00, 0x00, 0x00, 0x1E, 0x18, 0x10, 0x10, 0x10,
+    0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1C, 0x20, 0x38, 0x0C, 0x06, 0x3C, 0x00, 0x00, 0x00,
+    0x00, 0x10, 0x10, 0x3E, 0x10, 0x10, 0x10, 0x18, 0x0E, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x22,
+    0x22, 0x22, 0x22, 0x26, 0x1E, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x22, 0x26, 0x24, 0x14, 0x1C,
+    0x18, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x43, 0x42, 0x2A, 0x3A, 0x36, 0x34, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x26, 0x14, 0x18, 0x18, 0x34, 0x22, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x22,
+    0x22, 0x14, 0x14, 0x18, 0x08, 0x18, 0x30, 0x00, 0x00, 0x00, 0x00, 0x3E, 0x04, 0x08, 0x10, 0x10,
+    0x3E, 0x00, 0x00, 0x00, 0x0E, 0x08, 0x08, 0x08, 0x30, 0x18, 0x08, 0x08, 0x08, 0x0E, 0x00, 0x00,
+    0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x00, 0x30, 0x08, 0x08, 0x08,
+    0x0E, 0x08, 0x08, 0x08, 0x08, 0x30, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x38, 0x0E, 0x00,
+    0x00, 0x00, 0x00, 0x00,
+};
+
+// Software text, for platforms without a native text renderer. Draws until the end of the string
+// or the right edge of the screen, newlines start a new row.
+void render_text(char *text, i32 x, i32 y, col32 color) {
+    i32rect clip  = render_clip();
+    i32     pen_x = x;
+    for (char *c = text; *c; c++) {
+        if (*c == '\n') {
+            pen_x = x;
+            y += FONT_H;
+            continue;
+        }
+
+        u8 ch = (u8)*c;
+        if (ch < FONT_FIRST || ch > FONT_LAST) ch = '?';
+
+        const u8 *glyph = &font_8x12[(ch - FONT_FIRST) * FONT_H];
+        for (i32 row = 0; row < FONT_H; row++) {
+            i32 py = y + row;
+            if (py < clip.y || py >= clip.y + clip.h) continue;
+
+            u32 *dst = &G->screen_buf[py * G->screen_size.w];
+            for (i32 col = 0; col < FONT_W; col++) {
+                i32 px = pen_x + col;
+                if (px < clip.x || px >= clip.x + clip.w) continue;
+                if (glyph[row] & (0x80 >> col)) dst[px] = color;
+            }
+        }
+
+        pen_x += FONT_W;
+        if (pen_x >= G->screen_size.w) break;
+    }
+}
+
+// One queued command other than text, which each platform presents its own way
+static void render_cmd(DrawCmd next) {
+    switch (next.t) {
+    case DCT_MESH: {
+        render_mesh(next.vertices, next.count, next.edges, next.edges_count, next.color);
+        break;
+    }
+    case DCT_RECT: {
+        render_rect(
+            (i32rect){
+                .x = q8_to_i32(next.r.x),
+                .y = q8_to_i32(next.r.y),
+                .w = q8_to_i32(next.r.w),
+                .h = q8_to_i32(next.r.h),
+            },
+            next.color);
+        break;
+    }
+    case DCT_RECT_OUTLINE: {
+        render_rect_outline(
+            (i32rect){
+                .x = q8_to_i32(next.r.x),
+                .y = q8_to_i32(next.r.y),
+                .w = q8_to_i32(next.r.w),
+                .h = q8_to_i32(next.r.h),
+            },
+            next.color);
+        break;
+    }
+    case DCT_LINE: {
+        render_line(v2i_from_v2(next.from), v2i_from_v2(next.to), next.color);
+        break;
+    }
+    case DCT_TILES: {
+        render_tiles(next.ids, next.colors, next.colors_count, next.tile, next.window, next.corner);
+        break;
+    }
+    case DCT_LAYER: {
+        render_tile_cache(next.cache, next.scroll);
+        break;
+    }
+    default: break;
+    }
+}
+
+// Rasterizes every queued command except text
+void render_draw_queue() {
+    for (i32 i = 0; i < G->draw_count; i++) {
+        render_cmd(G->draw_queue[i]);
+    }
+}
+
+void render_text_queue() {
+    for (i32 i = 0; i < G->draw_count; i++) {
+        DrawCmd next = G->draw_queue[i];
+        if (next.t == DCT_TEXT) render_text(next.text, next.x, next.y, next.color);
+    }
+}
+
+// Damage tracking: the screen is split in cells, and only those where this frame's commands differ
+// from the last frame's are redrawn and presented. Every command gets a hash of what it draws and
+// the bounds it can touch, and each cell folds in the hashes of the commands over it in order, so a
+// command that changes, moves, appears or goes away damages the cells under it. Pixels outside the
+// damage keep what the last frame left there.
+#define DAMAGE_CELL_SHIFT 5
+#define DAMAGE_TEXT_LINE 20 // Room for a line of text in FONT_H or any platform's own font
+
+static u64 damage_hash(u64 hash, void *data, i32 size) {
+    u8 *bytes = (u8 *)data;
+    for (i32 i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// Hash of what a command draws, and the pixels it can touch in bounds
+static u64 damage_cmd(DrawCmd *cmd, i32rect *bounds) {
+    u64 hash = damage_hash(0xcbf29ce484222325ull, &cmd->t, sizeof(cmd->t));
+    hash     = damage_hash(hash, &cmd->color, sizeof(cmd->color));
+    *bounds  = (i32rect){0, 0, G->screen_size.w, G->screen_size.h};
+
+    switch (cmd->t) {
+    case DCT_RECT:
+    case DCT_RECT_OUTLINE: {
+        *bounds = (i32rect){q8_to_i32(cmd->r.x), q8_to_i32(cmd->r.y), q8_to_i32(cmd->r.w),
+                            q8_to_i32(cmd->r.h)};
+        return damage_hash(hash, bounds, sizeof(*bounds));
+    }
+    case DCT_LINE: {
+        v2i from = v2i_from_v2(cmd->from), to = v2i_from_v2(cmd->to);
+        *bounds  = (i32rect){from.x < to.x ? from.x : to.x, from.y < to.y ? from.y : to.y,
+                             abs(to.x - from.x) + 1, abs(to.y - from.y) + 1};
+        return damage_hash(hash, bounds, sizeof(*bounds));
+    }
+    case DCT_TEXT: {
+        i32 lines = 1, len = 0;
+        for (; cmd->text[len]; len++) {
+            lines += cmd->text[len] == '\n';
+        }
+        *bounds = (i32rect){cmd->x, cmd->y, G->screen_size.w - cmd->x, lines * DAMAGE_TEXT_LINE};
+        hash    = damage_hash(hash, bounds, sizeof(*bounds));
+        return damage_hash(hash, cmd->text, len);
+    }
+    case DCT_MESH: {
+        // Lines wrap around past 16 bits, so meshes that far out could land anywhere
+        v2 *projected = (v2 *)alloc_temp(sizeof(v2) * cmd->count);
+        v3_project_array(projected, cmd->vertices, cmd->count);
+        i32 x0 = 0x7FFFFFFF, y0 = 0x7FFFFFFF, x1 = -0x7FFFFFFF, y1 = -0x7FFFFFFF;
+        for (i32 i = 0; i < cmd->count; i++) {
+            v2i p = v2i_from_v2(v2_screen(projected[i], G->screen_size));
+            x0    = p.x < x0 ? p.x : x0;
+            y0    = p.y < y0 ? p.y : y0;
+            x1    = p.x > x1 ? p.x : x1;
+            y1    = p.y > y1 ? p.y : y1;
+        }
+        if (x0 >= -32768 && y0 >= -32768 && x1 <= 32767 && y1 <= 32767)
+            *bounds = (i32rect){x0, y0, x1 - x0 + 1, y1 - y0 + 1};
+
+        hash = damage_hash(hash, cmd->vertices, sizeof(v3) * cmd->count);
+        return damage_hash(hash, cmd->edges, sizeof(v2i) * cmd->edges_count);
+    }
+    case DCT_TILES: {
+        *bounds = (i32rect){cmd->corner.x, cmd->corner.y, cmd->window.w * cmd->tile,
+                            cmd->window.h * cmd->tile};
+        hash    = damage_hash(hash, bounds, sizeof(*bounds));
+        hash    = damage_hash(hash, cmd->ids, cmd->window.w * cmd->window.h);
+        return damage_hash(hash, cmd->colors, sizeof(col32) * cmd->colors_count);
+    }
+    case DCT_LAYER: {
+        TileCache *cache = cmd->cache;
+        hash             = damage_hash(hash, &cmd->scroll, sizeof(cmd->scroll));
+        hash             = damage_hash(hash, &cache->layer.map, sizeof(cache->layer.map));
+        hash             = damage_hash(hash, &cache->layer.map->version, sizeof(u32));
+        hash             = damage_hash(hash, &cache->valid, sizeof(cache->valid));
+        return damage_hash(hash, cache->layer.colors, sizeof(col32) * cache->layer.colors_count);
+    }
+    default: return hash;
+    }
+}
+
+// Finds the damage of the queued frame, call it once per frame before render_damage
+void damage_update() {
+    Damage *d = &G->damage;
+    if (!d->hash) {
+        d->shift = DAMAGE_CELL_SHIFT;
+        while ((G->screen_size.w + (1 << d->shift) - 1) >> d->shift > 64)
+            d->shift++;
+        d->cells_w = (G->screen_size.w + (1 << d->shift) - 1) >> d->shift;
+        d->cells_h = (G->screen_size.h + (1 << d->shift) - 1) >> d->shift;
+        d->hash    = ALLOC_ARRAY(u64, d->cells_w * d->cells_h);
+        d->prev    = ALLOC_ARRAY(u64, d->cells_w * d->cells_h);
+        d->rows    = ALLOC_ARRAY(u64, d->cells_h);
+        d->rects   = ALLOC_ARRAY(i32rect, d->cells_w * d->cells_h);
+    }
+
+    for (i32 i = 0; i < d->cells_w * d->cells_h; i++) {
+        d->hash[i] = 0;
+    }
+    d->bounds = (i32rect *)alloc_temp(sizeof(i32rect) * G->draw_count);
+    for (i32 i = 0; i < G->draw_count; i++) {
+        i32rect b;
+        u64     hash = damage_cmd(&G->draw_queue[i], &b);
+        i32     x0   = b.x > 0 ? b.x : 0;
+        i32     y0   = b.y > 0 ? b.y : 0;
+        i32     x1   = b.x + b.w < G->screen_size.w ? b.x + b.w : G->screen_size.w;
+        i32     y1   = b.y + b.h < G->screen_size.h ? b.y + b.h : G->screen_size.h;
+        d->bounds[i] = b;
+        if (x0 >= x1 || y0 >= y1) continue;
+
+        for (i32 cy = y0 >> d->shift; cy <= (y1 - 1) >> d->shift; cy++) {
+            for (i32 cx = x0 >> d->shift; cx <= (x1 - 1) >> d->shift; cx++) {
+                u64 *cell = &d->hash[cy * d->cells_w + cx];
+                *cell     = (*cell ^ hash) * 0x100000001b3ull;
+            }
+        }
+    }
+
+    for (i32 cy = 0; cy < d->cells_h; cy++) {
+        d->rows[cy] = 0;
+        for (i32 cx = 0; cx < d->cells_w; cx++) {
+            i32 i = cy * d->cells_w + cx;
+            if (!d->valid || d->hash[i] != d->prev[i]) d->rows[cy] |= 1ull << cx;
+        }
+    }
+    u64 *swap = d->prev;
+    d->prev   = d->hash;
+    d->hash   = swap;
+    d->valid  = true;
+
+    // Runs of damaged cells grow down over the rows below that have all of them damaged too
+    u64 *rows      = (u64 *)alloc_temp(sizeof(u64) * d->cells_h);
+    d->rects_count = 0;
+    d->pixels      = 0;
+    for (i32 cy = 0; cy < d->cells_h; cy++) {
+        rows[cy] = d->rows[cy];
+    }
+    for (i32 cy = 0; cy < d->cells_h; cy++) {
+        while (rows[cy]) {
+            i32 x   = lsb_u64(rows[cy]);
+            u64 end = ~(rows[cy] >> x);
+            i32 len = end ? lsb_u64(end) : 64 - x;
+            u64 run = (len == 64 ? ~0ull : (1ull << len) - 1) << x;
+
+            i32 y = cy + 1;
+            while (y < d->cells_h && (rows[y] & run) == run) {
+                rows[y++] &= ~run;
+            }
+            rows[cy] &= ~run;
+
+            i32rect r = {x << d->shift, cy << d->shift, len << d->shift, (y - cy) << d->shift};
+            r.w       = r.x + r.w < G->screen_size.w ? r.w : G->screen_size.w - r.x;
+            r.h       = r.y + r.h < G->screen_size.h ? r.h : G->screen_size.h - r.y;
+            d->rects[d->rects_count++] = r;
+            d->pixels += r.w * r.h;
+        }
+    }
+}
+
+// Everything is damaged next frame, for when the screen was changed behind the draw queue's back
+void damage_invalidate() { G->damage.valid = false; }
+
+static bool damage_touches(i32 cmd, i32rect r) {
+    i32rect b = G->damage.bounds[cmd];
+    return b.x < r.x + r.w && r.x < b.x + b.w && b.y < r.y + r.h && r.y < b.y + b.h;
+}
+
+// Rasterizes the damaged rects only. With software_text, text is drawn too, like
+// render_text_queue does for the whole screen.
+void render_damage(bool software_text) {
+    Damage *d = &G->damage;
+    for (i32 i = 0; i < d->rects_count; i++) {
+        G->clip = d->rects[i];
+        for (i32 j = 0; j < G->draw_count; j++) {
+            if (damage_touches(j, G->clip)) render_cmd(G->draw_queue[j]);
+        }
+        for (i32 j = 0; software_text && j < G->draw_count; j++) {
+            DrawCmd next = G->draw_queue[j];
+            if (next.t == DCT_TEXT && damage_touches(j, G->clip))
+                render_text(next.text, next.x, next.y, next.color);
+        }
+    }
+    G->clip = (i32rect){0};
+}
+
+// Draw streams: captured frames of the draw queue in a self-contained binary format. Pointers are
+// replaced with offsets into a per-frame blob holding the vertices, edges and strings, so a stream
+// can be replayed without the game that produced it. Layout:
+//     DrawStreamHeader
+//     per frame: DrawStreamFrame, DrawStreamCmd[cmds_count], blob[blob_size]
+#define DRAW_STREAM_MAGIC 0x4D525344 // "DSRM"
+#define DRAW_STREAM_VERSION 2
+
+typedef struct {
+    u32 magic, version;
+    v2i screen_size;
+    i32 frames;
+} DrawStreamHeader;
+
+typedef struct {
+    i32 cmds_count, blob_size;
+} DrawStreamFrame;
+
+typedef struct {
+    u32   t;
+    col32 color;
+
+    union {
+        struct { // text, offset of a NUL terminated string
+            i32 text, x, y;
+        };
+
+        struct { // rect
+            rect r;
+        };
+
+        struct { // line
+            v2 from, to;
+        };
+
+        struct { // mesh, offsets of the vertex and edge arrays
+            i32 vertices, count, edges, edges_count;
+        };
+
+        struct { // tiles, offsets of the ids and colors
+            i32 ids, colors, colors_count, tile;
+            v2i window, corner;
+        };
+    };
+} DrawStreamCmd;
+
+typedef struct {
+    u8 *data;
+    i32 len, cap;
+} DrawStream;
+
+DrawStream draw_stream_new(i32 cap) {
+    DrawStream result = {.data = alloc_perm(cap), .cap = cap, .len = sizeof(DrawStreamHeader)};
+    *(DrawStreamHeader *)result.data = (DrawStreamHeader){
+        .magic       = DRAW_STREAM_MAGIC,
+        .version     = DRAW_STREAM_VERSION,
+        .screen_size = G->screen_size,
+    };
+    return result;
+}
+
+// Copies into the blob at *at, keeping 4 byte alignment. Returns the offset from blob_start, or -1
+// when the stream is full.
+static i32 draw_stream_copy(DrawStream *s, i32 *at, i32 blob_start, void *src, i32 size) {
+    i32 padded = (size + 3) & ~3;
+    if (*at + padded > s->cap) return -1;
+
+    memcpy(s->data + *at, src, size);
+    memset(s->data + *at + size, 0, padded - size);
+
+    i32 result = *at - blob_start;
+    *at += padded;
+    return result;
+}
+
+// Appends the current draw queue as a new frame. Returns false and drops the frame when the
+// stream is out of space.
+bool draw_stream_capture(DrawStream *s) {
+    DrawStreamHeader *header = (DrawStreamHeader *)s->data;
+
+    i32 cmds_start = s->len + sizeof(DrawStreamFrame);
+    i32 blob_start = cmds_start + sizeof(DrawStreamCmd) * G->draw_count;
+    if (blob_start > s->cap) return false;
+
+    DrawStreamFrame *frame = (DrawStreamFrame *)(s->data + s->len);
+    DrawStreamCmd   *cmds  = (DrawStreamCmd *)(s->data + cmds_start);
+    i32              at    = blob_start;
+
+    for (i32 i = 0; i < G->draw_count; i++) {
+        DrawCmd next = G->draw_queue[i];
+
+        // A cached layer is stored as the tiles it shows, the stream doesn't keep any pixels
+        if (next.t == DCT_LAYER) {
+            v2i     scroll = next.scroll;
+            i32rect view   = {scroll.x, scroll.y, G->screen_size.w, G->screen_size.h};
+            tile_window(&next.cache->layer, view, scroll, &next);
+        }
+
+        DrawStreamCmd *out = &cmds[i];
+        *out               = (DrawStreamCmd){.t = next.t, .color = next.color};
+
+        switch (next.t) {
+        case DCT_TEXT: {
+            out->x    = next.x;
+            out->y    = next.y;
+            out->text = draw_stream_copy(s, &at, blob_start, next.text, (i32)strlen(next.text) + 1);
+            if (out->text == -1) return false;
+            break;
+        }
+        case DCT_RECT:
+        case DCT_RECT_OUTLINE: out->r = next.r; break;
+        case DCT_LINE: {
+            out->from = next.from;
+            out->to   = next.to;
+            break;
+        }
+        case DCT_MESH: {
+            out->count       = next.count;
+            out->edges_count = next.edges_count;
+
+            // Meshes usually share their edges, only store each array once per frame
+            out->vertices = out->edges = -1;
+            for (i32 j = 0; j < i; j++) {
+                DrawCmd prev = G->draw_queue[j];
+                if (prev.t != DCT_MESH) continue;
+                if (prev.vertices == next.vertices && prev.count == next.count)
+                    out->vertices = cmds[j].vertices;
+                if (prev.edges == next.edges && prev.edges_count == next.edges_count)
+                    out->edges = cmds[j].edges;
+            }
+
+            i32 verts_size = sizeof(v3) * next.count;
+            i32 edges_size = sizeof(v2i) * next.edges_count;
+            if (out->vertices == -1)
+                out->vertices = draw_stream_copy(s, &at, blob_start, next.vertices, verts_size);
+            if (out->edges == -1)
+                out->edges = draw_stream_copy(s, &at, blob_start, next.edges, edges_size);
+            if (out->vertices == -1 || out->edges == -1) return false;
+            break;
+        }
+        case DCT_TILES: {
+            out->colors_count = next.colors_count;
+            out->tile         = next.tile;
+            out->window       = next.window;
+            out->corner       = next.corner;
+
+            i32 ids_size    = next.window.w * next.window.h;
+            i32 colors_size = sizeof(col32) * next.colors_count;
+            out->ids        = draw_stream_copy(s, &at, blob_start, next.ids, ids_size);
+            out->colors     = draw_stream_copy(s, &at, blob_start, next.colors, colors_size);
+            if (out->ids == -1 || out->colors == -1) return false;
+            break;
+        }
+        default: break;
+        }
+    }
+
+    *frame = (DrawStreamFrame){.cmds_count = G->draw_count, .blob_size = at - blob_start};
+    s->len = at;
+    header->frames++;
+    return true;
+}
+
+bool draw_stream_save(DrawStream *s, char *path) {
+    return file_write_bytes(path, s->data, s->len) == s->len;
+}
+
+// Saves the stream and empties it for the next capture
+void draw_stream_finish(DrawStream *s, char *path) {
+    DrawStreamHeader *header = (DrawStreamHeader *)s->data;
+    if (draw_stream_save(s, path))
+        INFO("Captured %d frames to %s", header->frames, path);
+    else
+        ERR("Couldn't write %s", path);
+
+    s->len         = sizeof(DrawStreamHeader);
+    header->frames = 0;
+}
+
+DrawStream draw_stream_load(char *path) {
+    string file = file_read(path);
+    if (!file.text || file.len < sizeof(DrawStreamHeader)) return (DrawStream){0};
+
+    DrawStreamHeader *header = (DrawStreamHeader *)file.text;
+    if (header->magic != DRAW_STREAM_MAGIC || header->version != DRAW_STREAM_VERSION)
+        return (DrawStream){0};
+
+    return (DrawStream){.data = file.text, .len = file.len, .cap = file.len};
+}
+
+DrawStreamHeader *draw_stream_header(DrawStream *s) { return (DrawStreamHeader *)s->data; }
+
+// Iterates frames: pass NULL to get the first one. Returns NULL after the last frame, or when the
+// next frame would read past the end of the stream.
+DrawStreamFrame *draw_stream_next(DrawStream *s, DrawStreamFrame *frame) {
+    i32 at = sizeof(DrawStreamHeader);
+    if (frame) {
+        at = (i32)((u8 *)frame - s->data) + sizeof(DrawStreamFrame) +
+             sizeof(DrawStreamCmd) * frame->cmds_count + frame->blob_size;
+    }
+    if (at + (i32)sizeof(DrawStreamFrame) > s->len) return NULL;
+
+    DrawStreamFrame *result = (DrawStreamFrame *)(s->data + at);
+    if (result->cmds_count < 0 || result->blob_size < 0) return NULL;
+
+    i64 size = sizeof(DrawStreamFrame) + sizeof(DrawStreamCmd) * (i64)result->cmds_count +
+               result->blob_size;
+    if (at + size > s->len) return NULL;
+    return result;
+}
+
+static bool draw_stream_in_blob(DrawStreamFrame *frame, i32 offset, i64 size) {
+    return offset >= 0 && size >= 0 && offset + size <= frame->blob_size;
+}
+
+// Edges index the mesh's own vertices
+static bool draw_stream_edges_valid(v2i *edges, i32 edges_count, i32 count) {
+    for (i32 i = 0; i < edges_count; i++) {
+        if (edges[i].from < 0 || edges[i].from >= count || edges[i].to < 0 || edges[i].to >= count)
+            return false;
+    }
+    return true;
+}
+
+// Refills the draw queue from a captured frame, pointing into the stream's memory. Commands
+// referencing data outside their frame are skipped.
+void draw_stream_replay(DrawStreamFrame *frame) {
+    DrawStreamCmd *cmds = (DrawStreamCmd *)(frame + 1);
+    u8            *blob = (u8 *)(cmds + frame->cmds_count);
+
+    G->draw_count = 0;
+    for (i32 i = 0; i < frame->cmds_count && G->draw_count < G->draw_size; i++) {
+        DrawStreamCmd next = cmds[i];
+        DrawCmd       cmd  = {.t = next.t, .color = next.color};
+
+        switch (next.t) {
+        case DCT_TEXT: {
+            // Strings are read up to their NUL, which has to be in the blob too
+            if (!draw_stream_in_blob(frame, next.text, 1) ||
+                !memchr(blob + next.text, 0, frame->blob_size - next.text))
+                continue;
+            cmd.text = (char *)blob + next.text;
+            cmd.x    = next.x;
+            cmd.y    = next.y;
+            break;
+        }
+        case DCT_RECT:
+        case DCT_RECT_OUTLINE: cmd.r = next.r; break;
+        case DCT_LINE: {
+            cmd.from = next.from;
+            cmd.to   = next.to;
+            break;
+        }
+        case DCT_MESH: {
+            if (!draw_stream_in_blob(frame, next.vertices, sizeof(v3) * (i64)next.count) ||
+                !draw_stream_in_blob(frame, next.edges, sizeof(v2i) * (i64)next.edges_count) ||
+                !draw_stream_edges_valid((v2i *)(blob + next.edges), next.edges_count, next.count))
+                continue;
+            cmd.vertices    = (v3 *)(blob + next.vertices);
+            cmd.count       = next.count;
+            cmd.edges       = (v2i *)(blob + next.edges);
+            cmd.edges_count = next.edges_count;
+            break;
+        }
+        case DCT_TILES: {
+            if (next.window.w < 0 || next.window.h < 0 || next.colors_count < 0 ||
+                !draw_stream_in_blob(frame, next.ids, (i64)next.window.w * next.window.h) ||
+                !draw_stream_in_blob(frame, next.colors, sizeof(col32) * (i64)next.colors_count))
+                continue;
+            cmd.ids          = blob + next.ids;
+            cmd.colors       = (col32 *)(blob + next.colors);
+            cmd.colors_count = next.colors_count;
+            cmd.tile         = next.tile;
+            cmd.window       = next.window;
+            cmd.corner       = next.corner;
+            break;
+        }
+        default: continue;
+        }
+
+        G->draw_queue[G->draw_count++] = cmd;
+    }
+}
+
+// Input recordings: the dt and input events of every frame, to run a session again. The game only
+// gets input through the ring and time through game_frame, and its math is fixed point, so a
+// replay is bit-identical where ReadOSTimer has the frequency it was recorded with. Layout:
+//     InputRecordHeader
+//     per frame: InputRecordFrame, InputRecordEvent[events + late]
+#define INPUT_RECORD_MAGIC 0x43455249 // "IREC"
+#define INPUT_RECORD_VERSION 1
+
+typedef struct {
+    u32 magic, version;
+    u64 timer_freq; // Event ages are in ticks of it
+    i32 frames;
+} InputRecordHeader;
+
+typedef struct {
+    f64 dt;
+    u16 events, late; // The late events came in while latching and follow the frame's
+} InputRecordFrame;
+
+typedef struct {
+    u32 age;  // Ticks from the event until the view it was in was taken
+    i16 x, y; // Mouse moves, in window pixels
+    u8  t, key;
+} InputRecordEvent;
+
+typedef struct InputRecording {
+    u8 *data;
+    i32 len, cap;
+    i32 at;               // Of the next frame to replay
+    i32 late, late_count; // Offset and count of the late events of the frame being replayed
+    i32 carry;            // Late events recorded last frame, which the ring gives this frame again
+    u64 clock;            // Replaces ReadOSTimer for input views while replaying
+} InputRecording;
+
+InputRecording input_record_new(i32 cap) {
+    InputRecording result = {
+        .data = alloc_perm(cap),
+        .cap  = cap,
+        .len  = sizeof(InputRecordHeader),
+    };
+    *(InputRecordHeader *)result.data = (InputRecordHeader){
+        .magic      = INPUT_RECORD_MAGIC,
+        .version    = INPUT_RECORD_VERSION,
+        .timer_freq = GetOSTimerFreq(),
+    };
+    return result;
+}
+
+static void input_record_events(InputRecordEvent *dst, InputView view, i32 first) {
+    for (i32 i = first; i < view.count; i++) {
+        InputEvent e   = view.events[i];
+        u64        age = view.time - e.time;
+
+        dst[i - first] = (InputRecordEvent){
+            .age = age < 0xFFFFFFFF ? (u32)age : 0xFFFFFFFF,
+            .x   = (i16)q8_to_i32(e.pos.x),
+            .y   = (i16)q8_to_i32(e.pos.y),
+            .t   = (u8)e.t,
+            .key = (u8)e.key,
+        };
+    }
+}
+
+// Appends the frame that just ran with dt, after input_latch. Returns false and drops the frame
+// when the recording is full.
+bool input_record_frame(InputRecording *r, f64 dt) {
+    i32 carry  = r->carry < G->input.count ? r->carry : G->input.count;
+    i32 events = G->input.count - carry, late = G->input_late.count;
+    i32 size   = sizeof(InputRecordFrame) + sizeof(InputRecordEvent) * (events + late);
+    if (r->len + size > r->cap || events > 0xFFFF || late > 0xFFFF) return false;
+
+    InputRecordFrame *frame = (InputRecordFrame *)(r->data + r->len);
+    *frame = (InputRecordFrame){.dt = dt, .events = (u16)events, .late = (u16)late};
+
+    InputRecordEvent *dst = (InputRecordEvent *)(frame + 1);
+    input_record_events(dst, G->input, carry);
+    input_record_events(dst + events, G->input_late, 0);
+
+    r->carry = late;
+    r->len += size;
+    ((InputRecordHeader *)r->data)->frames++;
+    return true;
+}
+
+// Saves the recording and empties it for the next one
+void input_record_finish(InputRecording *r, char *path) {
+    InputRecordHeader *header = (InputRecordHeader *)r->data;
+    if (file_write_bytes(path, r->data, r->len) == r->len)
+        INFO("Recorded input of %d frames to %s", header->frames, path);
+    else
+        ERR("Couldn't write %s", path);
+
+    r->len         = sizeof(InputRecordHeader);
+    r->carry       = 0;
+    header->frames = 0;
+}
+
+InputRecording input_record_load(char *path) {
+    string file = file_read(path);
+    if (!file.text || file.len < sizeof(InputRecordHeader)) return (InputRecording){0};
+
+    InputRecordHeader *header = (InputRecordHeader *)file.text;
+    if (header->magic != INPUT_RECORD_MAGIC || header->version != INPUT_RECORD_VERSION)
+        return (InputRecording){0};
+    if (header->timer_freq != GetOSTimerFreq())
+        WARN("%s was recorded with another timer frequency, replays may drift", path);
+
+    return (InputRecording){
+        .data = file.text,
+        .len  = file.len,
+        .cap  = file.len,
+        .at   = sizeof(InputRecordHeader),
+    };
+}
+
+static InputEvent input_replay_event(InputRecording *r, InputRecordEvent e) {
+    u64 freq = ((InputRecordHeader *)r->data)->timer_freq;
+    return (InputEvent){
+        .time = r->clock - e.age * GetOSTimerFreq() / freq,
+        .t    = e.t,
+        .key  = e.key,
+        .pos  = {Q8(e.x), Q8(e.y)},
+    };
+}
+
+// Starts replaying the next frame, before input_begin_frame: its events go in the ring instead of
+// the platform's and dt is the one it ran with. Returns false after the last frame.
+bool input_replay_frame(InputRecording *r, f64 *dt) {
+    if (r->at + (i32)sizeof(InputRecordFrame) > r->len) return false;
+
+    InputRecordFrame *frame = (InputRecordFrame *)(r->data + r->at);
+    i32 size = sizeof(InputRecordFrame) + sizeof(InputRecordEvent) * (frame->events + frame->late);
+    if (r->at + size > r->len) return false;
+
+    // Only the ages of events matter, the clock just keeps time like the real one would
+    G->input_replay = r;
+    r->clock += (u64)(frame->dt * (f64)GetOSTimerFreq());
+
+    InputRecordEvent *events = (InputRecordEvent *)(frame + 1);
+    for (i32 i = 0; i < frame->events; i++)
+        input_ring_push(input_replay_event(r, events[i]));
+
+    *dt           = frame->dt;
+    r->late       = r->at + sizeof(InputRecordFrame) + sizeof(InputRecordEvent) * frame->events;
+    r->late_count = frame->late;
+    r->at += size;
+    return true;
+}
+
+static u64 input_replay_clock() { return G->input_replay->clock; }
+
+// The events that came in while the replayed frame was made, see input_latch
+static void input_replay_late() {
+    InputRecording   *r      = G->input_replay;
+    InputRecordEvent *events = (InputRecordEvent *)(r->data + r->late);
+    for (i32 i = 0; i < r->late_count; i++)
+        input_ring_push(input_replay_event(r, events[i]));
+}
+
+// Tilemap files: a TilemapHeader padded to one chunk, then the ids of every chunk in the order
+// Tilemap keeps them. Solid bits aren't stored, they follow from solid_ids as chunks load.
+#define TILEMAP_MAGIC 0x50414D54 // "TMAP"
+#define TILEMAP_VERSION 1
+#define TILE_CHUNK_BYTES (TILE_CHUNK * TILE_CHUNK)
+
+typedef struct {
+    u32 magic, version;
+    v2i size;
+    q8  tile_size;
+    u32 solid_ids[8];
+} TilemapHeader;
+
+// Only maps with every chunk in memory can be saved
+bool tilemap_save(Tilemap *tm, char *path) {
+    if (tm->chunk_slot) return false;
+
+    u8             block[TILE_CHUNK_BYTES] = {0};
+    TilemapHeader *header                  = (TilemapHeader *)block;
+
+    header->magic     = TILEMAP_MAGIC;
+    header->version   = TILEMAP_VERSION;
+    header->size      = tm->size;
+    header->tile_size = tm->tile_size;
+    for (i32 i = 0; i < 8; i++) {
+        header->solid_ids[i] = tm->solid_ids[i];
+    }
+
+    i32 ids_len = tm->chunks_w * tm->chunks_h * TILE_CHUNK_BYTES;
+    if (file_write_bytes(path, block, sizeof(block)) != sizeof(block)) return false;
+    return file_append_bytes(path, tm->ids, ids_len) == ids_len;
+}
+
+// Keeps the chunks of a mapped tilemap file that are around a view resident, in a fixed number of
+// slots. Chunks the view needs are loaded before tilestream_update returns, so what the game sees
+// never depends on the disk. Chunks ahead of the camera's motion are prefetched: the OS is asked
+// for their pages one frame and a few are copied in every frame after, by when the reads have
+// usually landed. When every slot is taken the least recently needed chunk is evicted.
+//
+// The copies run on the calling thread. A loader thread started from game.c would be left running
+// freed code after a hot reload, while the OS reads in the background regardless.
+#define TILESTREAM_LOOKAHEAD 30 // Frames of the camera's current motion to prefetch for
+#define TILESTREAM_LOADS 4      // Prefetched chunks copied in per frame
+
+typedef struct {
+    Tilemap map;
+    u8     *file;
+    i64     file_size;
+    i32    *slot_chunk; // -1 for free slots
+    u64    *slot_used;  // Last frame a slot's chunk was in or ahead of the view
+    u64     frame;
+    i32rect ahead; // Chunks prefetched last frame
+    i32     loads, evictions;
+    i32     misses; // Loads the view waited on, because prefetching didn't get to them
+} TileStream;
+
+// Nothing in a file's header is used before it's checked here. Tile indices are i32 with the chunk
+// in the high bits, which bounds how many chunks a map can have.
+#define TILEMAP_MAX_CHUNKS (1 << (30 - 2 * TILE_CHUNK_SHIFT))
+
+static bool tilemap_header_valid(TilemapHeader *header, i64 size) {
+    if (size < TILE_CHUNK_BYTES) return false; // The header is padded to one chunk
+    if (header->magic != TILEMAP_MAGIC || header->version != TILEMAP_VERSION) return false;
+    if (header->size.w <= 0 || header->size.h <= 0) return false;
+    // Same rule as tilemap_new, and draw_tiles needs tiles at least a pixel wide
+    q8 tile = header->tile_size;
+    if (tile < Q8(1) || (tile & (tile - 1))) return false;
+
+    i64 chunks_w = ((i64)header->size.w + TILE_CHUNK - 1) >> TILE_CHUNK_SHIFT;
+    i64 chunks_h = ((i64)header->size.h + TILE_CHUNK - 1) >> TILE_CHUNK_SHIFT;
+    i64 chunks   = chunks_w * chunks_h;
+    return chunks <= TILEMAP_MAX_CHUNKS && size >= (1 + chunks) * TILE_CHUNK_BYTES;
+}
+
+// slots is how many chunks stay in memory at once, it has to cover the view
+bool tilestream_open(TileStream *s, char *path, i32 slots, Arena *a) {
+    i64 size = 0;
+    u8 *file = file_map(path, &size);
+    if (!file) return false;
+
+    TilemapHeader *header = (TilemapHeader *)file;
+    if (!tilemap_header_valid(header, size)) {
+        ERR("%s is not a tilemap file", path);
+        file_unmap(file, size);
+        return false;
+    }
+    i32 chunks_w = (header->size.w + TILE_CHUNK - 1) >> TILE_CHUNK_SHIFT;
+    i32 chunks_h = (header->size.h + TILE_CHUNK - 1) >> TILE_CHUNK_SHIFT;
+
+    // Slot 0 is the empty chunk every unloaded one points at
+    i32     cap = slots + 1;
+    Tilemap map = {
+        .size       = header->size,
+        .chunks_w   = chunks_w,
+        .chunks_h   = chunks_h,
+        .ids        = alloc(cap * TILE_CHUNK_BYTES, a),
+        .solid      = (u32 *)alloc(sizeof(u32) * cap * TILE_CHUNK, a),
+        .tile_size  = header->tile_size,
+        .tile_shift = msb_u32((u32)header->tile_size),
+        .chunks_cap = cap,
+        .chunk_slot = (i32 *)alloc(sizeof(i32) * chunks_w * chunks_h, a),
+    };
+    *s = (TileStream){
+        .map        = map,
+        .file       = file,
+        .file_size  = size,
+        .slot_chunk = (i32 *)alloc(sizeof(i32) * cap, a),
+        .slot_used  = (u64 *)alloc(sizeof(u64) * cap, a),
+    };
+    for (i32 i = 0; i < 8; i++) {
+        s->map.solid_ids[i] = header->solid_ids[i];
+    }
+    for (i32 i = 0; i < cap * TILE_CHUNK_BYTES; i++) {
+        s->map.ids[i] = 0;
+    }
+    for (i32 i = 0; i < cap * TILE_CHUNK; i++) {
+        s->map.solid[i] = 0;
+    }
+    for (i32 i = 0; i < chunks_w * chunks_h; i++) {
+        s->map.chunk_slot[i] = 0;
+    }
+    for (i32 i = 0; i < cap; i++) {
+        s->slot_chunk[i] = -1;
+        s->slot_used[i]  = 0;
+    }
+    return true;
+}
+
+// Maps the file again for a stream restored from a snapshot, see game_start. The slots are emptied
+// in case the file changed since, the next update loads what the view needs.
+bool tilestream_reopen(TileStream *s, char *path) {
+    i64 size = 0;
+    u8 *file = file_map(path, &size);
+    if (!file) return false;
+
+    TilemapHeader *header = (TilemapHeader *)file;
+    if (size != s->file_size || !tilemap_header_valid(header, size) ||
+        header->size.w != s->map.size.w || header->size.h != s->map.size.h ||
+        header->tile_size != s->map.tile_size) {
+        file_unmap(file, size);
+        return false;
+    }
+
+    s->file  = file;
+    s->ahead = (i32rect){0};
+    for (i32 i = 0; i < s->map.chunks_w * s->map.chunks_h; i++) {
+        s->map.chunk_slot[i] = 0;
+    }
+    for (i32 i = 0; i < s->map.chunks_cap; i++) {
+        s->slot_chunk[i] = -1;
+        s->slot_used[i]  = 0;
+    }
+    return true;
+}
+
+void tilestream_close(TileStream *s) {
+    if (s->file) file_unmap(s->file, s->file_size);
+    s->file = NULL;
+}
+
+// A free slot, or the least recently used one not needed this frame. -1 when there is none.
+static i32 tilestream_slot(TileStream *s) {
+    i32 result = -1;
+    for (i32 i = 1; i < s->map.chunks_cap; i++) {
+        if (s->slot_chunk[i] == -1) return i;
+        if (s->slot_used[i] == s->frame) continue;
+        if (result == -1 || s->slot_used[i] < s->slot_used[result]) result = i;
+    }
+    return result;
+}
+
+static bool tilestream_load(TileStream *s, i32 chunk) {
+    if (s->map.chunk_slot[chunk]) return true;
+
+    i32 slot = tilestream_slot(s);
+    if (slot == -1) return false;
+    if (s->slot_chunk[slot] != -1) {
+        s->map.chunk_slot[s->slot_chunk[slot]] = 0;
+        s->evictions++;
+    }
+
+    u8  *src   = s->file + (i64)(1 + chunk) * TILE_CHUNK_BYTES;
+    u8  *ids   = s->map.ids + slot * TILE_CHUNK_BYTES;
+    u32 *solid = s->map.solid + slot * TILE_CHUNK;
+    for (i32 i = 0; i < TILE_CHUNK_BYTES; i++) {
+        ids[i] = src[i];
+    }
+    for (i32 y = 0; y < TILE_CHUNK; y++) {
+        u32 bits = 0;
+        for (i32 x = 0; x < TILE_CHUNK; x++) {
+            bits |= (u32)tilemap_id_solid(&s->map, ids[y * TILE_CHUNK + x]) << x;
+        }
+        solid[y] = bits;
+    }
+
+    s->slot_chunk[slot]      = chunk;
+    s->map.chunk_slot[chunk] = slot;
+    s->loads++;
+    return true;
+}
+
+// Chunks under a world space rect, clipped to the map
+static i32rect tilestream_chunks(TileStream *s, rect r) {
+    i32rect tiles = tilemap_tiles(&s->map, r);
+    i32     x0    = tiles.x >> TILE_CHUNK_SHIFT;
+    i32     y0    = tiles.y >> TILE_CHUNK_SHIFT;
+    i32     x1    = (tiles.x + tiles.w - 1) >> TILE_CHUNK_SHIFT;
+    i32     y1    = (tiles.y + tiles.h - 1) >> TILE_CHUNK_SHIFT;
+
+    x0 = x0 > 0 ? x0 : 0;
+    y0 = y0 > 0 ? y0 : 0;
+    x1 = x1 < s->map.chunks_w - 1 ? x1 : s->map.chunks_w - 1;
+    y1 = y1 < s->map.chunks_h - 1 ? y1 : s->map.chunks_h - 1;
+    return (i32rect){x0, y0, x1 - x0 + 1, y1 - y0 + 1};
+}
+
+static inline bool tilestream_in(i32rect chunks, i32 cx, i32 cy) {
+    return cx >= chunks.x && cx < chunks.x + chunks.w && cy >= chunks.y && cy < chunks.y + chunks.h;
+}
+
+// Call once per frame with the world space view and how far the camera moved since the last one
+void tilestream_update(TileStream *s, rect view, v2 motion) {
+    if (!s->file) return;
+    s->frame++;
+
+    i32rect need = tilestream_chunks(s, view);
+    for (i32 cy = need.y; cy < need.y + need.h; cy++) {
+        for (i32 cx = need.x; cx < need.x + need.w; cx++) {
+            i32 chunk = cy * s->map.chunks_w + cx;
+            if (!s->map.chunk_slot[chunk]) s->misses++;
+            if (!tilestream_load(s, chunk))
+                FATAL("Tile stream has %d slots, the view needs %d", s->map.chunks_cap - 1,
+                      need.w * need.h);
+            s->slot_used[s->map.chunk_slot[chunk]] = s->frame;
+        }
+    }
+
+    // The view now, where it will be after the lookahead, and everything between
+    rect future = view;
+    future.x += motion.x * TILESTREAM_LOOKAHEAD;
+    future.y += motion.y * TILESTREAM_LOOKAHEAD;
+    rect path = {
+        view.x < future.x ? view.x : future.x,
+        view.y < future.y ? view.y : future.y,
+        view.w + (motion.x < 0 ? -motion.x : motion.x) * TILESTREAM_LOOKAHEAD,
+        view.h + (motion.y < 0 ? -motion.y : motion.y) * TILESTREAM_LOOKAHEAD,
+    };
+    i32rect ahead = tilestream_chunks(s, path);
+
+    // Copies in what was asked for last frame and keeps what's already here from being evicted
+    i32 loads = 0;
+    for (i32 cy = ahead.y; cy < ahead.y + ahead.h; cy++) {
+        for (i32 cx = ahead.x; cx < ahead.x + ahead.w; cx++) {
+            i32 chunk = cy * s->map.chunks_w + cx;
+            if (!s->map.chunk_slot[chunk]) {
+                if (loads == TILESTREAM_LOADS || !tilestream_in(s->ahead, cx, cy)) continue;
+                if (!tilestream_load(s, chunk)) continue;
+                loads++;
+            }
+            s->slot_used[s->map.chunk_slot[chunk]] = s->frame;
+        }
+    }
+
+    // Chunks in a row are adjacent in the file, so each row is one request
+    if (ahead.x != s->ahead.x || ahead.y != s->ahead.y || ahead.w != s->ahead.w ||
+        ahead.h != s->ahead.h) {
+        for (i32 cy = ahead.y; cy < ahead.y + ahead.h; cy++) {
+            i64 first = 1 + (i64)cy * s->map.chunks_w + ahead.x;
+            file_prefetch(s->file + first * TILE_CHUNK_BYTES, (i64)ahead.w * TILE_CHUNK_BYTES);
+        }
+    }
+    s->ahead = ahead;
+}
+
+// Snapshots: Data and everything after it in the perm arena, which is all init leaves behind. The
+// arena is at PERM_BASE, so the pointers in there hold in a later run and restoring is one copy.
+// What lives outside the arena, like mapped files or the game's statics, is up to its restore.
+// Layout:
+//     SnapshotHeader
+//     the perm arena from start to used
+#define SNAPSHOT_MAGIC 0x50414E53  // "SNAP"
+#define SNAPSHOT_VERSION 1
+#define PERM_BASE 0x20000000000ull // 2TB, clear of where either OS maps things on its own
+
+typedef struct {
+    u32  magic, version;
+    u64  base;        // Of the perm arena
+    i32  start, used; // In the perm arena, start is where Data is
+    char build[112];  // Of the game and engine that saved it, see snapshot_header
+} SnapshotHeader;
+
+static SnapshotHeader snapshot_header(cstr build) {
+    Arena         *perm   = &ctx()->perm;
+    SnapshotHeader result = {
+        .magic   = SNAPSHOT_MAGIC,
+        .version = SNAPSHOT_VERSION,
+        .base    = (u64)perm->data,
+        .start   = (i32)(G->game_memory - (u8 *)perm->data),
+        .used    = perm->used,
+    };
+    char *text = string_format(&ctx()->temp, "%s %s %s %d %d", G->game.info->name,
+                               G->game.info->version, build, G->game.gamedata_size(),
+                               (i32)sizeof(EngineData));
+    strncpy(result.build, text, sizeof(result.build) - 1);
+    return result;
+}
+
+bool snapshot_save(char *path, cstr build) {
+    SnapshotHeader header = snapshot_header(build);
+    i32            size   = header.used - header.start;
+    return file_write_bytes(path, (u8 *)&header, sizeof(header)) == sizeof(header) &&
+           file_append_bytes(path, G->game_memory, size) == size;
+}
+
+// Only into the arena layout and build it was saved from, right after game_memory was allocated
+bool snapshot_restore(char *path, cstr build) {
+    i64 size = 0;
+    u8 *file = file_map(path, &size);
+    if (!file) return false;
+
+    SnapshotHeader *header = (SnapshotHeader *)file;
+    SnapshotHeader  want   = snapshot_header(build);
+
+    bool valid = size >= sizeof(SnapshotHeader) && header->magic == want.magic &&
+                 header->version == want.version && header->base == want.base &&
+                 header->start == want.start && header->used <= ctx()->perm.cap &&
+                 size == sizeof(SnapshotHeader) + header->used - header->start &&
+                 strcmp(header->build, want.build) == 0;
+    if (valid) {
+        memcpy(G->game_memory, file + sizeof(SnapshotHeader), header->used - header->start);
+        ctx()->perm.used = header->used;
+    }
+
+    file_unmap(file, size);
+    return valid;
+}
+
+// Runs init, or restores Info.snapshot when it was saved by this build, then calls the game's
+// restore to fix up the rest. Call right after allocating game_memory, anything the engine
+// allocates before the game starts has to come first. build tells builds of the game apart.
+void game_start(cstr build) {
+    cstr path = G->game.info->snapshot;
+    if (path && snapshot_restore((char *)path, build)) {
+        if (!G->game.restore || G->game.restore()) {
+            INFO("Restored %s", path);
+            return;
+        }
+
+        // Back to how the arena was, init gets zeroed memory like the first time
+        WARN("Couldn't restore %s, running init", path);
+        i32 start = (i32)(G->game_memory - (u8 *)ctx()->perm.data);
+        memset(G->game_memory, 0, ctx()->perm.used - start);
+        ctx()->perm.used = start + G->game.gamedata_size();
+    }
+
+    if (G->game.init) G->game.init();
+    if (path && !snapshot_save((char *)path, build)) ERR("Couldn't write %s", path);
+}
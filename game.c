@@ -1,11 +1,19 @@
+#ifdef _WIN32
 #include "base_win.c"
+#else
+#include "base_linux.c"
+#endif
 
 export Info game = {
-    .name    = "Handmade Renderer",
-    .version = "0.1.0",
+    .name     = "Handmade Renderer",
+    .version  = "0.1.0",
+    .idle     = true,
+    .sim_hz   = 120,
+    .snapshot = "game.snap",
 };
 
 #define ENTITY_MAX 1
+#define LEVEL_PATH "level.tmap"
 
 typedef struct {
     i32   id;
@@ -15,21 +23,38 @@ typedef struct {
 } Entity;
 
 struct Data {
-    v3    camera_pos;
+    v3    camera_pos, prev_camera_pos; // prev_* are as of the step before the last, for render
+    v2    last_camera;
     col32 fg, bg, text_light, text_dark;
     col32 solid_tiles[4];
-
-    handle level_mark;
-    m3    *obj_transform;
-    Mesh  *obj_mesh;
-    v2i    tilemap_size;
-    u8   **tilemap;
-    q8     tile_size;
+    col32 backdrop_tiles[2];
+
+    handle     level_mark;
+    m3        *obj_transform;
+    fx        *prev_obj_rot;
+    Mesh      *obj_mesh;
+    bool       obj_spin; // Toggled with S, the window only idles while nothing moves
+    TileStream level;
+    Tilemap    backdrop;
+    TileCache  backdrop_layer;
+
+    // What render queued, for latch to move
+    u32  backdrop_cmd, world_last;
+    v3 **obj_trans;
 };
 
+static void level_generate(Tilemap *tm) {
+    for (i32 y = 0; y < tm->size.y; y++) {
+        for (i32 x = 0; x < tm->size.x; x++) {
+            tilemap_set(tm, x, y, (x + y) % 4);
+        }
+    }
+}
+
 export void init() {
     *data = (Data){
         .obj_mesh   = &cube,
+        .obj_spin   = true,
         .fg         = rgb(110, 124, 205),
         .bg         = rgb(51, 45, 116),
         .text_light = rgb(230, 240, 250),
@@ -41,75 +66,124 @@ export void init() {
                 rgb(128, 128, 0),
                 rgb(0, 0, 128),
             },
-        .tile_size    = Q8(32),
-        .tilemap_size = (v2i){64, 64},
+        .backdrop_tiles = {rgb(51, 45, 116), rgb(61, 55, 136)},
     };
 
     data->level_mark    = arena_mark(&ctx()->perm);
     data->obj_transform = ALLOC_ARRAY(m3, ENTITY_MAX);
+    data->prev_obj_rot  = ALLOC_ARRAY(fx, ENTITY_MAX);
 
     for (i32 i = 0; i < ENTITY_MAX; i++) {
         data->obj_transform[i]       = m3_id;
-        data->obj_transform[i].pos   = (v3){Q8((i % 5) - 2), Q8(0), Q8((i / 5) - 2)};
-        data->obj_transform[i].scale = (v3){Q8(1) >> 1, Q8(1) >> 1, Q8(1) >> 1};
+        data->obj_transform[i].pos   = (v3){FX((i % 5) - 2), FX(0), FX((i / 5) - 2)};
+        data->obj_transform[i].scale = (v3){FX(1) >> 1, FX(1) >> 1, FX(1) >> 1};
     }
 
     data->obj_transform[0]       = m3_id;
-    data->obj_transform[0].pos   = (v3){0, 0, Q8(1)};
-    data->obj_transform[0].scale = (v3){Q8(1) >> 1, Q8(1) >> 1, Q8(1) >> 1};
-
-    data->tilemap = ALLOC_ARRAY(u8 *, data->tilemap_size.y);
-    for (i32 i = 0; i < data->tilemap_size.y; i++) {
-        data->tilemap[i] = ALLOC_ARRAY(u8, data->tilemap_size.x);
-    }
-
-    for (i32 y = 0; y < data->tilemap_size.y; y++) {
-        for (i32 x = 0; x < data->tilemap_size.x; x++) {
-            data->tilemap[y][x] = (x + y) % 4;
+    data->obj_transform[0].pos   = (v3){0, 0, FX(1)};
+    data->obj_transform[0].scale = (v3){FX(1) >> 1, FX(1) >> 1, FX(1) >> 1};
+
+    // The level is streamed from disk, and generated on the first run. Without a file to save to
+    // it stays in memory.
+    if (!tilestream_open(&data->level, LEVEL_PATH, 16, &ctx()->perm)) {
+        handle  mark = arena_mark(&ctx()->temp);
+        Tilemap tm   = tilemap_new((v2i){64, 64}, Q8(32), &ctx()->temp);
+        level_generate(&tm);
+
+        bool saved = tilemap_save(&tm, LEVEL_PATH);
+        arena_reset(&ctx()->temp, mark);
+        if (!saved || !tilestream_open(&data->level, LEVEL_PATH, 16, &ctx()->perm)) {
+            WARN("Couldn't save %s, keeping the level in memory", LEVEL_PATH);
+            data->level = (TileStream){.map = tilemap_new((v2i){64, 64}, Q8(32), &ctx()->perm)};
+            level_generate(&data->level.map);
         }
     }
+
+    data->backdrop = tilemap_new((v2i){2, 2}, Q8(64), &ctx()->perm);
+    tilemap_set(&data->backdrop, 1, 0, 1);
+    tilemap_set(&data->backdrop, 0, 1, 1);
+
+    // Opaque and it only ever scrolls, so it's kept rendered and presented with a copy. The level
+    // has transparent tiles, those are cheaper to draw again than to blend.
+    TileLayer backdrop   = {&data->backdrop, data->backdrop_tiles, 2, Q8(1) / 2, true};
+    data->backdrop_layer = tile_cache_new(backdrop, &ctx()->perm);
 }
 
-export void update(q8 dt) {
-    if (G->keys[K_UP] == KS_PRESSED) data->camera_pos.z -= dt;
-    if (G->keys[K_DOWN] == KS_PRESSED) data->camera_pos.z += dt;
-    if (G->keys[K_LEFT] == KS_PRESSED) data->camera_pos.x += dt;
-    if (G->keys[K_RIGHT] == KS_PRESSED) data->camera_pos.x -= dt;
-
-    for (i32 y = 0; y < G->screen_size.h / q8_to_i32(data->tile_size); y++) {
-        for (i32 x = 0; x < G->screen_size.w / q8_to_i32(data->tile_size); x++) {
-            i32 map_x = x % data->tilemap_size.x;
-            i32 map_y = y % data->tilemap_size.y;
-
-            u8 tile_id = data->tilemap[map_y][map_x];
-            draw_rect((rect){q8_mul(Q8(x), data->tile_size), q8_mul(Q8(y), data->tile_size),
-                             data->tile_size, data->tile_size},
-                      data->solid_tiles[tile_id]);
-        }
+// After game_start restored a snapshot of init, for what isn't in the perm arena: the mesh is a
+// static of this build and the level's file has to be mapped again
+export bool restore() {
+    data->obj_mesh = &cube;
+    return !data->level.file || tilestream_reopen(&data->level, LEVEL_PATH);
+}
+
+// Runs at Info.sim_hz, however fast frames are drawn
+export void simulate(q16 dt) {
+    fx step = fx_from_q16(dt);
+
+    data->prev_camera_pos = data->camera_pos;
+    if (G->keys[K_UP] == KS_PRESSED) data->camera_pos.z -= step;
+    if (G->keys[K_DOWN] == KS_PRESSED) data->camera_pos.z += step;
+    if (G->keys[K_LEFT] == KS_PRESSED) data->camera_pos.x += step;
+    if (G->keys[K_RIGHT] == KS_PRESSED) data->camera_pos.x -= step;
+
+    for (i32 i = 0; i < ENTITY_MAX; i++) {
+        data->prev_obj_rot[i] = data->obj_transform[i].rot.y;
+        if (!data->obj_spin) continue;
+
+        data->obj_transform[i].rot.y += fx_mul(FX_PI, step);
+        while (data->obj_transform[i].rot.y > FX_TAU)
+            data->obj_transform[i].rot.y -= FX_TAU;
+        while (data->obj_transform[i].rot.y < 0)
+            data->obj_transform[i].rot.y += FX_TAU;
     }
+}
+
+// Draws alpha of the way from the previous step to the last one
+export void render(q16 alpha) {
+    if (input_presses(K_S) & 1) data->obj_spin = !data->obj_spin;
+
+    // An idle game only gets frames without input while this is called, see Info.idle
+    bool moved = data->camera_pos.x != data->prev_camera_pos.x ||
+                 data->camera_pos.z != data->prev_camera_pos.z;
+    if (data->obj_spin || moved) keep_animating();
+
+    v3 camera_pos = v3_lerp(data->prev_camera_pos, data->camera_pos, alpha);
+
+    // 128 pixels per world unit, the last level color is left out so the backdrop shows through
+    v2 camera = {-fx_to_q8(camera_pos.x) * 128, fx_to_q8(camera_pos.z) * 128};
+    v2 motion = {camera.x - data->last_camera.x, camera.y - data->last_camera.y};
+    data->last_camera = camera;
+
+    TileLayer level = {&data->level.map, data->solid_tiles, 3, Q8(1), false};
+    tilestream_update(&data->level, tile_layer_view(&level, camera), motion);
+    data->backdrop_cmd = G->draw_count;
+    draw_tile_cache(&data->backdrop_layer, camera);
+    draw_tiles(&level, camera);
 
-    v3 **obj_trans = (v3 **)alloc_temp(sizeof(v3 *) * ENTITY_MAX);
+    v3 **obj_trans  = (v3 **)alloc_temp(sizeof(v3 *) * ENTITY_MAX);
+    data->obj_trans = obj_trans;
     for (i32 i = 0; i < ENTITY_MAX; i++) {
         obj_trans[i] = (v3 *)alloc_temp(sizeof(v3) * data->obj_mesh->verts_count);
     }
     for (i32 i = 0; i < ENTITY_MAX; i++) {
-        data->obj_transform[i].rot.y += q8_mul(Q8_PI, dt);
-        while (data->obj_transform[i].rot.y > Q8_TAU)
-            data->obj_transform[i].rot.y -= Q8_TAU;
-        while (data->obj_transform[i].rot.y < 0)
-            data->obj_transform[i].rot.y += Q8_TAU;
+        // The shorter way around, in case the last step wrapped
+        fx from = data->prev_obj_rot[i], to = data->obj_transform[i].rot.y;
+        if (to - from > FX_PI) from += FX_TAU;
+        if (from - to > FX_PI) to += FX_TAU;
+        fx rot = fx_lerp(from, to, alpha);
 
         for (i32 j = 0; j < data->obj_mesh->verts_count; j++) {
             obj_trans[i][j] = v3_add(
                 v3_add(v3_rotate_xz(v3_mul(data->obj_mesh->verts[j], data->obj_transform[i].scale),
-                                    data->obj_transform[i].rot.y),
+                                    rot),
                        data->obj_transform[i].pos),
-                data->camera_pos);
+                camera_pos);
         }
 
         draw_mesh(obj_trans[i], data->obj_mesh->verts_count, data->obj_mesh->edges,
                   data->obj_mesh->edges_count, rgb(255, 255, 255));
     }
+    data->world_last = G->draw_count;
 
     draw_text(string_format(&ctx()->temp, "Total memory used: %d KB", ctx()->perm.used / 1024), 10,
               10, data->text_light);
@@ -118,6 +192,42 @@ export void update(q8 dt) {
               10, 30, data->text_light);
 }
 
+// Arrow keys that went down or up after simulate looked at them move the camera right away, by how
+// far it went since. The next steps take over from there.
+export void latch() {
+    InputView late = G->input_late;
+    bool      held[K_COUNT];
+    v3        lead = {0};
+    for (i32 i = 0; i < K_COUNT; i++)
+        held[i] = G->keys[i] == KS_PRESSED || G->keys[i] == KS_JUST_PRESSED;
+
+    for (i32 i = 0; i < late.count; i++) {
+        InputEvent *e = &late.events[i];
+        if (e->t == IE_MOUSE_MOVE || held[e->key] == (e->t == IE_KEY_DOWN)) continue; // Repeats
+        held[e->key] = e->t == IE_KEY_DOWN;
+
+        // One world unit per second, like simulate
+        f64 since = (f64)(late.time - e->time) / (f64)GetOSTimerFreq();
+        fx  dist  = (fx)(since * (f64)FX(1));
+        if (e->t == IE_KEY_UP) dist = -dist;
+
+        if (e->key == K_UP) lead.z -= dist;
+        if (e->key == K_DOWN) lead.z += dist;
+        if (e->key == K_LEFT) lead.x += dist;
+        if (e->key == K_RIGHT) lead.x -= dist;
+    }
+    if (!lead.x && !lead.z) return;
+
+    // 128 pixels per world unit as in render, and the backdrop moves at half the speed
+    v2i offset = {fx_to_q8(lead.x) * 128 >> 8, -fx_to_q8(lead.z) * 128 >> 8};
+    draw_shift(data->backdrop_cmd, data->backdrop_cmd + 1, (v2i){offset.x / 2, offset.y / 2});
+    draw_shift(data->backdrop_cmd + 1, data->world_last, offset);
+    for (i32 i = 0; i < ENTITY_MAX; i++) {
+        for (i32 j = 0; j < data->obj_mesh->verts_count; j++)
+            data->obj_trans[i][j] = v3_add(data->obj_trans[i][j], lead);
+    }
+}
+
 export void quit() {}
 
 #include "hot_reload.c"
\ No newline at end of file
@@ -16,6 +16,9 @@ static GameDLL load_dll() {
     tcc_set_error_func(result.tcc, NULL, tcc_err);
 
     tcc_add_include_path(result.tcc, "include/winapi");
+#ifdef FX_Q16
+    tcc_define_symbol(result.tcc, "FX_Q16", NULL); // game.c has to agree with the engine on fx
+#endif
     tcc_add_library_path(result.tcc, "lib");
     tcc_add_library(result.tcc, "msvcrt");
     tcc_add_library(result.tcc, "kernel32");
@@ -26,6 +29,12 @@ static GameDLL load_dll() {
     if (tcc_add_file(result.tcc, "game.c") == -1) goto cleanup;
     if (tcc_add_symbol(result.tcc, "G", &G) == -1) goto cleanup;
     if (tcc_add_symbol(result.tcc, "data", &G->game_memory) == -1) goto cleanup;
+    if (tcc_add_symbol(result.tcc, "block_begin", block_begin) == -1) goto cleanup;
+    if (tcc_add_symbol(result.tcc, "block_bytes", block_bytes) == -1) goto cleanup;
+    if (tcc_add_symbol(result.tcc, "block_end", block_end) == -1) goto cleanup;
+    if (tcc_add_symbol(result.tcc, "histogram_add", histogram_add) == -1) goto cleanup;
+    if (tcc_add_symbol(result.tcc, "histogram_percentile", histogram_percentile) == -1)
+        goto cleanup;
     if (tcc_relocate(result.tcc, TCC_RELOCATE_AUTO) == -1) goto cleanup;
 
     result.info = tcc_get_symbol(result.tcc, "game");
@@ -34,8 +43,13 @@ static GameDLL load_dll() {
     result.init = tcc_get_symbol(result.tcc, "init");
     if (!result.init) goto cleanup;
 
-    result.update = tcc_get_symbol(result.tcc, "update");
-    if (!result.update) goto cleanup;
+    // Either update, or simulate and render at a fixed rate, see game_frame
+    result.update   = tcc_get_symbol(result.tcc, "update");
+    result.simulate = tcc_get_symbol(result.tcc, "simulate");
+    result.render   = tcc_get_symbol(result.tcc, "render");
+    if (result.info->sim_hz ? !result.simulate || !result.render : !result.update) goto cleanup;
+    result.latch   = tcc_get_symbol(result.tcc, "latch");
+    result.restore = tcc_get_symbol(result.tcc, "restore");
 
     result.gamedata_size = tcc_get_symbol(result.tcc, "gamedata_size");
     if (!result.gamedata_size) goto cleanup;
@@ -56,16 +70,79 @@ cleanup:
     return (GameDLL){0};
 }
 
-static void hot_reload() {
+// Snapshots hold the engine's structs as well as the game's, so they're as old as this executable
+// or the newest of the sources tcc builds the game from, see game_start
+static char *snapshot_build() {
+    cstr sources[] = {"game.c", "base_win.c", "engine.c", "base.h", "profiler.h"};
+    u64  newest    = 0;
+    for (i32 i = 0; i < sizeof(sources) / sizeof(sources[0]); i++) {
+        FILETIME write = {0};
+        if (!GetLastWriteTime(sources[i], &write)) continue;
+
+        u64 time = (u64)write.dwHighDateTime << 32 | write.dwLowDateTime;
+        if (time > newest) newest = time;
+    }
+    return string_format(&ctx()->temp, "%s %s %llx", __DATE__, __TIME__, newest);
+}
+
+static bool hot_reload() {
     FILETIME new_write = {0};
-    if (!GetLastWriteTime("game.c", &new_write)) return;
-    if (CompareFileTime(&new_write, &G->game.last_write) == 0) return;
+    if (!GetLastWriteTime("game.c", &new_write)) return false;
+    if (CompareFileTime(&new_write, &G->game.last_write) == 0) return false;
 
     GameDLL new_dll = load_dll();
-    if (!new_dll.tcc) return;
+    if (!new_dll.tcc) return false;
 
     tcc_delete(G->game.tcc);
     G->game = new_dll;
+    return true;
+}
+
+// F4 starts and stops capturing frames to a draw stream, see replay.c
+static DrawStream capture   = {0};
+static bool       capturing = false;
+
+// F6 starts and stops recording input to input.rec, see ParseCommandLine to replay it
+static InputRecording record    = {0};
+static bool           recording = false;
+
+// Input goes to the input ring, the rest of the messages are handled here or by WndProc
+static void pump_messages() {
+    while (PeekMessage(&G->platform.msg, NULL, 0, 0, PM_REMOVE)) {
+        PushInput(&G->platform.msg);
+
+        switch (G->platform.msg.message) {
+        case WM_QUIT: G->shutdown = true; break;
+
+        case WM_KEYDOWN:
+            switch (G->platform.msg.wParam) {
+            case VK_ESCAPE: DestroyWindow(G->platform.hwnd); break;
+            case VK_F3: G->profiler.overlay ^= true; break;
+            case VK_F4: {
+                if (!capture.data) capture = draw_stream_new(MB(8));
+                capturing ^= true;
+                if (!capturing) draw_stream_finish(&capture, "capture.draw");
+                break;
+            }
+            case VK_F5: G->game.init(); break;
+            case VK_F6: {
+                if (!record.data) record = input_record_new(MB(4));
+                recording ^= true;
+                if (!recording) input_record_finish(&record, "input.rec");
+                break;
+            }
+            case VK_F11: FullscreenWindow(G->platform.hwnd); break;
+
+            default: break;
+            }
+            break;
+
+        default: break;
+        }
+
+        TranslateMessage(&G->platform.msg);
+        DispatchMessage(&G->platform.msg);
+    }
 }
 
 LRESULT CALLBACK WndProc(HWND hwnd, u32 message, WPARAM wParam, LPARAM lParam) {
@@ -77,6 +154,11 @@ LRESULT CALLBACK WndProc(HWND hwnd, u32 message, WPARAM wParam, LPARAM lParam) {
 
     case WM_DESTROY: PostQuitMessage(0); break;
     case WM_ERASEBKGND: return 1;
+    case WM_PAINT: {
+        ValidateRect(hwnd, NULL);
+        G->platform.repaint = true;
+        break;
+    }
 
     default: return DefWindowProc(hwnd, message, wParam, lParam);
     }
@@ -86,7 +168,7 @@ LRESULT CALLBACK WndProc(HWND hwnd, u32 message, WPARAM wParam, LPARAM lParam) {
 i32 APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, i32 nCmdShow) {
     // SetProcessDPIAware();
     {
-        Arena perm = arena_new(MB(32), NULL);
+        Arena perm = arena_new_at(PERM_BASE, MB(32));
 
         G  = (EngineData *)alloc(sizeof(EngineData), &perm);
         *G = (EngineData){
@@ -94,7 +176,7 @@ i32 APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLi
                 {
                     .perm = perm,
                 },
-            .prev_placement = {sizeof(WINDOWPLACEMENT)},
+            .platform       = {.prev_placement = {sizeof(WINDOWPLACEMENT)}},
             .screen_size    = {.w = 640, .h = 360},
             .draw_size      = 1024,
             .metrics        = metrics_init(),
@@ -107,16 +189,15 @@ i32 APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLi
     BLOCK_BEGIN("init");
     G->draw_queue = ALLOC_ARRAY(DrawCmd, G->draw_size);
 
-    QueryPerformanceFrequency(&G->freq);
-    const f32 target_dt  = 1.0f / 60.0f;
-    f32       dt         = target_dt;
-    f64       next_frame = now_seconds();
+    const f32 target_dt = 1.0f / 60.0f;
+    f64       dt        = target_dt;
+    Pacer     pacer     = pacer_new(target_dt);
 
     G->game = load_dll();
     if (!G->game.tcc) return 1;
 
-    G->game_memory = alloc_perm(G->game.gamedata_size());
-    G->screen_buf  = ALLOC_ARRAY(u32, G->screen_size.w * G->screen_size.h);
+    G->screen_buf = CreateScreen();
+    if (!G->screen_buf) return 1;
 
     WNDCLASS wc = {
         .hInstance     = hInstance,
@@ -136,214 +217,88 @@ i32 APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLi
 
     cstr window_name =
         string_format(&G->ctx.perm, "%s %s", G->game.info->name, G->game.info->version);
-    G->hwnd = CreateWindow(G->game.info->name, window_name, style, CW_USEDEFAULT, CW_USEDEFAULT,
-                           wr.right - wr.left, wr.bottom - wr.top, 0, 0, hInstance, 0);
-    if (!G->hwnd) return 0;
+    G->platform.hwnd =
+        CreateWindow(G->game.info->name, window_name, style, CW_USEDEFAULT, CW_USEDEFAULT,
+                     wr.right - wr.left, wr.bottom - wr.top, 0, 0, hInstance, 0);
+    if (!G->platform.hwnd) return 0;
+
+    InputRecording replay    = {0};
+    bool           max_speed = false;
+    if (!ParseCommandLine(lpCmdLine, &replay, &max_speed)) return 1;
 
-    if (G->game.init) G->game.init();
+    G->game_memory = alloc_perm(G->game.gamedata_size());
+    game_start(snapshot_build());
     BLOCK_END();
 
     RepProfiler rep = repprofiler_new("game loop", 1000);
+    rep_set_budget(&rep, target_dt * 1000.0);
     while (!G->shutdown) {
-        hot_reload();
+        // Idle time is left out of the pacing and the profiles, the next frame starts on time
+        if (!hot_reload() && !replay.data && WaitIdle()) {
+            pacer_reset(&pacer);
+            continue;
+        }
+        if (replay.data && !input_replay_frame(&replay, &dt)) break;
+
         rep_begin(&rep);
+        profiler_frame_begin();
         f64 frame_start = now_seconds();
 
-        for (i32 i = 0; i < K_COUNT; i++) {
-            if (G->keys[i] == KS_JUST_RELEASED) G->keys[i] = KS_RELEASED;
-            if (G->keys[i] == KS_JUST_PRESSED) G->keys[i] = KS_PRESSED;
+        BLOCK_BEGIN("input");
+        pump_messages();
+        input_begin_frame();
+        BLOCK_END();
+
+        BLOCK_BEGIN("update");
+        G->animating = false;
+        game_frame(dt);
+        BLOCK_END();
+
+        // Input that came in while the frame was made, for the game to move its camera by
+        BLOCK_BEGIN("latch");
+        pump_messages();
+        input_latch();
+        BLOCK_END();
+
+        if (recording && !input_record_frame(&record, dt)) {
+            WARN("Input recording full");
+            input_record_finish(&record, "input.rec");
+            recording = false;
         }
 
-        while (PeekMessage(&G->msg, NULL, 0, 0, PM_REMOVE)) {
-            switch (G->msg.message) {
-            case WM_QUIT: G->shutdown = true; break;
-
-            case WM_LBUTTONDOWN: G->keys[K_MOUSE_LEFT] = KS_JUST_PRESSED; break;
-            case WM_LBUTTONUP: G->keys[K_MOUSE_LEFT] = KS_JUST_RELEASED; break;
-            case WM_MBUTTONDOWN: G->keys[K_MOUSE_MID] = KS_JUST_PRESSED; break;
-            case WM_MBUTTONUP: G->keys[K_MOUSE_MID] = KS_JUST_RELEASED; break;
-            case WM_RBUTTONDOWN: G->keys[K_MOUSE_RIGHT] = KS_JUST_PRESSED; break;
-            case WM_RBUTTONUP: G->keys[K_MOUSE_RIGHT] = KS_JUST_RELEASED; break;
-
-            case WM_KEYDOWN:
-                switch (G->msg.wParam) {
-                case VK_ESCAPE: DestroyWindow(G->hwnd); break;
-                case VK_F5: G->game.init(); break;
-                case VK_F11: FullscreenWindow(G->hwnd); break;
-
-                case VK_UP: G->keys[K_UP] = KS_JUST_PRESSED; break;
-                case VK_DOWN: G->keys[K_DOWN] = KS_JUST_PRESSED; break;
-                case VK_LEFT: G->keys[K_LEFT] = KS_JUST_PRESSED; break;
-                case VK_RIGHT: G->keys[K_RIGHT] = KS_JUST_PRESSED; break;
-                case 'W': G->keys[K_W] = KS_JUST_PRESSED; break;
-                case 'A': G->keys[K_A] = KS_JUST_PRESSED; break;
-                case 'R': G->keys[K_R] = KS_JUST_PRESSED; break;
-                case 'S': G->keys[K_S] = KS_JUST_PRESSED; break;
-
-                default: break;
-                }
-                break;
-
-            case WM_KEYUP:
-                switch (G->msg.wParam) {
-                case VK_UP: G->keys[K_UP] = KS_JUST_RELEASED; break;
-                case VK_DOWN: G->keys[K_DOWN] = KS_JUST_RELEASED; break;
-                case VK_LEFT: G->keys[K_LEFT] = KS_JUST_RELEASED; break;
-                case VK_RIGHT: G->keys[K_RIGHT] = KS_JUST_RELEASED; break;
-                case 'W': G->keys[K_W] = KS_JUST_RELEASED; break;
-                case 'A': G->keys[K_A] = KS_JUST_RELEASED; break;
-                case 'R': G->keys[K_R] = KS_JUST_RELEASED; break;
-                case 'S': G->keys[K_S] = KS_JUST_RELEASED; break;
-
-                default: break;
-                }
-                break;
-
-            case WM_MOUSEMOVE:
-                G->mouse_pos = (v2){
-                    .x = Q8(G->msg.lParam & 0xFFFF),
-                    .y = Q8((G->msg.lParam >> 16) & 0xFFFF),
-                };
-                break;
-
-            default: break;
-            }
-
-            TranslateMessage(&G->msg);
-            DispatchMessage(&G->msg);
+        if (capturing && !draw_stream_capture(&capture)) {
+            WARN("Draw stream full");
+            draw_stream_finish(&capture, "capture.draw");
+            capturing = false;
         }
 
-        G->game.update((q8)(dt * 256.0f));
-
-        {
-            HDC  hdc = GetDC(G->hwnd);
-            RECT rc  = {0};
-            GetClientRect(G->hwnd, &rc);
-
-            i32 client_w = rc.right - rc.left;
-            i32 client_h = rc.bottom - rc.top;
-
-            HDC     mem_dc  = CreateCompatibleDC(hdc);
-            HBITMAP mem_bmp = CreateCompatibleBitmap(hdc, client_w, client_h);
-            HBITMAP old_bmp = SelectObject(mem_dc, mem_bmp);
-
-            for (i32 i = 0; i < G->draw_count; i++) {
-                DrawCmd next = G->draw_queue[i];
-
-                switch (next.t) {
-                case DCT_MESH: {
-                    v2i *screen_verts = (v2i *)alloc_temp(sizeof(v2i) * next.count);
-                    for (i32 v = 0; v < next.count; v++) {
-                        v3 n            = next.vertices[v];
-                        screen_verts[v] = v2i_from_v2(v2_screen(v3_project(n), G->screen_size));
-                    }
-
-                    for (i32 v = 0; v < next.edges_count; v++) {
-                        v2i edge = next.edges[v];
-                        render_line(screen_verts[edge.from], screen_verts[edge.to], WHITE);
-                    }
-                    break;
-                }
-                case DCT_RECT: {
-                    next.r = (rect){
-                        .x = q8_to_i32(next.r.x),
-                        .y = q8_to_i32(next.r.y),
-                        .w = q8_to_i32(next.r.w),
-                        .h = q8_to_i32(next.r.h),
-                    };
-                    for (i32 y_coord = next.r.y; y_coord < next.r.y + next.r.h; y_coord++) {
-                        for (i32 x_coord = next.r.x; x_coord < next.r.x + next.r.w; x_coord++) {
-                            if (x_coord >= 0 && x_coord < G->screen_size.w && y_coord >= 0 &&
-                                y_coord < G->screen_size.h) {
-                                i32 coord            = y_coord * G->screen_size.w + x_coord;
-                                G->screen_buf[coord] = next.color;
-                            }
-                        }
-                    }
-                    break;
-                }
-                default: break;
-                }
-            }
-
-            HDC              buf_dc  = CreateCompatibleDC(hdc);
-            BITMAPINFOHEADER buf_bmi = {
-                .biSize        = sizeof(BITMAPINFOHEADER),
-                .biWidth       = G->screen_size.w,
-                .biHeight      = -G->screen_size.h,
-                .biPlanes      = 1,
-                .biBitCount    = 32,
-                .biCompression = BI_RGB,
-            };
-            void   *buf_bits = NULL;
-            HBITMAP buf_bmp  = CreateDIBSection(buf_dc, (BITMAPINFO *)&buf_bmi, DIB_RGB_COLORS,
-                                                &buf_bits, NULL, 0);
-            HBITMAP buf_old  = SelectObject(buf_dc, buf_bmp);
-
-            memcpy(buf_bits, G->screen_buf, G->screen_size.w * G->screen_size.h * sizeof(u32));
-
-            for (i32 i = 0; i < G->draw_count; i++) {
-                DrawCmd next = G->draw_queue[i];
-                if (next.t == DCT_TEXT) {
-                    RECT r = {
-                        .left   = next.x,
-                        .top    = next.y,
-                        .right  = G->screen_size.w,
-                        .bottom = G->screen_size.h,
-                    };
-                    SetTextColor(buf_dc, next.color);
-                    SetBkMode(buf_dc, TRANSPARENT);
-                    DrawText(buf_dc, next.text, -1, &r, DT_LEFT | DT_TOP);
-                }
-            }
-
-            GdiFlush();
-            CopyMemory(G->screen_buf, buf_bits, G->screen_size.w * G->screen_size.h * sizeof(u32));
-
-            SelectObject(buf_dc, buf_old);
-            DeleteObject(buf_bmp);
-            DeleteDC(buf_dc);
-
-            BITMAPINFOHEADER bmi = {
-                .biSize        = sizeof(BITMAPINFOHEADER),
-                .biWidth       = G->screen_size.w,
-                .biHeight      = -G->screen_size.h,
-                .biPlanes      = 1,
-                .biBitCount    = 32,
-                .biCompression = BI_RGB,
-            };
-
-            StretchDIBits(mem_dc, 0, 0, client_w, client_h, 0, 0, G->screen_size.w,
-                          G->screen_size.h, G->screen_buf, (BITMAPINFO *)&bmi, DIB_RGB_COLORS,
-                          SRCCOPY);
-
-            BitBlt(hdc, 0, 0, client_w, client_h, mem_dc, 0, 0, SRCCOPY);
+        profiler_overlay(target_dt * 1000.0);
 
-            SelectObject(mem_dc, old_bmp);
-            DeleteObject(mem_bmp);
-            DeleteDC(mem_dc);
+        BLOCK_BEGIN("raster");
+        damage_update();
+        render_damage(false);
+        block_bytes(G->damage.pixels * sizeof(u32));
+        BLOCK_END();
 
-            ReleaseDC(G->hwnd, hdc);
-            G->draw_count = 0;
-        }
+        BLOCK_BEGIN("present");
+        PresentWindow();
+        G->draw_count = 0;
+        BLOCK_END();
+        profiler_frame_end();
 
+        // The budget is for the frame's work, the wait for the next one is left out
+        rep_end(&rep);
         {
-            next_frame += target_dt;
-
-            f64 remaining = next_frame - now_seconds();
-            if (remaining > 0.0) {
-                DWORD sleep_ms = (DWORD)(remaining * 1000.0);
-                if (sleep_ms > 0) Sleep(sleep_ms);
-            }
-
+            if (!max_speed) pacer_wait(&pacer);
             ctx()->temp.used = 0;
             dt               = now_seconds() - frame_start;
         }
-        rep_end(&rep);
     }
 
     repprofiler_print(&rep);
+    pacer_print(&pacer);
+    if (recording) input_record_finish(&record, "input.rec");
     if (G->game.quit) G->game.quit();
     profiler_end();
-    return G->msg.wParam;
+    return G->platform.msg.wParam;
 }
\ No newline at end of file
@@ -0,0 +1,283 @@
+#define ENGINE_IMPL
+#include "base_linux.c"
+#include "profiler.c"
+
+Data *data;
+
+#include "game.c"
+
+#include <stdlib.h>
+
+// Input scripts have one event per line, applied at the start of the given frame:
+//     <frame> <key> down|up
+//     <frame> mouse <x> <y>
+//     <frame> quit
+// Lines starting with '#' are comments, events must be sorted by frame.
+static const struct {
+    cstr name;
+    Key  key;
+} key_names[] = {
+    {"up", K_UP},
+    {"down", K_DOWN},
+    {"left", K_LEFT},
+    {"right", K_RIGHT},
+    {"enter", K_ENTER},
+    {"escape", K_ESCAPE},
+    {"w", K_W},
+    {"a", K_A},
+    {"r", K_R},
+    {"s", K_S},
+    {"mouse_left", K_MOUSE_LEFT},
+    {"mouse_right", K_MOUSE_RIGHT},
+    {"mouse_mid", K_MOUSE_MID},
+};
+
+static void headless_input() {
+    Platform *p = &G->platform;
+
+    while (p->input_cursor < p->input_script.len) {
+        char *line = (char *)p->input_script.text + p->input_cursor;
+        char *end  = strchr(line, '\n');
+        i32   len  = end ? (i32)(end - line) + 1 : (i32)strlen(line);
+
+        u64  frame    = 0;
+        char what[32] = {0}, arg[32] = {0};
+        if (line[0] == '#' || sscanf(line, "%lu %31s", &frame, what) < 2) {
+            p->input_cursor += len;
+            continue;
+        }
+        if (frame > p->frame) return;
+        p->input_cursor += len;
+
+        InputEvent e = {.time = ReadOSTimer()};
+        if (strcmp(what, "quit") == 0) {
+            G->shutdown = true;
+        } else if (strcmp(what, "mouse") == 0) {
+            i32 x = 0, y = 0;
+            sscanf(line, "%*u %*s %d %d", &x, &y);
+            e.t   = IE_MOUSE_MOVE;
+            e.pos = (v2){.x = Q8(x), .y = Q8(y)};
+            input_push(e);
+        } else {
+            sscanf(line, "%*u %*s %31s", arg);
+            for (i32 i = 0; i < sizeof(key_names) / sizeof(key_names[0]); i++) {
+                if (strcmp(what, key_names[i].name) != 0) continue;
+                e.t   = strcmp(arg, "down") == 0 ? IE_KEY_DOWN : IE_KEY_UP;
+                e.key = key_names[i].key;
+                input_push(e);
+            }
+        }
+    }
+}
+
+// Binary PPM, the framebuffer is 0x00RRGGBB
+static void headless_dump_ppm() {
+    Platform *p = &G->platform;
+    if (!p->dump_ppm) return;
+
+    char path[256];
+    snprintf(path, sizeof(path), p->dump_ppm, p->frame);
+
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        ERR("Couldn't open %s", path);
+        return;
+    }
+
+    i32 w = G->screen_size.w, h = G->screen_size.h;
+    u8 *rgb_buf = alloc_temp(w * h * 3);
+    for (i32 i = 0; i < w * h; i++) {
+        col32 c            = G->screen_buf[i];
+        rgb_buf[i * 3 + 0] = (c >> 16) & 0xFF;
+        rgb_buf[i * 3 + 1] = (c >> 8) & 0xFF;
+        rgb_buf[i * 3 + 2] = c & 0xFF;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", w, h);
+    fwrite(rgb_buf, 1, w * h * 3, file);
+    fclose(file);
+}
+
+static void usage(cstr exe) {
+    printf("Usage: %s [--frames N] [--size WxH] [--dump pattern.ppm] [--input script.txt] "
+           "[--record input.rec] [--replay input.rec] [--capture stream.draw] [--overlay] "
+           "[--hw-counters] [--full-redraw] [--realtime] [--no-snapshot]\n",
+           exe);
+}
+
+i32 main(i32 argc, char **argv) {
+    v2i  screen_size = {.w = 640, .h = 360};
+    u64  frame_count = 600;
+    cstr dump_ppm = NULL, input_path = NULL, capture_path = NULL, record_path = NULL,
+         replay_path = NULL;
+    bool overlay = false, hw_counters = false, full_redraw = false, realtime = false,
+         no_snapshot = false;
+
+    for (i32 i = 1; i < argc; i++) {
+        cstr arg  = argv[i];
+        bool more = i + 1 < argc;
+        if (strcmp(arg, "--frames") == 0 && more) {
+            frame_count = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(arg, "--size") == 0 && more) {
+            sscanf(argv[++i], "%dx%d", &screen_size.w, &screen_size.h);
+        } else if (strcmp(arg, "--dump") == 0 && more) {
+            dump_ppm = argv[++i];
+        } else if (strcmp(arg, "--input") == 0 && more) {
+            input_path = argv[++i];
+        } else if (strcmp(arg, "--record") == 0 && more) {
+            record_path = argv[++i];
+        } else if (strcmp(arg, "--replay") == 0 && more) {
+            replay_path = argv[++i];
+        } else if (strcmp(arg, "--capture") == 0 && more) {
+            capture_path = argv[++i];
+        } else if (strcmp(arg, "--overlay") == 0) {
+            overlay = true;
+        } else if (strcmp(arg, "--hw-counters") == 0) {
+            hw_counters = true;
+        } else if (strcmp(arg, "--full-redraw") == 0) {
+            full_redraw = true;
+        } else if (strcmp(arg, "--realtime") == 0) {
+            realtime = true;
+        } else if (strcmp(arg, "--no-snapshot") == 0) {
+            no_snapshot = true;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    {
+        Arena perm = arena_new_at(PERM_BASE, MB(64));
+
+        G  = (EngineData *)alloc(sizeof(EngineData), &perm);
+        *G = (EngineData){
+            .ctx =
+                {
+                    .perm = perm,
+                },
+            .screen_size = screen_size,
+            .draw_size   = 1024,
+            .metrics     = metrics_init(),
+            .system_info = systeminfo_init(),
+            .profiler    = profiler_new("Handmade Renderer (headless)"),
+            .platform    = {.frame_count = frame_count, .dump_ppm = dump_ppm},
+        };
+        ctx()->temp = arena_new(MB(8), &ctx()->perm);
+    }
+
+    BLOCK_BEGIN("init");
+    G->game = (GameDLL){
+        .init          = init,
+        .simulate      = simulate,
+        .render        = render,
+        .latch         = latch,
+        .restore       = restore,
+        .quit          = quit,
+        .gamedata_size = gamedata_size,
+        .info          = &game,
+    };
+
+    G->draw_queue = ALLOC_ARRAY(DrawCmd, G->draw_size);
+    G->screen_buf = ALLOC_ARRAY(u32, G->screen_size.w * G->screen_size.h);
+
+    if (input_path) {
+        G->platform.input_script = file_read((char *)input_path);
+        if (!G->platform.input_script.text) FATAL("Couldn't read input script %s", input_path);
+    }
+    if (hw_counters) profiler_enable_hw_counters();
+    G->profiler.overlay = overlay;
+
+    // Replays run the frames of the recording, up to --frames, with the input and dt they had
+    InputRecording record = {0}, replay = {0};
+    if (record_path) record = input_record_new(MB(4));
+    if (replay_path) {
+        replay = input_record_load((char *)replay_path);
+        if (!replay.data) FATAL("Couldn't load input recording %s", replay_path);
+    }
+
+    // Everything the game drew each frame, without the overlay, see replay.c
+    DrawStream capture   = {0};
+    bool       capturing = capture_path != NULL;
+    if (capturing) capture = draw_stream_new(MB(24));
+
+    INFO("Running %s %s headless, %" U64_FMT " frames at %dx%d", G->game.info->name,
+         G->game.info->version, frame_count, G->screen_size.w, G->screen_size.h);
+
+    // Runs init every time with --no-snapshot, to time it or to check it against a restore
+    if (no_snapshot) game.snapshot = NULL;
+    G->game_memory = alloc_perm(G->game.gamedata_size());
+    data           = (Data *)G->game_memory;
+    game_start(__DATE__ " " __TIME__);
+    BLOCK_END();
+
+    // Simulation always advances by the target dt, so runs are reproducible regardless of speed.
+    // With --realtime frames are also paced to it, like a window would be.
+    const f32 target_dt = 1.0f / 60.0f;
+    Pacer     pacer     = pacer_new(target_dt);
+
+    RepProfiler rep = repprofiler_new("headless frame", frame_count);
+    rep_set_budget(&rep, target_dt * 1000.0);
+    for (; G->platform.frame < frame_count && !G->shutdown; G->platform.frame++) {
+        f64 dt = target_dt;
+        if (replay.data && !input_replay_frame(&replay, &dt)) break;
+
+        rep_begin(&rep);
+        profiler_frame_begin();
+
+        BLOCK_BEGIN("input");
+        headless_input();
+        input_begin_frame();
+        BLOCK_END();
+
+        BLOCK_BEGIN("update");
+        game_frame(dt);
+        BLOCK_END();
+
+        // Scripted input all comes in at the start of a frame, the late view is always empty
+        input_latch();
+        if (record.data && !input_record_frame(&record, dt)) {
+            WARN("Input recording full after %d frames",
+                 ((InputRecordHeader *)record.data)->frames);
+            input_record_finish(&record, (char *)record_path);
+            record = (InputRecording){0};
+        }
+
+        if (capturing && !draw_stream_capture(&capture)) {
+            WARN("Draw stream full after %d frames", draw_stream_header(&capture)->frames);
+            capturing = false;
+        }
+
+        profiler_overlay(target_dt * 1000.0);
+
+        // Only the damaged parts of the screen unless asked, the output is the same either way
+        BLOCK_BEGIN("raster");
+        if (full_redraw) {
+            render_draw_queue();
+            render_text_queue();
+            block_bytes(G->screen_size.w * G->screen_size.h * sizeof(u32));
+        } else {
+            damage_update();
+            render_damage(true);
+            block_bytes(G->damage.pixels * sizeof(u32));
+        }
+        BLOCK_END();
+
+        BLOCK_BEGIN("present");
+        headless_dump_ppm();
+        G->draw_count    = 0;
+        ctx()->temp.used = 0;
+        BLOCK_END();
+
+        profiler_frame_end();
+        rep_end(&rep); // Before pacing, the budget is for the frame's work
+        if (realtime) pacer_wait(&pacer);
+    }
+
+    repprofiler_print(&rep);
+    pacer_print(&pacer);
+    if (record.data) input_record_finish(&record, (char *)record_path);
+    if (capture_path) draw_stream_finish(&capture, (char *)capture_path);
+    if (G->game.quit) G->game.quit();
+    profiler_end();
+    return 0;
+}
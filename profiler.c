@@ -1,65 +1,272 @@
 #include "profiler.h"
-#include <winnt.h>
 
 Profiler profiler_new(cstr name) {
     Profiler result = {
-        .name  = name,
-        .ended = false,
-        .start = 0,
+        .name       = name,
+        .ended      = false,
+        .start      = 0,
+        .blocks_len = 1, // Id 0 means "not registered"
     };
-    LARGE_INTEGER perfCounter = {0};
-    QueryPerformanceCounter(&perfCounter);
-    result.start = perfCounter.QuadPart;
+    result.start = ReadOSTimer();
+    result.freq  = GetOSTimerFreq();
     return result;
 }
 
-void block_begin(u64 id, cstr label, cstr file, i32 line, u64 bytesProcessed) {
-    Profiler *p = &G->profiler;
-    if (id >= MAX_BLOCKS) {
-        return;
+bool profiler_enable_hw_counters() {
+    G->profiler.hw = G->metrics.hw_available;
+    if (!G->profiler.hw) WARN("Hardware counters unavailable, profiling time only");
+    return G->profiler.hw;
+}
+
+static HwCounters hw_delta(HwCounters to, HwCounters from) {
+    HwCounters result = {0};
+    for (i32 i = 0; i < HW_COUNT; i++)
+        result.val[i] = to.val[i] - from.val[i];
+    return result;
+}
+
+static void hw_accumulate(HwCounters *dst, HwCounters to, HwCounters from) {
+    for (i32 i = 0; i < HW_COUNT; i++)
+        dst->val[i] += to.val[i] - from.val[i];
+}
+
+// Installed in place of a page that couldn't be allocated, so nobody waits for it
+#define BLOCK_PAGE_FAILED ((Block *)1)
+
+Block *block_get(Profiler *p, u32 id) {
+    if (id == 0 || id >= MAX_BLOCK_PAGES * BLOCK_PAGE_SIZE) return NULL;
+
+    Block *page = p->pages[id / BLOCK_PAGE_SIZE];
+    return page && page != BLOCK_PAGE_FAILED ? &page[id % BLOCK_PAGE_SIZE] : NULL;
+}
+
+// FNV-1a over the label, file and line of a call site
+static u64 block_hash(cstr label, cstr file, i32 line) {
+    u64 hash = 14695981039346656037ull;
+    for (cstr c = label; *c; c++)
+        hash = (hash ^ (u8)*c) * 1099511628211ull;
+    for (cstr c = file; *c; c++)
+        hash = (hash ^ (u8)*c) * 1099511628211ull;
+    for (i32 i = 0; i < 4; i++)
+        hash = (hash ^ ((line >> (i * 8)) & 0xFF)) * 1099511628211ull;
+    return hash;
+}
+
+// Copies the tail of src, file paths are more useful with their end than their beginning
+static void block_copy_name(char *dst, cstr src, i32 cap) {
+    i32 len = 0;
+    while (src[len])
+        len++;
+    if (len > cap - 1) src += len - (cap - 1);
+
+    i32 i = 0;
+    for (; src[i] && i < cap - 1; i++)
+        dst[i] = src[i];
+    dst[i] = 0;
+}
+
+// Returns the lowest registered id below `limit` matching the key, or 0. When `wait` is set,
+// blocks that are still being registered by another thread are waited on instead of skipped.
+static u32 block_find(Profiler *p, u64 hash, i32 line, u32 limit, bool wait) {
+    for (u32 id = 1; id < limit; id++) {
+        Block *b = block_get(p, id);
+        while (wait && (!b || b->state == BS_EMPTY)) {
+            if (p->pages[id / BLOCK_PAGE_SIZE] == BLOCK_PAGE_FAILED) break;
+            _mm_pause();
+            b = block_get(p, id);
+        }
+
+        if (!b || b->state != BS_READY) continue;
+        if (b->hash == hash && b->line == line) return id;
+    }
+    return 0;
+}
+
+// Lock-free: a slot is claimed with an atomic increment and pages are installed with a CAS. If two
+// threads race on the same call site both get a slot, and the lower id wins.
+u32 block_register(cstr label, cstr file, i32 line) {
+    Profiler *p    = &G->profiler;
+    u64       hash = block_hash(label, file, line);
+
+    u32 found = block_find(p, hash, line, p->blocks_len, false);
+    if (found) return found;
+
+    u32 id = (u32)atomic_add(&p->blocks_len, 1) - 1;
+    if (id >= MAX_BLOCK_PAGES * BLOCK_PAGE_SIZE) {
+        WARN("Profiler block table is full, dropping %s (%s:%d)", label, file, line);
+        return 0;
     }
 
-    Block        *m    = &p->blocks[id];
-    LARGE_INTEGER time = {0};
-    QueryPerformanceCounter(&time);
+    u32 page = id / BLOCK_PAGE_SIZE;
+    if (!p->pages[page]) {
+        i32    size  = sizeof(Block) * BLOCK_PAGE_SIZE;
+        Block *fresh = (Block *)os_alloc(size);
+        Block *put   = fresh ? fresh : BLOCK_PAGE_FAILED;
+        if (atomic_cas_ptr((void *volatile *)&p->pages[page], put, NULL) != NULL && fresh)
+            os_free(fresh, size);
+    }
+    if (p->pages[page] == BLOCK_PAGE_FAILED) {
+        WARN("Couldn't allocate a profiler block page, dropping %s (%s:%d)", label, file, line);
+        return 0;
+    }
 
-    if (p->queue_len > 0) {
-        Block *prev = &p->blocks[p->queue[p->queue_len - 1]];
-        prev->time_ex += time.QuadPart - prev->from;
-        prev->time_inc += time.QuadPart - prev->from;
+    Block *b = block_get(p, id);
+    block_copy_name(b->label, label, sizeof(b->label));
+    block_copy_name(b->file, file, sizeof(b->file));
+    b->line = line;
+    b->hash = hash;
+    atomic_add(&b->state, BS_READY); // Full barrier, publishes the fields above
+
+    found = block_find(p, hash, line, id, true);
+    if (found) {
+        b->state = BS_DUPLICATE;
+        return found;
     }
+    return id;
+}
 
-    m->from  = time.QuadPart;
-    m->label = label;
-    m->file  = file;
-    m->line  = line;
-    m->bytesProcessed += bytesProcessed;
+void block_begin(u32 *id, cstr label, cstr file, i32 line, u64 bytesProcessed) {
+    Profiler *p = &G->profiler;
+    if (!*id) *id = block_register(label, file, line);
+    assert(p->queue_len < MAX_BLOCK_DEPTH);
 
-    p->queue[p->queue_len++] = id;
+    // Unregistered blocks are still pushed, so that block_end stays balanced
+    p->queue[p->queue_len++] = *id;
 
-    m->iterations++;
+    Block *m = block_get(p, *id);
+    if (!m) return;
 
-    return;
+    HwCounters hw = p->hw ? ReadHardwareCounters(G->metrics) : (HwCounters){0};
+
+    u64 time = ReadOSTimer();
+
+    Block *prev = p->queue_len > 1 ? block_get(p, p->queue[p->queue_len - 2]) : NULL;
+    if (prev) {
+        prev->time_ex += time - prev->from;
+        prev->time_inc += time - prev->from;
+        if (p->hw) hw_accumulate(&prev->hw_ex, hw, prev->hw_from);
+    }
+
+    m->from    = time;
+    m->hw_from = hw;
+    m->bytesProcessed += bytesProcessed;
+    m->iterations++;
 }
 
 void block_bytes(u64 bytes) {
-    G->profiler.blocks[G->profiler.queue[G->profiler.queue_len - 1]].bytesProcessed += bytes;
+    Profiler *p = &G->profiler;
+    if (p->queue_len == 0) return;
+
+    Block *m = block_get(p, p->queue[p->queue_len - 1]);
+    if (m) m->bytesProcessed += bytes;
 }
 
 void block_end() {
-    LARGE_INTEGER now = {0};
-    QueryPerformanceCounter(&now);
+    u64 now = ReadOSTimer();
+
+    Profiler  *p  = &G->profiler;
+    HwCounters hw = p->hw ? ReadHardwareCounters(G->metrics) : (HwCounters){0};
+    Block     *m  = block_get(p, p->queue[--p->queue_len]);
+    if (!m) return;
+
+    m->time_ex += now - m->from;
+    m->time_inc += now - m->from;
+    if (p->hw) hw_accumulate(&m->hw_ex, hw, m->hw_from);
+
+    Block *prev = p->queue_len > 0 ? block_get(p, p->queue[p->queue_len - 1]) : NULL;
+    if (prev) {
+        prev->from    = now;
+        prev->hw_from = hw;
+        prev->time_inc += now - m->from;
+    }
+}
 
+void profiler_frame_begin() { G->profiler.frame_start = ReadOSTimer(); }
+
+// Records the frame time and snapshots how much exclusive time each block got this frame
+void profiler_frame_end() {
+    u64 now = ReadOSTimer();
+
+    Profiler *p = &G->profiler;
+    p->frame_times[p->frame_index] = now - p->frame_start;
+    p->frame_index                 = (p->frame_index + 1) % PROFILER_FRAME_HISTORY;
+
+    for (u32 i = 1; i < (u32)p->blocks_len; i++) {
+        Block *b = block_get(p, i);
+        if (!b || b->state != BS_READY) continue;
+
+        b->frame_ex   = b->time_ex - b->frame_mark;
+        b->frame_mark = b->time_ex;
+    }
+}
+
+#define OVERLAY_ROWS 12
+
+// Draws the last PROFILER_FRAME_HISTORY frame times and the most expensive blocks of the last
+// frame. Everything goes through the draw queue, so it costs a handful of commands.
+void profiler_overlay(f64 budget_ms) {
     Profiler *p = &G->profiler;
-    Block    *m = &p->blocks[p->queue[--p->queue_len]];
-    m->time_ex += now.QuadPart - m->from;
-    m->time_inc += now.QuadPart - m->from;
+    if (!p->overlay) return;
+    BLOCK_BEGIN("profiler_overlay");
+
+    f64 to_ms = 1000.0 / (f64)p->freq;
+
+    // Frame graph, the budget line sits at half height
+    i32 bar_w   = 2;
+    i32 graph_w = PROFILER_FRAME_HISTORY * bar_w;
+    i32 graph_h = 64;
+    i32 graph_x = 10;
+    i32 graph_y = G->screen_size.h - graph_h - 10;
+
+    draw_rect((rect){Q8(graph_x), Q8(graph_y), Q8(graph_w), Q8(graph_h)}, rgb(20, 20, 30));
+    for (u32 i = 0; i < PROFILER_FRAME_HISTORY; i++) {
+        f64 ms = (f64)p->frame_times[(p->frame_index + i) % PROFILER_FRAME_HISTORY] * to_ms;
+        i32 h  = (i32)(ms / budget_ms * (graph_h / 2));
+        if (h > graph_h) h = graph_h;
+        if (h <= 0) continue;
+
+        col32 color = ms > budget_ms ? rgb(220, 60, 60) : rgb(60, 200, 90);
+        draw_rect((rect){Q8(graph_x + i * bar_w), Q8(graph_y + graph_h - h), Q8(bar_w), Q8(h)},
+                  color);
+    }
+    draw_rect((rect){Q8(graph_x), Q8(graph_y + graph_h / 2), Q8(graph_w), Q8(1)},
+              rgb(230, 230, 120));
+
+    u64 last_frame = p->frame_times[(p->frame_index + PROFILER_FRAME_HISTORY - 1) %
+                                    PROFILER_FRAME_HISTORY];
+    draw_text(string_format(&ctx()->temp, "%.2f ms / %.2f ms", (f64)last_frame * to_ms,
+                            budget_ms),
+              graph_x + graph_w + 6, graph_y, WHITE);
+
+    // Block table, sorted by exclusive time in the last frame
+    Block *rows[OVERLAY_ROWS] = {0};
+    i32    rows_len           = 0;
+    for (u32 i = 1; i < (u32)p->blocks_len; i++) {
+        Block *b = block_get(p, i);
+        if (!b || b->state != BS_READY || b->frame_ex == 0) continue;
+
+        i32 at = rows_len < OVERLAY_ROWS ? rows_len++ : OVERLAY_ROWS;
+        while (at > 0 && rows[at - 1]->frame_ex < b->frame_ex) {
+            if (at < OVERLAY_ROWS) rows[at] = rows[at - 1];
+            at--;
+        }
+        if (at < OVERLAY_ROWS) rows[at] = b;
+    }
 
-    if (p->queue_len > 0) {
-        Block *prev = &p->blocks[p->queue[p->queue_len - 1]];
-        prev->from  = now.QuadPart;
-        prev->time_inc += now.QuadPart - m->from;
+    i32 table_w = 260;
+    i32 table_x = G->screen_size.w - table_w - 4;
+    i32 row_h   = 16;
+    draw_rect((rect){Q8(table_x - 6), Q8(6), Q8(table_w + 6), Q8((rows_len + 1) * row_h + 8)},
+              rgb(20, 20, 30));
+    draw_text("Block (ex)          ms      %", table_x, 10, WHITE);
+    for (i32 i = 0; i < rows_len; i++) {
+        f64 ms = (f64)rows[i]->frame_ex * to_ms;
+        f64 pc = last_frame ? (f64)rows[i]->frame_ex / (f64)last_frame * 100.0 : 0.0;
+        draw_text(string_format(&ctx()->temp, "%-16.16s %7.3f %5.1f%%", rows[i]->label, ms, pc),
+                  table_x, 10 + (i + 1) * row_h, WHITE);
     }
+
+    BLOCK_END();
 }
 
 static f64 to_gb(f64 bytes) { return bytes / 1024.0 / 1024.0 / 1024.0; }
@@ -71,48 +278,94 @@ void profiler_end() {
 
     p->ended = true;
 
-    LARGE_INTEGER perfCounter = {0}, perfFreq = {0};
-    QueryPerformanceCounter(&perfCounter);
-    QueryPerformanceFrequency(&perfFreq);
+    u64 perfCounter = ReadOSTimer();
+    u64 perfFreq    = GetOSTimerFreq();
 
-    f64 totalTime = (f64)(perfCounter.QuadPart - p->start) / (f64)(perfFreq.QuadPart);
+    f64 totalTime = (f64)(perfCounter - p->start) / (f64)(perfFreq);
 
     INFO("Finished %s in %.6f seconds", p->name, totalTime);
-    printf(" %-24s \t| %-25s \t| %-25s \t| %-12s\n", "Name[n]", "Time (Ex)", "Time (Inc)",
+    printf(" %-24s \t| %-25s \t| %-25s \t| %-12s", "Name[n]", "Time (Ex)", "Time (Inc)",
            "Bandwidth");
+    if (p->hw) printf("\t| %-6s | %-9s | %-9s | %-9s", "IPC", "L1D/px", "LLC/px", "Br MPKI");
+    printf("\n");
     printf("-----------------------------------------------------------------------------------"
            "--------------------"
            "--------\n");
 
-    for (u64 i = 1; i < MAX_BLOCKS; i++) {
-        Block next = p->blocks[i];
-        if (next.iterations == 0) continue;
+    for (u32 i = 1; i < (u32)p->blocks_len; i++) {
+        Block *block = block_get(p, i);
+        if (!block || block->state != BS_READY || block->iterations == 0) continue;
+        Block next = *block;
 
-        f64 nextTimeEx  = ((f64)(next.time_ex) / (f64)(perfFreq.QuadPart));
-        f64 nextTimeInc = ((f64)(next.time_inc) / (f64)(perfFreq.QuadPart));
+        f64 nextTimeEx  = ((f64)(next.time_ex) / (f64)(perfFreq));
+        f64 nextTimeInc = ((f64)(next.time_inc) / (f64)(perfFreq));
+        printf(" %-20s [%" U64_FMT "] \t| %.5f secs\t(%.2f%%) \t| %.5f secs\t(%.2f%%) \t|",
+               next.label, next.iterations, nextTimeEx, (nextTimeEx / totalTime) * 100, nextTimeInc,
+               (nextTimeInc / totalTime) * 100);
         if (next.bytesProcessed == 0) {
-            printf(" %-20s [%llu] \t| %.5f secs\t(%.2f%%) \t| %.5f secs\t(%.2f%%) \t|\n",
-                   next.label, next.iterations, nextTimeEx, (nextTimeEx / totalTime) * 100,
-                   nextTimeInc, (nextTimeInc / totalTime) * 100);
+            printf(" %-12s", "");
         } else {
-            printf(" %-20s [%llu] \t| %.5f secs\t(%.2f%%) \t| %.5f secs\t(%.2f%%) \t| %.3f GB/s\n",
-                   next.label, next.iterations, nextTimeEx, (nextTimeEx / totalTime) * 100,
-                   nextTimeInc, (nextTimeInc / totalTime) * 100,
-                   to_gb((f64)(next.bytesProcessed) / nextTimeEx));
+            printf(" %-7.3f GB/s", to_gb((f64)(next.bytesProcessed) / nextTimeEx));
+        }
+
+        // Misses are per pixel of bytesProcessed, a cache line holds 16 of them
+        if (p->hw) {
+            u64 *hw     = next.hw_ex.val;
+            f64  pixels = (f64)(next.bytesProcessed) / sizeof(col32);
+            f64  ipc    = hw[HW_CYCLES] ? (f64)hw[HW_INSTRUCTIONS] / (f64)hw[HW_CYCLES] : 0.0;
+            f64  mpki   = hw[HW_INSTRUCTIONS]
+                              ? (f64)hw[HW_BRANCH_MISSES] * 1000.0 / (f64)hw[HW_INSTRUCTIONS]
+                              : 0.0;
+            if (pixels > 0) {
+                printf("\t| %-6.2f | %-9.4f | %-9.4f | %-9.2f", ipc,
+                       (f64)hw[HW_L1D_MISSES] / pixels, (f64)hw[HW_LLC_MISSES] / pixels, mpki);
+            } else {
+                printf("\t| %-6.2f | %-9s | %-9s | %-9.2f", ipc, "-", "-", mpki);
+            }
         }
+        printf("\n");
     }
 }
 
-i32 by_time(const void *from, const void *to) {
-    return ((RepBlock *)(from))->time - ((RepBlock *)(to))->time;
+static u32 histogram_bucket(u64 val) {
+    if (val < HIST_SUB_COUNT) return (u32)val;
+
+    i32 shift = msb_u64(val) - HIST_SUB_BITS;
+    return (shift + 1) * HIST_SUB_COUNT + (u32)(val >> shift) - HIST_SUB_COUNT;
 }
 
-i32 by_bytes(const void *from, const void *to) {
-    return ((RepBlock *)(from))->bytes - ((RepBlock *)(to))->bytes;
+// Highest value that falls in the bucket, so percentiles never under-report
+static u64 histogram_bucket_max(u32 bucket) {
+    if (bucket < HIST_SUB_COUNT) return bucket;
+
+    i32 shift    = bucket / HIST_SUB_COUNT - 1;
+    u64 mantissa = bucket % HIST_SUB_COUNT + HIST_SUB_COUNT;
+    return ((mantissa + 1) << shift) - 1;
 }
 
-i32 by_page_faults(const void *from, const void *to) {
-    return ((RepBlock *)(from))->pageFaults - ((RepBlock *)(to))->pageFaults;
+void histogram_add(Histogram *h, u64 val) {
+    if (h->total == 0 || val < h->min) h->min = val;
+    if (val > h->max) h->max = val;
+    h->counts[histogram_bucket(val)]++;
+    h->total++;
+}
+
+u64 histogram_percentile(Histogram *h, f64 percentile) {
+    if (h->total == 0) return 0;
+
+    u64 rank = (u64)((f64)h->total * percentile / 100.0);
+    if (rank >= h->total) rank = h->total - 1;
+
+    u64 seen = 0, result = h->max;
+    for (u32 i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen > rank) {
+            result = histogram_bucket_max(i);
+            break;
+        }
+    }
+    if (result < h->min) return h->min;
+    return result < h->max ? result : h->max;
 }
 
 RepProfiler repprofiler_new(cstr name, u64 maxRepeats) {
@@ -122,23 +375,28 @@ RepProfiler repprofiler_new(cstr name, u64 maxRepeats) {
     };
 }
 
+void rep_set_budget(RepProfiler *p, f64 ms) {
+    u64 perfFreq = GetOSTimerFreq();
+    p->budget = (u64)(ms / 1000.0 * (f64)perfFreq);
+}
+
 void rep_begin(RepProfiler *p) {
-    LARGE_INTEGER perfCounter = {0};
-    QueryPerformanceCounter(&perfCounter);
+    u64 perfCounter = ReadOSTimer();
     p->current = (RepBlock){
-        .time       = (u64)(perfCounter.QuadPart),
+        .time       = (u64)(perfCounter),
         .bytes      = 0,
         .pageFaults = ReadPageFaultCount(G->metrics),
+        .hw         = G->profiler.hw ? ReadHardwareCounters(G->metrics) : (HwCounters){0},
     };
 }
 
 void rep_add_bytes(RepProfiler *p, u64 bytes) { p->current.bytes += bytes; }
 
 void rep_end(RepProfiler *p) {
-    LARGE_INTEGER perfCounter = {0};
-    QueryPerformanceCounter(&perfCounter);
-    p->current.time       = perfCounter.QuadPart - p->current.time;
+    u64 perfCounter = ReadOSTimer();
+    p->current.time       = perfCounter - p->current.time;
     p->current.pageFaults = ReadPageFaultCount(G->metrics) - p->current.pageFaults;
+    if (G->profiler.hw) p->current.hw = hw_delta(ReadHardwareCounters(G->metrics), p->current.hw);
 
     if (p->current.time < p->min.time || p->min.time == 0) {
         p->min = p->current;
@@ -151,72 +409,84 @@ void rep_end(RepProfiler *p) {
     p->avg.bytes += p->current.bytes;
     p->avg.time += p->current.time;
     p->avg.pageFaults += p->current.pageFaults;
+    hw_accumulate(&p->avg.hw, p->current.hw, (HwCounters){0});
 
     if (p->repeats == 0) p->first = p->current;
 
+    histogram_add(&p->time, p->current.time);
+    histogram_add(&p->bytes, p->current.bytes);
+    histogram_add(&p->pageFaults, p->current.pageFaults);
+
+    if (p->budget && p->current.time > p->budget) {
+        p->overBudget++;
+        p->streak++;
+        if (p->streak > p->longestStreak) p->longestStreak = p->streak;
+    } else {
+        p->streak = 0;
+    }
+
     p->repeats++;
 }
 
 void repprofiler_print(RepProfiler *p) {
-    INFO("Finished %s after %llu repeats.", p->name, p->repeats);
+    INFO("Finished %s after %" U64_FMT " repeats.", p->name, p->repeats);
 
     // FIRST
-    LARGE_INTEGER perfFreq = {0};
-    QueryPerformanceFrequency(&perfFreq);
+    u64 perfFreq = GetOSTimerFreq();
 
-    f64 firstTime = (f64)(p->first.time) / (f64)(perfFreq.QuadPart);
-    printf("\t> Initial: \t%.3f ms\t%.3f GB/s\t%llu pf\n", firstTime * 1000.0,
+    f64 firstTime = (f64)(p->first.time) / (f64)(perfFreq);
+    printf("\t> Initial: \t%.3f ms\t%.3f GB/s\t%" U64_FMT " pf\n", firstTime * 1000.0,
            to_gb((f64)(p->first.bytes) / firstTime), p->first.pageFaults);
 
     // MIN
-    f64 minTime = (f64)(p->min.time) / (f64)(perfFreq.QuadPart);
-    printf("\t> Fastest: \t%.3f ms\t%.3f GB/s\t%llu pf\n", minTime * 1000.0,
+    f64 minTime = (f64)(p->min.time) / (f64)(perfFreq);
+    printf("\t> Fastest: \t%.3f ms\t%.3f GB/s\t%" U64_FMT " pf\n", minTime * 1000.0,
            to_gb((f64)(p->min.bytes) / minTime), p->min.pageFaults);
 
     // MAX
-    f64 maxTime = (f64)(p->max.time) / (f64)(perfFreq.QuadPart);
-    printf("\t> Slowest: \t%.3f ms\t%.3f GB/s\t%llu pf\n", maxTime * 1000.0,
+    f64 maxTime = (f64)(p->max.time) / (f64)(perfFreq);
+    printf("\t> Slowest: \t%.3f ms\t%.3f GB/s\t%" U64_FMT " pf\n", maxTime * 1000.0,
            to_gb((f64)(p->max.bytes) / maxTime), p->max.pageFaults);
 
     // AVERAGE
     f64 avgBytes  = (f64)(p->avg.bytes) / (f64)(p->repeats);
     f64 avgFaults = (f64)(p->avg.pageFaults) / (f64)(p->repeats);
     f64 avgTime   = (f64)(p->avg.time) / (f64)(p->repeats);
-    avgTime /= (f64)(perfFreq.QuadPart);
+    avgTime /= (f64)(perfFreq);
 
     printf("\t> Average: \t%.3f ms\t%.3f GB/s\t%.2f pf\n", avgTime * 1000.0,
            to_gb((f64)(avgBytes) / avgTime), avgFaults);
-}
-
-#ifndef DISABLE_PROFILER
 
-#define BLOCK_BEGIN(name) block_begin(__COUNTER__ + 1, name, __FILE__, __LINE__, 0)
-#define BLOCK_END() block_end()
-#define PROFILE(name, code)                                 \
-    block_begin(__COUNTER__ + 1, name, __FILE__, __LINE__, 0); \
-    code;                                                   \
-    block_end();
-
-#define REPETITION_PROFILE(name, count)                        \
-    do {                                                       \
-        RepProfiler _profiler_ = repprofiler_new(name, count); \
-        while (_profiler_.repeats < _profiler_.maxRepeats) {   \
-            rep_begin(&_profiler_);
-
-#define REPETITION_END()  \
-    rep_end(&_profiler_); \
-    }                     \
-    }                     \
-    while (0)             \
-        ;
-
-#else
-
-#define BLOCK_BEGIN(...)
-#define BLOCK_END(...)
-#define PROFILE(name, code) code
+    // HARDWARE COUNTERS, averaged per repetition
+    if (G->profiler.hw) {
+        u64 *hw     = p->avg.hw.val;
+        f64  pixels = (f64)(p->avg.bytes) / sizeof(col32);
+        printf("\t> Counters: \t%.2f IPC\t%.2f branch MPKI",
+               hw[HW_CYCLES] ? (f64)hw[HW_INSTRUCTIONS] / (f64)hw[HW_CYCLES] : 0.0,
+               hw[HW_INSTRUCTIONS] ? (f64)hw[HW_BRANCH_MISSES] * 1000.0 / (f64)hw[HW_INSTRUCTIONS]
+                                   : 0.0);
+        if (pixels > 0) {
+            printf("\t%.4f L1D/px\t%.4f LLC/px", (f64)hw[HW_L1D_MISSES] / pixels,
+                   (f64)hw[HW_LLC_MISSES] / pixels);
+        }
+        printf("\n");
+    }
 
-#define REPETITION_PROFILE(...)
-#define REPETITION_END(...)
+    // PERCENTILES
+    const f64 percentiles[] = {50.0, 90.0, 99.0, 99.9};
+    printf("\t> Percentile \tTime\t\tBytes\t\tPage faults\t(upper bounds)\n");
+    for (i32 i = 0; i < 4; i++) {
+        f64 time = (f64)histogram_percentile(&p->time, percentiles[i]) / (f64)(perfFreq);
+        printf("\t> p%-5g \t%.3f ms\t%" U64_FMT "\t\t%" U64_FMT "\n", percentiles[i], time * 1000.0,
+               histogram_percentile(&p->bytes, percentiles[i]),
+               histogram_percentile(&p->pageFaults, percentiles[i]));
+    }
 
-#endif
+    // BUDGET
+    if (p->budget) {
+        f64 budget = (f64)(p->budget) / (f64)(perfFreq);
+        printf("\t> Over budget (%.3f ms): %" U64_FMT " (%.2f%%), longest streak: %" U64_FMT "\n",
+               budget * 1000.0, p->overBudget, (f64)(p->overBudget) / (f64)(p->repeats) * 100.0,
+               p->longestStreak);
+    }
+}
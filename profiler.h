@@ -2,43 +2,155 @@
 
 #include "base.h"
 
+typedef enum {
+    BS_EMPTY = 0,
+    BS_READY,
+    BS_DUPLICATE, // Lost a registration race, the block with the lower id is used instead
+} BlockState;
+
 typedef struct {
-    cstr label, file;
+    char label[32], file[64];
     i32  line;
+    u64  hash;
+
+    volatile i32 state;
 
     u64 iterations;
     u64 from, time_ex, time_inc;
 
     u64 bytesProcessed;
+
+    // Exclusive time spent during the last completed frame, see profiler_frame_end
+    u64 frame_ex, frame_mark;
+
+    // Exclusive hardware counter deltas, only sampled when Profiler.hw is set
+    HwCounters hw_from, hw_ex;
 } Block;
 
-#ifndef MAX_BLOCKS
-#define MAX_BLOCKS 128
+// Blocks live in fixed-size pages that are never moved, so a Block * stays valid while the table
+// grows. Block ids are stable for a given (file, line, label), even across hot reloads.
+#ifndef BLOCK_PAGE_SIZE
+#define BLOCK_PAGE_SIZE 64
+#endif
+
+#ifndef MAX_BLOCK_PAGES
+#define MAX_BLOCK_PAGES 64
+#endif
+
+#ifndef MAX_BLOCK_DEPTH
+#define MAX_BLOCK_DEPTH 64
+#endif
+
+#ifndef PROFILER_FRAME_HISTORY
+#define PROFILER_FRAME_HISTORY 120
 #endif
 
 typedef struct {
     cstr name;
     bool ended;
-    u64  start;
+    u64  start, freq;
+
+    Block *volatile pages[MAX_BLOCK_PAGES];
+    volatile i32    blocks_len;
+    u32             queue[MAX_BLOCK_DEPTH];
+    i32             queue_len;
+
+    // Sample hardware counters on every block_begin/block_end, costs a syscall each
+    bool hw;
 
-    Block blocks[MAX_BLOCKS];
-    i32   blocks_len;
-    u64   queue[MAX_BLOCKS];
-    i32   queue_len;
+    // Live overlay
+    bool overlay;
+    u64  frame_start;
+    u64  frame_times[PROFILER_FRAME_HISTORY];
+    u32  frame_index;
 } Profiler;
 
+bool profiler_enable_hw_counters();
+void profiler_frame_begin();
+void profiler_frame_end();
+void profiler_overlay(f64 budget_ms);
+
+Block *block_get(Profiler *p, u32 id);
+u32    block_register(cstr label, cstr file, i32 line);
+void   block_begin(u32 *id, cstr label, cstr file, i32 line, u64 bytesProcessed);
+void   block_bytes(u64 bytes);
+void   block_end();
+
 typedef struct {
-    u64 time, bytes, pageFaults;
+    u64        time, bytes, pageFaults;
+    HwCounters hw;
 } RepBlock;
 
+// Log-linear histogram: values below HIST_SUB_COUNT get exact buckets, above that every power of
+// two is split into HIST_SUB_COUNT linear buckets, for a relative error of at most 1/16.
+// Percentiles are the top of their bucket, an upper bound, clamped to the values actually seen.
+#define HIST_SUB_BITS 4
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+typedef struct {
+    u32 counts[HIST_BUCKETS];
+    u64 total;
+    u64 min, max;
+} Histogram;
+
+void histogram_add(Histogram *h, u64 val);
+u64  histogram_percentile(Histogram *h, f64 percentile);
+
 typedef struct {
     cstr     name;
     RepBlock first, min, max, avg, current;
     u64      repeats, maxRepeats;
+
+    Histogram time, bytes, pageFaults;
+
+    // Frame budget in timer ticks, 0 when unset
+    u64 budget, overBudget, streak, longestStreak;
 } RepProfiler;
 
 RepProfiler repprofiler_new(cstr name, u64 maxRepeats);
+void        rep_set_budget(RepProfiler *p, f64 ms);
 void        rep_begin(RepProfiler *p);
 void        rep_add_bytes(RepProfiler *p, u64 bytes);
 void        rep_end(RepProfiler *p);
-void        repprofiler_print(RepProfiler *p);
\ No newline at end of file
+void        repprofiler_print(RepProfiler *p);
+
+#ifndef DISABLE_PROFILER
+
+// Each call site caches its block id in a static, so registration only happens on first use.
+#define BLOCK_ID_(line) _block_id_##line
+#define BLOCK_ID(line) BLOCK_ID_(line)
+
+#define BLOCK_BEGIN(name)               \
+    persist u32 BLOCK_ID(__LINE__) = 0; \
+    block_begin(&BLOCK_ID(__LINE__), name, __FILE__, __LINE__, 0)
+#define BLOCK_END() block_end()
+#define PROFILE(name, code)                                        \
+    persist u32 BLOCK_ID(__LINE__) = 0;                            \
+    block_begin(&BLOCK_ID(__LINE__), name, __FILE__, __LINE__, 0); \
+    code;                                                          \
+    block_end();
+
+#define REPETITION_PROFILE(name, count)                        \
+    do {                                                       \
+        RepProfiler _profiler_ = repprofiler_new(name, count); \
+        while (_profiler_.repeats < _profiler_.maxRepeats) {   \
+            rep_begin(&_profiler_);
+
+#define REPETITION_END()  \
+    rep_end(&_profiler_); \
+    }                     \
+    }                     \
+    while (0)             \
+        ;
+
+#else
+
+#define BLOCK_BEGIN(...)
+#define BLOCK_END(...)
+#define PROFILE(name, code) code
+
+#define REPETITION_PROFILE(...)
+#define REPETITION_END(...)
+
+#endif
@@ -0,0 +1,123 @@
+#define ENGINE_IMPL
+#include "base_linux.c"
+#include "profiler.c"
+
+#include <stdlib.h>
+
+// Rasterizes a captured draw stream (see main_headless.c --capture) without running the game.
+// Every repetition replays all frames, or a single one with --frame, into an offscreen buffer.
+
+static void usage(cstr exe) {
+    printf("Usage: %s stream.draw [--repeats N] [--frame N] [--budget ms] [--hw-counters]\n",
+           exe);
+}
+
+i32 main(i32 argc, char **argv) {
+    cstr path        = NULL;
+    u64  repeats     = 100;
+    i32  only_frame  = -1;
+    f64  budget_ms   = 0.0;
+    bool hw_counters = false;
+
+    for (i32 i = 1; i < argc; i++) {
+        cstr arg  = argv[i];
+        bool more = i + 1 < argc;
+        if (strcmp(arg, "--repeats") == 0 && more) {
+            repeats = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(arg, "--frame") == 0 && more) {
+            only_frame = atoi(argv[++i]);
+        } else if (strcmp(arg, "--budget") == 0 && more) {
+            budget_ms = atof(argv[++i]);
+        } else if (strcmp(arg, "--hw-counters") == 0) {
+            hw_counters = true;
+        } else if (arg[0] != '-' && !path) {
+            path = arg;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!path) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    {
+        Arena perm = arena_new(MB(128), NULL);
+
+        G  = (EngineData *)alloc(sizeof(EngineData), &perm);
+        *G = (EngineData){
+            .ctx =
+                {
+                    .perm = perm,
+                },
+            .draw_size   = 1024,
+            .metrics     = metrics_init(),
+            .system_info = systeminfo_init(),
+            .profiler    = profiler_new("Handmade Renderer (replay)"),
+        };
+        ctx()->temp = arena_new(MB(8), &ctx()->perm);
+    }
+    if (hw_counters) profiler_enable_hw_counters();
+
+    DrawStream stream = draw_stream_load((char *)path);
+    if (!stream.data) FATAL("Couldn't load draw stream %s", path);
+
+    DrawStreamHeader *header = draw_stream_header(&stream);
+    G->screen_size           = header->screen_size;
+    G->screen_buf            = ALLOC_ARRAY(u32, G->screen_size.w * G->screen_size.h);
+    G->draw_queue            = ALLOC_ARRAY(DrawCmd, G->draw_size);
+
+    // Index the frames once, replay only walks this array
+    DrawStreamFrame **frames     = ALLOC_ARRAY(DrawStreamFrame *, header->frames);
+    i32               frames_len = 0;
+    for (DrawStreamFrame *frame = draw_stream_next(&stream, NULL);
+         frame && frames_len < header->frames; frame = draw_stream_next(&stream, frame)) {
+        frames[frames_len++] = frame;
+    }
+    if (frames_len < header->frames) WARN("Stream is truncated, found %d frames", frames_len);
+
+    i32 first = 0, last = frames_len;
+    if (only_frame >= 0) {
+        if (only_frame >= frames_len)
+            FATAL("Frame %d out of range, the stream has %d", only_frame, frames_len);
+        first = only_frame;
+        last  = only_frame + 1;
+    }
+
+    INFO("Replaying %s: %d of %d frames at %dx%d, %" U64_FMT " repeats", path, last - first,
+         frames_len, G->screen_size.w, G->screen_size.h, repeats);
+
+    u64 frame_bytes = G->screen_size.w * G->screen_size.h * sizeof(u32);
+
+    RepProfiler rep = repprofiler_new("replay", repeats);
+    if (budget_ms > 0.0) rep_set_budget(&rep, budget_ms);
+    while (rep.repeats < rep.maxRepeats) {
+        rep_begin(&rep);
+        for (i32 i = first; i < last; i++) {
+            draw_stream_replay(frames[i]);
+
+            BLOCK_BEGIN("raster");
+            render_draw_queue();
+            render_text_queue();
+            block_bytes(frame_bytes);
+            BLOCK_END();
+
+            ctx()->temp.used = 0;
+        }
+        rep_add_bytes(&rep, frame_bytes * (last - first));
+        rep_end(&rep);
+    }
+
+    // Output of the final frame, to check a rasterizer change didn't alter any pixels
+    u64 hash = 0xcbf29ce484222325ull;
+    for (i32 i = 0; i < G->screen_size.w * G->screen_size.h; i++) {
+        hash ^= G->screen_buf[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    repprofiler_print(&rep);
+    INFO("Final frame hash %016lx", hash);
+    profiler_end();
+    return 0;
+}
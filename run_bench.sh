@@ -0,0 +1,3 @@
+#!/bin/sh
+
+cc -O2 -fno-builtin-log -march=native $CFLAGS bench.c -o handmade_bench -lm && ./handmade_bench "$@"
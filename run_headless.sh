@@ -0,0 +1,3 @@
+#!/bin/sh
+
+cc -O2 -fno-builtin-log main_headless.c -o handmade_headless -lm && ./handmade_headless "$@"
@@ -0,0 +1,3 @@
+#!/bin/sh
+
+cc -O2 -fno-builtin-log replay.c -o handmade_replay -lm && ./handmade_replay "$@"
@@ -1,4 +1,8 @@
+#ifdef _WIN32
 #include "base_win.c"
+#else
+#include "base_linux.c"
+#endif
 
 export Info game = {
     .name    = "Template",